@@ -0,0 +1,98 @@
+/**
+  @file
+
+  @brief
+  Throughput of binlog_crc32() against zlib's crc32(), which
+  read_log_event() used to verify the checksum of received events.
+
+  Not part of the default build:
+    cmake --build . --target bench_crc32 && ./bench/bench_crc32
+*/
+
+#include "binlog/binlog_checksum.h"
+
+#include <zlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* bytes checksummed per kernel and size */
+static const ulonglong BENCH_TOTAL_BYTES= 4ULL << 30;
+/* an average row event, a large one and a large transaction */
+static const size_t bench_sizes[]= { 200, 8192, 1 << 20 };
+
+
+static double now_sec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+  Compare both kernels over every length up to 2000 bytes at every
+  alignment of a word.
+
+  @retval false  identical results
+  @retval true   a mismatch, printed
+*/
+static bool check_kernel(const uchar *buf)
+{
+  for (size_t len= 0; len < 2000; len++)
+  {
+    for (size_t off= 0; off < 8; off++)
+    {
+      uint32 ours= binlog_crc32(0, buf + off, len);
+      uint32 zlib= (uint32) crc32(0, buf + off, (uInt) len);
+      if (ours != zlib)
+      {
+        printf("mismatch at length %lu offset %lu: %08x, zlib %08x\n",
+               (ulong) len, (ulong) off, ours, zlib);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+int main()
+{
+  size_t buf_size= (1 << 20) + 8;
+  uchar *buf= (uchar *) malloc(buf_size);
+  if (!buf)
+    return 1;
+  srand(1);
+  for (size_t i= 0; i < buf_size; i++)
+    buf[i]= (uchar) rand();
+
+  printf("binlog_crc32 kernel: %s\n", binlog_crc32_implementation());
+  if (check_kernel(buf))
+    return 1;
+
+  /* the sum keeps the compiler from dropping the loops */
+  uint32 sum= 0;
+  printf("%10s %14s %14s\n", "bytes", "binlog_crc32", "zlib crc32");
+  for (size_t i= 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+  {
+    size_t len= bench_sizes[i];
+    ulonglong rounds= BENCH_TOTAL_BYTES / len;
+
+    double start= now_sec();
+    for (ulonglong r= 0; r < rounds; r++)
+      sum+= binlog_crc32(0, buf, len);
+    double ours= now_sec() - start;
+
+    start= now_sec();
+    for (ulonglong r= 0; r < rounds; r++)
+      sum+= (uint32) crc32(0, buf, (uInt) len);
+    double zlib= now_sec() - start;
+
+    printf("%10lu %9.2f GB/s %9.2f GB/s\n", (ulong) len,
+           BENCH_TOTAL_BYTES / ours / 1e9, BENCH_TOTAL_BYTES / zlib / 1e9);
+  }
+  printf("(checksum of the results %08x)\n", sum);
+  free(buf);
+  return 0;
+}
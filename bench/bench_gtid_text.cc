@@ -0,0 +1,204 @@
+/**
+  @file
+
+  @brief
+  Loading a large gtid_executed: gtid_text_parse() plus one
+  add_gtid_encoding(), as set_gtid_executed() does, against
+  Gtid_set::add_gtid_text() alone. The text holds 500 UUIDs with 20
+  intervals each, about 105 KB.
+
+  Not part of the default build:
+    cmake --build . --target bench_gtid_text && ./bench/bench_gtid_text
+*/
+
+#define MYSQL_CLIENT
+
+#include "my_global.h"
+#include "my_sys.h"
+#include "gtid/gtid_text_parser.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <string>
+
+/* BINLOG_ERROR in rpl_gtid.h reports through these */
+static void error(const char *format, ...)
+  MY_ATTRIBUTE((format(printf, 1, 2)));
+static void warning(const char *format, ...)
+  MY_ATTRIBUTE((format(printf, 1, 2)));
+
+#include "rpl_gtid.h"
+
+Sid_map *global_sid_map= NULL;
+Checkable_rwlock *global_sid_lock= NULL;
+
+static const int BENCH_UUIDS= 500;
+static const int BENCH_INTERVALS= 20;
+static const int BENCH_ROUNDS= 200;
+
+
+static void error(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "ERROR: ");
+  vfprintf(stderr, format, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+
+static void warning(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "WARNING: ");
+  vfprintf(stderr, format, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+
+static double now_sec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/** gtid_executed as the server prints it, upper case UUIDs. */
+static std::string make_gtid_text()
+{
+  std::string text;
+  char buf[64];
+  for (int uuid= 0; uuid < BENCH_UUIDS; uuid++)
+  {
+    if (uuid)
+      text+= ",\n";
+    snprintf(buf, sizeof(buf), "%08X-71CA-11E1-9E33-C80AA94%05d",
+             (uint) (uuid * 2654435761U), uuid);
+    text+= buf;
+    for (int i= 0; i < BENCH_INTERVALS; i++)
+    {
+      snprintf(buf, sizeof(buf), ":%d-%d", i * 1000 + 1, i * 1000 + 500);
+      text+= buf;
+    }
+  }
+  return text;
+}
+
+
+/**
+  The set_gtid_executed() path: parse without the lock, add the
+  encoding under it.
+
+  @param[out] locked  seconds spent under global_sid_lock
+
+  @retval false  ok
+  @retval true   error, printed
+*/
+static bool load_parsed(const char *text, Gtid_set *set, double *locked)
+{
+  Received_gtid_set parsed;
+  if (gtid_text_parse(text, &parsed))
+  {
+    error("gtid_text_parse() rejected the text");
+    return true;
+  }
+  size_t len= parsed.get_encoded_length();
+  uchar *encoded= (uchar *) my_malloc(PSI_NOT_INSTRUMENTED, len, MYF(MY_WME));
+  if (!encoded)
+    return true;
+  parsed.encode(encoded);
+
+  double start= now_sec();
+  global_sid_lock->wrlock();
+  bool failed= set->add_gtid_encoding(encoded, len) != RETURN_STATUS_OK;
+  global_sid_lock->unlock();
+  *locked+= now_sec() - start;
+
+  my_free(encoded);
+  if (failed)
+    error("add_gtid_encoding() failed");
+  return failed;
+}
+
+
+/** The former path, all of it under global_sid_lock. */
+static bool load_text(const char *text, Gtid_set *set)
+{
+  global_sid_lock->wrlock();
+  bool failed= set->add_gtid_text(text) != RETURN_STATUS_OK;
+  global_sid_lock->unlock();
+  if (failed)
+    error("add_gtid_text() failed");
+  return failed;
+}
+
+
+int main(int argc, char **argv)
+{
+  MY_INIT(argv[0]);
+  (void) argc;
+  if (!(global_sid_lock= new Checkable_rwlock))
+    return 1;
+
+  std::string text= make_gtid_text();
+  printf("%d UUIDs x %d intervals, %lu bytes, %d rounds\n", BENCH_UUIDS,
+         BENCH_INTERVALS, (ulong) text.size(), BENCH_ROUNDS);
+
+  /* each round starts from an empty Sid_map, as at startup */
+  double parsed_time= 0, parsed_locked= 0, text_time= 0;
+  for (int round= 0; round < BENCH_ROUNDS; round++)
+  {
+    Sid_map parsed_map(global_sid_lock);
+    Sid_map text_map(global_sid_lock);
+    Gtid_set parsed_set(&parsed_map);
+    Gtid_set text_set(&text_map);
+
+    double start= now_sec();
+    if (load_parsed(text.c_str(), &parsed_set, &parsed_locked))
+      return 1;
+    parsed_time+= now_sec() - start;
+
+    start= now_sec();
+    if (load_text(text.c_str(), &text_set))
+      return 1;
+    text_time+= now_sec() - start;
+
+    if (round == 0)
+    {
+      char *a= NULL, *b= NULL;
+      global_sid_lock->rdlock();
+      parsed_set.to_string(&a);
+      text_set.to_string(&b);
+      global_sid_lock->unlock();
+      bool differ= strcmp(a, b) != 0;
+      my_free(a);
+      my_free(b);
+      if (differ)
+      {
+        error("the two paths built different sets");
+        return 1;
+      }
+    }
+  }
+
+  printf("gtid_text_parse + add_gtid_encoding %8.3f ms, %8.3f ms locked\n",
+         parsed_time * 1000 / BENCH_ROUNDS,
+         parsed_locked * 1000 / BENCH_ROUNDS);
+  printf("add_gtid_text                       %8.3f ms, all of it locked\n",
+         text_time * 1000 / BENCH_ROUNDS);
+
+  delete global_sid_lock;
+  my_end(0);
+  return 0;
+}
+
+/* compiled for the client, as in virtual_slave.cc */
+#include "rpl_gtid_sid_map.cc"
+#include "rpl_gtid_misc.cc"
+#include "rpl_gtid_set.cc"
+#include "rpl_gtid_specification.cc"
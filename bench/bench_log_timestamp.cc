@@ -0,0 +1,113 @@
+/**
+  @file
+
+  @brief
+  Cost of the timestamp of a log line: make_iso8601_timestamp() with
+  its per thread cache against localtime_r() and my_snprintf() on every
+  line, as it was before. Both include the my_micro_time() call.
+
+  Not part of the default build:
+    cmake --build . --target bench_log_timestamp && ./bench/bench_log_timestamp
+*/
+
+/* make_iso8601_timestamp() is static */
+#include "log/vs_log.cc"
+
+#include <stdio.h>
+#include <time.h>
+
+static const int BENCH_CALLS= 2000000;
+
+
+static double now_sec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/** make_iso8601_timestamp() without the cache. */
+static int make_uncached_timestamp(char *buf, ulonglong utime= 0)
+{
+  struct tm my_tm;
+  char tzinfo[7];
+  time_t seconds;
+
+  if (utime == 0)
+    utime= my_micro_time();
+  seconds= utime / 1000000;
+  utime= utime % 1000000;
+  localtime_r(&seconds, &my_tm);
+
+  long tim= timezone;
+  char dir= '-';
+  if (tim < 0)
+  {
+    dir= '+';
+    tim= -tim;
+  }
+  my_snprintf(tzinfo, sizeof(tzinfo), "%c%02d:%02d",
+              dir, (int) (tim / (60 * 60)), (int) ((tim / 60) % 60));
+  size_t len= my_snprintf(buf, iso8601_size,
+                          "%04d-%02d-%02dT%02d:%02d:%02d.%06lu%s",
+                          my_tm.tm_year + 1900, my_tm.tm_mon + 1,
+                          my_tm.tm_mday, my_tm.tm_hour, my_tm.tm_min,
+                          my_tm.tm_sec, (unsigned long) utime, tzinfo);
+  return min<int>(len, iso8601_size - 1);
+}
+
+
+/**
+  Both give the same timestamps, within a second and across seconds.
+
+  @retval false  identical
+  @retval true   a difference, printed
+*/
+static bool check_timestamps()
+{
+  char cached[iso8601_size], uncached[iso8601_size];
+  ulonglong base= my_micro_time();
+  for (ulonglong step= 0; step < 3000000; step+= 7919)
+  {
+    make_iso8601_timestamp(cached, base + step);
+    make_uncached_timestamp(uncached, base + step);
+    if (strcmp(cached, uncached))
+    {
+      printf("timestamps differ: %s, uncached %s\n", cached, uncached);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+int main(int argc, char **argv)
+{
+  MY_INIT(argv[0]);
+  (void) argc;
+  tzset();
+  if (check_timestamps())
+    return 1;
+
+  char buf[iso8601_size];
+  /* the sum keeps the compiler from dropping the loops */
+  long sum= 0;
+
+  double start= now_sec();
+  for (int i= 0; i < BENCH_CALLS; i++)
+    sum+= make_iso8601_timestamp(buf) + buf[iso8601_usec_offset + 5];
+  double cached= now_sec() - start;
+
+  start= now_sec();
+  for (int i= 0; i < BENCH_CALLS; i++)
+    sum+= make_uncached_timestamp(buf) + buf[iso8601_usec_offset + 5];
+  double uncached= now_sec() - start;
+
+  printf("%d timestamps, last %s\n", BENCH_CALLS, buf);
+  printf("cached   %6.1f ns per line\n", cached * 1e9 / BENCH_CALLS);
+  printf("uncached %6.1f ns per line\n", uncached * 1e9 / BENCH_CALLS);
+  printf("(sum %ld)\n", sum);
+  my_end(0);
+  return 0;
+}
@@ -0,0 +1,322 @@
+/**
+  @file
+
+  @brief
+  CRC32 kernels, see binlog_checksum.h.
+
+  The PCLMULQDQ kernel follows "Fast CRC Computation for Generic
+  Polynomials Using PCLMULQDQ Instruction" (Intel, 2009) with the
+  bit-reflected constants of the zlib polynomial 0xEDB88320: four
+  128 bit lanes are folded over 64 byte blocks, then into one lane,
+  then reduced to 32 bits with a Barrett reduction.
+*/
+
+#include "binlog_checksum.h"
+#include "binlog_raw.h"
+#include "binlog_file.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_CRC32_PCLMUL
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+typedef uint32 (*crc32_func)(uint32 crc, const uchar *buf, size_t len);
+
+static uint32 crc32_table[8][256];
+static crc32_func crc32_kernel= NULL;
+static const char *crc32_kernel_name= "";
+static pthread_once_t crc32_once= PTHREAD_ONCE_INIT;
+
+
+/**
+  Slice-by-8: eight bytes per step through eight tables, each table
+  advancing the CRC over one more zero byte.
+*/
+static uint32 crc32_slice8(uint32 crc, const uchar *buf, size_t len)
+{
+  crc= ~crc;
+  while (len && ((size_t) buf & 7))
+  {
+    crc= crc32_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    len--;
+  }
+  while (len >= 8)
+  {
+    uint32 one= uint4korr(buf) ^ crc;
+    uint32 two= uint4korr(buf + 4);
+    crc= crc32_table[7][one & 0xff] ^
+         crc32_table[6][(one >> 8) & 0xff] ^
+         crc32_table[5][(one >> 16) & 0xff] ^
+         crc32_table[4][one >> 24] ^
+         crc32_table[3][two & 0xff] ^
+         crc32_table[2][(two >> 8) & 0xff] ^
+         crc32_table[1][(two >> 16) & 0xff] ^
+         crc32_table[0][two >> 24];
+    buf+= 8;
+    len-= 8;
+  }
+  while (len--)
+    crc= crc32_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+
+#ifdef HAVE_CRC32_PCLMUL
+/**
+  Fold a multiple of 16 bytes, at least 64, into the CRC. crc is not
+  inverted here, the caller does that.
+*/
+__attribute__((target("pclmul,sse4.1")))
+static uint32 crc32_fold(uint32 crc, const uchar *buf, size_t len)
+{
+  static const ulonglong k1k2[2] MY_ATTRIBUTE((aligned(16)))=
+    { 0x0154442bd4ULL, 0x01c6e41596ULL };
+  static const ulonglong k3k4[2] MY_ATTRIBUTE((aligned(16)))=
+    { 0x01751997d0ULL, 0x00ccaa009eULL };
+  static const ulonglong k5k0[2] MY_ATTRIBUTE((aligned(16)))=
+    { 0x0163cd6124ULL, 0x0000000000ULL };
+  static const ulonglong poly[2] MY_ATTRIBUTE((aligned(16)))=
+    { 0x01db710641ULL, 0x01f7011641ULL };
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1= _mm_loadu_si128((const __m128i *) (buf + 0x00));
+  x2= _mm_loadu_si128((const __m128i *) (buf + 0x10));
+  x3= _mm_loadu_si128((const __m128i *) (buf + 0x20));
+  x4= _mm_loadu_si128((const __m128i *) (buf + 0x30));
+  x1= _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+  x0= _mm_load_si128((const __m128i *) k1k2);
+  buf+= 64;
+  len-= 64;
+
+  /* Four lanes in parallel. */
+  while (len >= 64)
+  {
+    x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6= _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7= _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8= _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2= _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3= _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4= _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    y5= _mm_loadu_si128((const __m128i *) (buf + 0x00));
+    y6= _mm_loadu_si128((const __m128i *) (buf + 0x10));
+    y7= _mm_loadu_si128((const __m128i *) (buf + 0x20));
+    y8= _mm_loadu_si128((const __m128i *) (buf + 0x30));
+
+    x1= _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2= _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3= _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4= _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+    buf+= 64;
+    len-= 64;
+  }
+
+  /* Fold the four lanes into one. */
+  x0= _mm_load_si128((const __m128i *) k3k4);
+
+  x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1= _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1= _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1= _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* Remaining 16 byte blocks. */
+  while (len >= 16)
+  {
+    x2= _mm_loadu_si128((const __m128i *) buf);
+    x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1= _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    buf+= 16;
+    len-= 16;
+  }
+
+  /* 128 bits to 64. */
+  x2= _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3= _mm_setr_epi32(~0, 0, ~0, 0);
+  x1= _mm_srli_si128(x1, 8);
+  x1= _mm_xor_si128(x1, x2);
+
+  x0= _mm_loadl_epi64((const __m128i *) k5k0);
+  x2= _mm_srli_si128(x1, 4);
+  x1= _mm_and_si128(x1, x3);
+  x1= _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1= _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits. */
+  x0= _mm_load_si128((const __m128i *) poly);
+  x2= _mm_and_si128(x1, x3);
+  x2= _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2= _mm_and_si128(x2, x3);
+  x2= _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1= _mm_xor_si128(x1, x2);
+
+  return (uint32) _mm_extract_epi32(x1, 1);
+}
+
+
+static uint32 crc32_pclmul(uint32 crc, const uchar *buf, size_t len)
+{
+  /* Short events are not worth the setup of the folding. */
+  if (len >= 64)
+  {
+    size_t fold_len= len & ~(size_t) 15;
+    crc= ~crc32_fold(~crc, buf, fold_len);
+    buf+= fold_len;
+    len-= fold_len;
+  }
+  return len ? crc32_slice8(crc, buf, len) : crc;
+}
+
+
+static bool cpu_has_pclmul()
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+  return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+#endif
+
+
+static void crc32_init()
+{
+  for (uint32 i= 0; i < 256; i++)
+  {
+    uint32 crc= i;
+    for (int bit= 0; bit < 8; bit++)
+      crc= (crc & 1) ? (crc >> 1) ^ 0xEDB88320U : crc >> 1;
+    crc32_table[0][i]= crc;
+  }
+  for (uint32 i= 0; i < 256; i++)
+  {
+    for (int k= 1; k < 8; k++)
+      crc32_table[k][i]= (crc32_table[k - 1][i] >> 8) ^
+                         crc32_table[0][crc32_table[k - 1][i] & 0xff];
+  }
+
+  crc32_kernel= crc32_slice8;
+  crc32_kernel_name= "slice-by-8";
+#ifdef HAVE_CRC32_PCLMUL
+  if (cpu_has_pclmul())
+  {
+    crc32_kernel= crc32_pclmul;
+    crc32_kernel_name= "pclmulqdq";
+  }
+#endif
+}
+
+
+uint32 binlog_crc32(uint32 crc, const uchar *buf, size_t len)
+{
+  pthread_once(&crc32_once, crc32_init);
+  return crc32_kernel(crc, buf, len);
+}
+
+
+const char *binlog_crc32_implementation()
+{
+  pthread_once(&crc32_once, crc32_init);
+  return crc32_kernel_name;
+}
+
+
+bool binlog_event_checksum_failed(const uchar *event, size_t len,
+                                  binary_log::enum_binlog_checksum_alg alg)
+{
+  if (alg != binary_log::BINLOG_CHECKSUM_ALG_CRC32)
+    return false;
+  if (len < LOG_EVENT_HEADER_LEN + BINLOG_CHECKSUM_LEN)
+    return true;
+
+  size_t data_len= len - BINLOG_CHECKSUM_LEN;
+  uint32 crc;
+  if (raw_event_type(event) == binary_log::FORMAT_DESCRIPTION_EVENT &&
+      (event[FLAGS_OFFSET] & RAW_LOG_EVENT_BINLOG_IN_USE_F))
+  {
+    /* The server computed the checksum with the in-use flag cleared. */
+    uchar flags= event[FLAGS_OFFSET] & ~RAW_LOG_EVENT_BINLOG_IN_USE_F;
+    crc= binlog_crc32(0, event, FLAGS_OFFSET);
+    crc= binlog_crc32(crc, &flags, 1);
+    crc= binlog_crc32(crc, event + FLAGS_OFFSET + 1,
+                      data_len - FLAGS_OFFSET - 1);
+  }
+  else
+    crc= binlog_crc32(0, event, data_len);
+  return crc != uint4korr(event + data_len);
+}
+
+
+bool binlog_file_verify(const char *log_name, my_off_t *bad_pos)
+{
+  binary_log::enum_binlog_checksum_alg alg= binary_log::BINLOG_CHECKSUM_ALG_OFF;
+  uchar header[LOG_EVENT_HEADER_LEN];
+  uchar *buf= NULL;
+  size_t buf_size= 0;
+  my_off_t pos= BIN_LOG_HEADER_SIZE;
+  my_off_t size;
+  bool failed= false;
+  Binlog_file *file;
+
+  *bad_pos= 0;
+  if (!(file= binlog_file_open(log_name)))
+    return true;
+  size= binlog_file_size(file);
+
+  while (pos < size)
+  {
+    uint32 len;
+    if (binlog_file_pread(file, header, sizeof(header), pos) !=
+        sizeof(header) ||
+        (len= raw_event_len(header)) < LOG_EVENT_HEADER_LEN)
+    {
+      failed= true;
+      break;
+    }
+    if (buf_size < len)
+    {
+      uchar *new_buf= (uchar *) realloc(buf, len);
+      if (!new_buf)
+      {
+        failed= true;
+        break;
+      }
+      buf= new_buf;
+      buf_size= len;
+    }
+    if (binlog_file_pread(file, buf, len, pos) != (ssize_t) len)
+    {
+      failed= true;
+      break;
+    }
+    if (raw_event_type(buf) == binary_log::FORMAT_DESCRIPTION_EVENT)
+      alg= raw_fde_checksum_alg(buf, len);
+    if (binlog_event_checksum_failed(buf, len, alg))
+    {
+      failed= true;
+      break;
+    }
+    pos+= len;
+  }
+
+  if (failed)
+    *bad_pos= pos;
+  free(buf);
+  binlog_file_close(file);
+  return failed;
+}
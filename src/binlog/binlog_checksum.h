@@ -0,0 +1,53 @@
+/**
+  @file
+
+  @brief
+  CRC32 of binlog events, bit compatible with zlib's crc32() that the
+  server uses to write the checksum trailer.
+
+  On x86-64 CPUs with PCLMULQDQ the data is folded 64 bytes at a time
+  with carry-less multiplications, elsewhere a slice-by-8 table kernel
+  is used. The choice is made once, at the first call.
+*/
+
+#ifndef MYSQL_BINLOG_CHECKSUM_H
+#define MYSQL_BINLOG_CHECKSUM_H
+
+#include "my_global.h"
+#include "binlog_event.h"
+
+/**
+  Continue a CRC32 over buf, start with crc 0.
+*/
+uint32 binlog_crc32(uint32 crc, const uchar *buf, size_t len);
+
+/** Name of the kernel binlog_crc32() uses, for the log. */
+const char *binlog_crc32_implementation();
+
+/**
+  Check the checksum trailer of an event, like
+  Log_event_footer::event_checksum_test() but without modifying the
+  event.
+
+  @param event  the event
+  @param len    length of the event, including the trailer
+  @param alg    checksum algorithm in effect for the event
+
+  @retval false  the checksum matches, or the event has none
+  @retval true   mismatch
+*/
+bool binlog_event_checksum_failed(const uchar *event, size_t len,
+                                  binary_log::enum_binlog_checksum_alg alg);
+
+/**
+  Check the checksums of all events of a binlog, plain or compressed.
+
+  @param log_name      binlog to check
+  @param[out] bad_pos  offset of the first bad or truncated event
+
+  @retval false  all events are fine
+  @retval true   a bad event, or the binlog could not be read
+*/
+bool binlog_file_verify(const char *log_name, my_off_t *bad_pos);
+
+#endif //MYSQL_BINLOG_CHECKSUM_H
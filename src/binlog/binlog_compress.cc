@@ -0,0 +1,304 @@
+/**
+  @file
+
+  @brief
+  Binlog compressor, see binlog_compress.h.
+
+  A binlog is compressed to <name>.vsz.tmp, synced, renamed to
+  <name>.vsz and only then is the plain file removed, so at any time at
+  least one complete copy exists under a name binlog_file_open() finds.
+  Readers that already have the plain file open keep reading it.
+*/
+
+#include "binlog_compress.h"
+#include "binlog_file.h"
+#include "binlog_checksum.h"
+#include "log/vs_log.h"
+
+#include <zlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/* seconds between two looks at the index when nothing is notified */
+static const int COMPRESS_POLL_SECONDS= 60;
+
+static pthread_mutex_t compress_lock= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compress_cond= PTHREAD_COND_INITIALIZER;
+static pthread_t compress_thread;
+static volatile bool compress_running= false;
+static bool compress_pending= false;
+
+static char compress_index_file[FN_REFLEN + 1];
+static uint compress_keep_files= 0;
+static int compress_level= Z_DEFAULT_COMPRESSION;
+/* binlogs that failed verification, only used by the compressor thread */
+static std::set<string> damaged_binlogs;
+
+
+/**
+  Run the calling thread at idle CPU and IO priority, so compression only
+  uses what the receive thread leaves.
+*/
+static void lower_priority()
+{
+#ifdef __linux__
+  struct sched_param param;
+  param.sched_priority= 0;
+  if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param))
+    sql_print_warning("Binlog compressor: could not switch to SCHED_IDLE");
+#ifdef SYS_ioprio_set
+  /* IOPRIO_WHO_PROCESS with id 0 is the calling thread, class IDLE */
+  const int ioprio_who_process= 1;
+  const int ioprio_class_idle= 3;
+  const int ioprio_class_shift= 13;
+  if (syscall(SYS_ioprio_set, ioprio_who_process, 0,
+              ioprio_class_idle << ioprio_class_shift))
+    sql_print_warning("Binlog compressor: could not lower the IO priority");
+#endif
+#endif
+}
+
+
+static bool write_all(int fd, const uchar *buf, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t written= write(fd, buf, len);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return true;
+    }
+    buf+= written;
+    len-= written;
+  }
+  return false;
+}
+
+
+/**
+  Write the compressed copy of the plain binlog open as in to out.
+
+  @return size of the compressed copy, 0 on error or when stopped
+*/
+static my_off_t write_frames(int in, my_off_t size, int out)
+{
+  uLong packed_max= compressBound(BINLOG_FRAME_SIZE);
+  uchar *frame= (uchar *) malloc(BINLOG_FRAME_SIZE);
+  uchar *packed= (uchar *) malloc(packed_max);
+  vector<ulonglong> offsets;
+  my_off_t written= 0;
+  uchar footer[BINLOG_COMPRESSED_FOOTER_LEN];
+  bool failed= !frame || !packed;
+
+  for (my_off_t pos= 0; !failed && pos < size; pos+= BINLOG_FRAME_SIZE)
+  {
+    size_t frame_len= (size_t) std::min<my_off_t>(BINLOG_FRAME_SIZE,
+                                                  size - pos);
+    uLongf packed_len= packed_max;
+    if (!compress_running ||
+        pread(in, frame, frame_len, (off_t) pos) != (ssize_t) frame_len ||
+        compress2(packed, &packed_len, frame, frame_len, compress_level) !=
+        Z_OK ||
+        write_all(out, packed, packed_len))
+    {
+      failed= true;
+      break;
+    }
+    offsets.push_back(written);
+    written+= packed_len;
+  }
+
+  if (!failed)
+  {
+    for (size_t i= 0; !failed && i < offsets.size(); i++)
+    {
+      uchar entry[8];
+      int8store(entry, offsets[i]);
+      failed= write_all(out, entry, sizeof(entry));
+    }
+    int8store(footer, written);
+    int8store(footer + 8, size);
+    int4store(footer + 16, (uint32) offsets.size());
+    int4store(footer + 20, (uint32) BINLOG_FRAME_SIZE);
+    memcpy(footer + 24, BINLOG_COMPRESSED_MAGIC, BINLOG_COMPRESSED_MAGIC_LEN);
+    failed= failed || write_all(out, footer, sizeof(footer)) || fsync(out);
+  }
+
+  free(frame);
+  free(packed);
+  return failed ? 0 : written + offsets.size() * 8 + sizeof(footer);
+}
+
+
+/**
+  Compress one closed binlog, a binlog that is no longer plain is left
+  alone.
+*/
+static void compress_file(const char *log_name)
+{
+  char tmp_name[FN_REFLEN + 16];
+  char vsz_name[FN_REFLEN + 16];
+  struct stat in_stat, now_stat;
+  my_off_t packed_size;
+  int in, out;
+
+  /* Do not archive a damaged binlog, it stays plain for inspection. */
+  my_off_t bad_pos;
+  if (access(log_name, F_OK) || damaged_binlogs.count(log_name))
+    return;
+  if (binlog_file_verify(log_name, &bad_pos))
+  {
+    damaged_binlogs.insert(log_name);
+    sql_print_error("Binlog compressor: '%s' has a bad event at %llu, "
+                    "not compressing it", log_name, (ulonglong) bad_pos);
+    return;
+  }
+
+  if ((in= open(log_name, O_RDONLY)) < 0)
+    return;
+  if (fstat(in, &in_stat))
+  {
+    close(in);
+    return;
+  }
+
+  my_snprintf(vsz_name, sizeof(vsz_name), "%s%s", log_name,
+              BINLOG_COMPRESSED_EXT);
+  my_snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", vsz_name);
+  if ((out= open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0660)) < 0)
+  {
+    sql_print_error("Binlog compressor: could not create '%s', errno %d",
+                    tmp_name, errno);
+    close(in);
+    return;
+  }
+
+  packed_size= write_frames(in, (my_off_t) in_stat.st_size, out);
+  close(out);
+
+  /* The binlog may have been removed by a reset meanwhile. */
+  if (!packed_size || stat(log_name, &now_stat) ||
+      now_stat.st_ino != in_stat.st_ino ||
+      now_stat.st_size != in_stat.st_size ||
+      rename(tmp_name, vsz_name))
+  {
+    if (packed_size && compress_running)
+      sql_print_warning("Binlog compressor: gave up on '%s'", log_name);
+    unlink(tmp_name);
+  }
+  else
+  {
+    unlink(log_name);
+    sql_print_information("Binlog compressor: '%s' %llu -> %llu bytes",
+                          log_name, (ulonglong) in_stat.st_size,
+                          (ulonglong) packed_size);
+  }
+#ifdef POSIX_FADV_DONTNEED
+  /* The binlog was read once, do not let it push out the tail. */
+  posix_fadvise(in, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+  close(in);
+}
+
+
+/**
+  Compress the closed binlogs older than the ones kept plain. The binlog
+  being written is never one of them, wherever the index lists it.
+*/
+static void compress_closed_binlogs()
+{
+  vector<string> binlogs;
+
+  if (binlog_file_closed_binlogs(compress_index_file, &binlogs) ||
+      binlogs.size() <= (size_t) compress_keep_files)
+    return;
+
+  size_t last= binlogs.size() - compress_keep_files;
+  for (size_t i= 0; i < last && compress_running; i++)
+    compress_file(binlogs[i].c_str());
+}
+
+
+static void *compress_thread_func(void *)
+{
+  lower_priority();
+
+  pthread_mutex_lock(&compress_lock);
+  while (compress_running)
+  {
+    compress_pending= false;
+    pthread_mutex_unlock(&compress_lock);
+
+    compress_closed_binlogs();
+
+    pthread_mutex_lock(&compress_lock);
+    if (compress_running && !compress_pending)
+    {
+      struct timespec abstime;
+      clock_gettime(CLOCK_REALTIME, &abstime);
+      abstime.tv_sec+= COMPRESS_POLL_SECONDS;
+      pthread_cond_timedwait(&compress_cond, &compress_lock, &abstime);
+    }
+  }
+  pthread_mutex_unlock(&compress_lock);
+  return NULL;
+}
+
+
+bool binlog_compress_start(const char *index_file, uint keep_files,
+                           int level)
+{
+  strncpy(compress_index_file, index_file, FN_REFLEN);
+  compress_keep_files= keep_files;
+  compress_level= level;
+  compress_running= true;
+  if (pthread_create(&compress_thread, NULL, compress_thread_func, NULL))
+  {
+    compress_running= false;
+    sql_print_error("Binlog compressor: could not create the thread");
+    return true;
+  }
+  sql_print_information("Binlog compressor: started, keeping the last %u "
+                        "closed binlogs plain", keep_files);
+  return false;
+}
+
+
+void binlog_compress_notify()
+{
+  if (!compress_running)
+    return;
+  pthread_mutex_lock(&compress_lock);
+  compress_pending= true;
+  pthread_cond_signal(&compress_cond);
+  pthread_mutex_unlock(&compress_lock);
+}
+
+
+void binlog_compress_stop()
+{
+  if (!compress_running)
+    return;
+  pthread_mutex_lock(&compress_lock);
+  compress_running= false;
+  pthread_cond_signal(&compress_cond);
+  pthread_mutex_unlock(&compress_lock);
+  pthread_join(compress_thread, NULL);
+}
@@ -0,0 +1,39 @@
+/**
+  @file
+
+  @brief
+  Background compression of closed binlogs.
+
+  A thread running at idle CPU and IO priority rewrites the closed
+  binlogs of the index file into the seekable format described in
+  binlog_file.h, leaving the newest few alone because downstream readers
+  are most likely to want them. The index file is not changed, readers
+  open binlogs through binlog_file_open() and do not notice.
+*/
+
+#ifndef MYSQL_BINLOG_COMPRESS_H
+#define MYSQL_BINLOG_COMPRESS_H
+
+#include "my_global.h"
+
+/**
+  Start the compressor thread.
+
+  @param index_file  name of the binlog index file, relative to the
+                     current work dir (binlog_dir)
+  @param keep_files  how many of the newest closed binlogs stay plain
+  @param level       zlib compression level, 1 to 9
+
+  @retval false  ok
+  @retval true   the thread could not be created
+*/
+bool binlog_compress_start(const char *index_file, uint keep_files,
+                           int level);
+
+/** A binlog was closed, look for work now instead of at the next poll. */
+void binlog_compress_notify();
+
+/** Stop the thread, a file being compressed is abandoned. */
+void binlog_compress_stop();
+
+#endif //MYSQL_BINLOG_COMPRESS_H
@@ -0,0 +1,269 @@
+/**
+  @file
+
+  @brief
+  Plain and compressed binlog reader, see binlog_file.h.
+
+  A compressed binlog keeps the last inflated frame, readers go through a
+  binlog front to back so every frame is inflated once.
+*/
+
+#include "binlog_file.h"
+#include "log/vs_log.h"
+
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+
+using std::min;
+
+struct Binlog_file
+{
+  int fd;
+  bool compressed;
+  /* the rest is for compressed binlogs only */
+  my_off_t size;
+  uint32 frame_count;
+  /* frame_count + 1 entries, the last one is the offset of the index */
+  ulonglong *frame_offsets;
+  uchar *frame;
+  uchar *packed;
+  size_t packed_size;
+  /* frame held in frame, -1 for none */
+  long cached_frame;
+};
+
+
+/**
+  Read the footer and the frame index of a compressed binlog.
+*/
+static bool read_frame_index(Binlog_file *file, const char *name)
+{
+  uchar footer[BINLOG_COMPRESSED_FOOTER_LEN];
+  struct stat stat_buf;
+
+  if (fstat(file->fd, &stat_buf) ||
+      stat_buf.st_size < (off_t) sizeof(footer) ||
+      pread(file->fd, footer, sizeof(footer),
+            stat_buf.st_size - sizeof(footer)) != (ssize_t) sizeof(footer) ||
+      memcmp(footer + 24, BINLOG_COMPRESSED_MAGIC,
+             BINLOG_COMPRESSED_MAGIC_LEN) ||
+      uint4korr(footer + 20) != BINLOG_FRAME_SIZE)
+  {
+    sql_print_error("'%s' is not a compressed binlog", name);
+    return true;
+  }
+
+  ulonglong index_offset= uint8korr(footer);
+  file->size= (my_off_t) uint8korr(footer + 8);
+  file->frame_count= uint4korr(footer + 16);
+  size_t index_len= (size_t) file->frame_count * 8;
+  if (index_offset + index_len + sizeof(footer) != (ulonglong) stat_buf.st_size ||
+      !(file->frame_offsets= (ulonglong *)
+          malloc((file->frame_count + 1) * sizeof(ulonglong))) ||
+      !(file->frame= (uchar *) malloc(BINLOG_FRAME_SIZE)))
+  {
+    sql_print_error("Compressed binlog '%s' is damaged", name);
+    return true;
+  }
+
+  uchar *index= (uchar *) malloc(index_len + 1);
+  if (!index ||
+      pread(file->fd, index, index_len, (off_t) index_offset) !=
+      (ssize_t) index_len)
+  {
+    free(index);
+    sql_print_error("Could not read the frame index of '%s'", name);
+    return true;
+  }
+  for (uint32 i= 0; i < file->frame_count; i++)
+    file->frame_offsets[i]= uint8korr(index + i * 8);
+  file->frame_offsets[file->frame_count]= index_offset;
+  free(index);
+  return false;
+}
+
+
+Binlog_file *binlog_file_open(const char *log_name)
+{
+  Binlog_file *file= (Binlog_file *) calloc(1, sizeof(Binlog_file));
+  char name[FN_REFLEN + sizeof(BINLOG_COMPRESSED_EXT)];
+
+  if (!file)
+    return NULL;
+  file->cached_frame= -1;
+  if ((file->fd= open(log_name, O_RDONLY)) >= 0)
+    return file;
+
+  my_snprintf(name, sizeof(name), "%s%s", log_name, BINLOG_COMPRESSED_EXT);
+  if (errno == ENOENT && (file->fd= open(name, O_RDONLY)) >= 0)
+  {
+    file->compressed= true;
+    if (!read_frame_index(file, name))
+      return file;
+  }
+  binlog_file_close(file);
+  return NULL;
+}
+
+
+void binlog_file_close(Binlog_file *file)
+{
+  if (!file)
+    return;
+  if (file->fd >= 0)
+    close(file->fd);
+  free(file->frame_offsets);
+  free(file->frame);
+  free(file->packed);
+  free(file);
+}
+
+
+my_off_t binlog_file_size(Binlog_file *file)
+{
+  struct stat stat_buf;
+  if (file->compressed)
+    return file->size;
+  return fstat(file->fd, &stat_buf) ? 0 : (my_off_t) stat_buf.st_size;
+}
+
+
+int binlog_file_fd(Binlog_file *file)
+{
+  return file->compressed ? -1 : file->fd;
+}
+
+
+/**
+  Inflate frame no into file->frame.
+*/
+static bool load_frame(Binlog_file *file, uint32 no)
+{
+  size_t packed_len= (size_t) (file->frame_offsets[no + 1] -
+                               file->frame_offsets[no]);
+  uLongf frame_len= BINLOG_FRAME_SIZE;
+
+  if (file->cached_frame == (long) no)
+    return false;
+  if (file->packed_size < packed_len)
+  {
+    uchar *new_packed= (uchar *) realloc(file->packed, packed_len);
+    if (!new_packed)
+      return true;
+    file->packed= new_packed;
+    file->packed_size= packed_len;
+  }
+  file->cached_frame= -1;
+  if (pread(file->fd, file->packed, packed_len,
+            (off_t) file->frame_offsets[no]) != (ssize_t) packed_len ||
+      uncompress(file->frame, &frame_len, file->packed, packed_len) != Z_OK)
+    return true;
+  file->cached_frame= (long) no;
+  return false;
+}
+
+
+ssize_t binlog_file_pread(Binlog_file *file, uchar *buf, size_t len,
+                          my_off_t pos)
+{
+  if (!file->compressed)
+  {
+    size_t done= 0;
+    while (done < len)
+    {
+      ssize_t got= pread(file->fd, buf + done, len - done,
+                         (off_t) (pos + done));
+      if (got < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return -1;
+      }
+      if (got == 0)
+        break;
+      done+= got;
+    }
+    return (ssize_t) done;
+  }
+
+  size_t done= 0;
+  while (done < len && pos + done < file->size)
+  {
+    my_off_t at= pos + done;
+    uint32 no= (uint32) (at / BINLOG_FRAME_SIZE);
+    size_t in_frame= (size_t) (at % BINLOG_FRAME_SIZE);
+    if (no >= file->frame_count || load_frame(file, no))
+      return -1;
+    size_t avail= (size_t) min<my_off_t>(BINLOG_FRAME_SIZE - in_frame,
+                                         file->size - at);
+    size_t copy= min(avail, len - done);
+    memcpy(buf + done, file->frame + in_frame, copy);
+    done+= copy;
+  }
+  return (ssize_t) done;
+}
+
+
+bool binlog_file_remove(const char *log_name)
+{
+  char name[FN_REFLEN + sizeof(BINLOG_COMPRESSED_EXT)];
+  bool removed= !remove(log_name);
+
+  my_snprintf(name, sizeof(name), "%s%s", log_name, BINLOG_COMPRESSED_EXT);
+  if (!remove(name))
+    removed= true;
+  return !removed;
+}
+
+
+/* the binlog being written, set by the receive thread */
+static pthread_mutex_t active_lock= PTHREAD_MUTEX_INITIALIZER;
+static char active_binlog[FN_REFLEN + 1];
+
+
+void binlog_file_set_active(const char *log_name)
+{
+  pthread_mutex_lock(&active_lock);
+  strncpy(active_binlog, log_name, FN_REFLEN);
+  pthread_mutex_unlock(&active_lock);
+}
+
+
+bool binlog_file_closed_binlogs(const char *index_file,
+                                std::vector<std::string> *binlogs)
+{
+  std::ifstream index(index_file);
+  std::vector<std::string> lines;
+  std::set<std::string> seen;
+  std::string line;
+
+  pthread_mutex_lock(&active_lock);
+  std::string active(active_binlog);
+  pthread_mutex_unlock(&active_lock);
+  if (active.empty())
+    return true;
+
+  while (std::getline(index, line))
+  {
+    if (!line.empty())
+      lines.push_back(line);
+  }
+  /* from the end, so a name listed again counts at its last place */
+  binlogs->clear();
+  seen.insert(active);
+  for (size_t i= lines.size(); i > 0; i--)
+  {
+    if (seen.insert(lines[i - 1]).second)
+      binlogs->push_back(lines[i - 1]);
+  }
+  std::reverse(binlogs->begin(), binlogs->end());
+  return false;
+}
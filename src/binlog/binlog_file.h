@@ -0,0 +1,97 @@
+/**
+  @file
+
+  @brief
+  Read access to a binlog in binlog_dir, whether it is still a plain
+  file or has been rewritten by the compressor (binlog_compress.h).
+
+  A compressed binlog <name> is stored as <name>.vsz and keeps its name
+  in the index file. The .vsz file is a sequence of independently
+  deflated frames of BINLOG_FRAME_SIZE original bytes each, followed by
+  the frame index and a footer:
+
+    frame 0 .. frame n-1
+    index   n * 8 bytes, file offset of each frame
+    footer  index offset (8), original size (8), frame count (4),
+            frame size (4), BINLOG_COMPRESSED_MAGIC (8)
+
+  so any original offset is reached by inflating a single frame.
+*/
+
+#ifndef MYSQL_BINLOG_FILE_H
+#define MYSQL_BINLOG_FILE_H
+
+#include "my_global.h"
+
+#include <string>
+#include <vector>
+
+/** Suffix of a compressed binlog. */
+#define BINLOG_COMPRESSED_EXT ".vsz"
+#define BINLOG_COMPRESSED_MAGIC "VSBINLZ1"
+#define BINLOG_COMPRESSED_MAGIC_LEN 8
+#define BINLOG_COMPRESSED_FOOTER_LEN (8 + 8 + 4 + 4 + BINLOG_COMPRESSED_MAGIC_LEN)
+/** Original bytes per frame. */
+#define BINLOG_FRAME_SIZE (1024 * 1024)
+
+struct Binlog_file;
+
+/**
+  Open a binlog for reading, the plain file if it exists and the
+  compressed one otherwise.
+
+  @return the handle, NULL if neither can be opened
+*/
+Binlog_file *binlog_file_open(const char *log_name);
+
+void binlog_file_close(Binlog_file *file);
+
+/** Original size of the binlog, it grows while the binlog is written. */
+my_off_t binlog_file_size(Binlog_file *file);
+
+/**
+  The descriptor of a plain binlog, for sendfile(). -1 if the binlog is
+  compressed and has to be read with binlog_file_pread().
+*/
+int binlog_file_fd(Binlog_file *file);
+
+/**
+  Read len bytes at original offset pos.
+
+  @return bytes read, less than len only at the end of the binlog,
+          -1 on error
+*/
+ssize_t binlog_file_pread(Binlog_file *file, uchar *buf, size_t len,
+                          my_off_t pos);
+
+/**
+  Remove a binlog, plain or compressed.
+
+  @retval false  removed
+  @retval true   there was nothing to remove
+*/
+bool binlog_file_remove(const char *log_name);
+
+/**
+  Publish the binlog being written, called by the receive thread when it
+  opens one, so other threads tell it from the closed binlogs.
+*/
+void binlog_file_set_active(const char *log_name);
+
+/**
+  The closed binlogs of the index file, oldest first. A binlog written
+  again from its start is listed again in the index, it counts at its
+  last place only. The binlog being written is left out wherever the
+  index lists it.
+
+  @param index_file    name of the binlog index file
+  @param[out] binlogs  the closed binlogs
+
+  @retval false  ok
+  @retval true   no binlog was opened yet, which ones are closed is
+                 not known
+*/
+bool binlog_file_closed_binlogs(const char *index_file,
+                                std::vector<std::string> *binlogs);
+
+#endif //MYSQL_BINLOG_FILE_H
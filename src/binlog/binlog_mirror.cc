@@ -0,0 +1,730 @@
+/**
+  @file
+
+  @brief
+  Mirror of the binlogs, see binlog_mirror.h.
+
+  The queue is a ring of records, a header and its data, written by the
+  receive thread and replayed in order by the mirror thread. The
+  receive thread only takes the lock to reserve room and to publish a
+  record, the copy is done outside of it.
+*/
+
+#include "binlog_mirror.h"
+#include "server/metrics.h"
+#include "log/vs_log.h"
+#include "my_sys.h"
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::string;
+
+/* bytes of records queued at most */
+static const size_t MIRROR_QUEUE_SIZE= 64 * 1024 * 1024;
+/* longer writes are queued as several records */
+static const size_t MIRROR_RECORD_MAX= 1024 * 1024;
+/* chunk size when a mirror binlog is brought to the length of the binlog */
+static const size_t MIRROR_COPY_CHUNK= 1024 * 1024;
+
+enum Mirror_op
+{
+  MIRROR_OP_OPEN= 0,
+  MIRROR_OP_CLOSE,
+  MIRROR_OP_WRITE,
+  MIRROR_OP_TRUNCATE,
+  MIRROR_OP_SYNC,
+  MIRROR_OP_INDEX,
+  MIRROR_OP_RESET,
+  /* fills the end of the ring when the next record does not fit */
+  MIRROR_OP_PAD
+};
+
+/*
+  Followed by len bytes of data, the next record starts at the next
+  multiple of 8. Less than a header left before the end of the ring is
+  skipped.
+*/
+struct Mirror_record
+{
+  uint32 op;
+  uint32 len;
+  /* OPEN: size, TRUNCATE: length, SYNC: sequence number */
+  ulonglong arg;
+};
+
+static inline size_t record_size(size_t len)
+{
+  return sizeof(Mirror_record) + ((len + 7) & ~(size_t) 7);
+}
+
+static pthread_mutex_t mirror_lock= PTHREAD_MUTEX_INITIALIZER;
+/* the mirror thread waits for records */
+static pthread_cond_t queue_cond= PTHREAD_COND_INITIALIZER;
+/* the receive thread waits for room */
+static pthread_cond_t room_cond= PTHREAD_COND_INITIALIZER;
+/* the receive thread waits for syncs */
+static pthread_cond_t synced_cond= PTHREAD_COND_INITIALIZER;
+/* the binlog sync thread waits for requests */
+static pthread_cond_t primary_cond= PTHREAD_COND_INITIALIZER;
+
+static uchar *queue= NULL;
+/* bytes ever queued and replayed, under mirror_lock */
+static ulonglong queue_head= 0;
+static ulonglong queue_tail= 0;
+static bool reader_waiting= false;
+static bool writer_waiting= false;
+
+static volatile bool mirror_running= false;
+static bool mirror_stopping= false;
+static Mirror_ack mirror_ack= MIRROR_ACK_ALL;
+/* under mirror_lock: the mirror is given up, nothing is written to it */
+static bool mirror_failed= false;
+/* under mirror_lock: last sync asked for and last one the mirror did */
+static ulonglong sync_requested= 0;
+static ulonglong mirror_synced= 0;
+
+/* MIRROR_ACK_FIRST: the binlog sync thread, all under mirror_lock */
+static int primary_fd= -1;
+static bool primary_measure= false;
+static ulonglong primary_requested= 0;
+static ulonglong primary_synced= 0;
+static bool primary_failed= false;
+
+static pthread_t mirror_thread;
+static pthread_t primary_thread;
+
+/* only used by the mirror thread */
+static int dir_fd= -1;
+static int file_fd= -1;
+static int index_fd= -1;
+static char file_name[FN_REFLEN + 1];
+static char mirror_dir[FN_REFLEN + 1];
+static char index_name[FN_REFLEN + 1];
+
+
+/**
+  Give the mirror up, waking whoever waits for it.
+*/
+static void mirror_fail()
+{
+  pthread_mutex_lock(&mirror_lock);
+  mirror_failed= true;
+  pthread_cond_broadcast(&synced_cond);
+  pthread_cond_broadcast(&room_cond);
+  pthread_mutex_unlock(&mirror_lock);
+}
+
+
+////////////////////////////////////////////////////////////
+//
+// Mirror thread
+//
+////////////////////////////////////////////////////////////
+
+static bool write_all(int fd, const uchar *buf, size_t len)
+{
+  while (len)
+  {
+    ssize_t written= write(fd, buf, len);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return true;
+    buf+= written;
+    len-= written;
+  }
+  return false;
+}
+
+
+/**
+  Copy [from, to) of the binlog log_name to the mirror binlog.
+*/
+static bool copy_from_binlog(const char *log_name, my_off_t from, my_off_t to)
+{
+  int fd= open(log_name, O_RDONLY);
+  uchar *buf= (uchar *) malloc(MIRROR_COPY_CHUNK);
+  bool failed= fd < 0 || !buf;
+
+  while (!failed && from < to)
+  {
+    size_t want= (size_t) min<my_off_t>(to - from, MIRROR_COPY_CHUNK);
+    ssize_t got= pread(fd, buf, want, from);
+    failed= got <= 0 ||
+            pwrite(file_fd, buf, got, from) != got;
+    from+= got;
+  }
+  free(buf);
+  if (fd >= 0)
+    close(fd);
+  return failed;
+}
+
+
+/** Make the mirror binlog durable and report sync seq as done. */
+static bool sync_mirror(ulonglong seq)
+{
+  if (file_fd >= 0)
+  {
+    ulonglong start= metrics_enabled() ? my_micro_time() : 0;
+    if (fdatasync(file_fd))
+    {
+      sql_print_error("Mirror: could not sync '%s/%s', errno %d", mirror_dir,
+                      file_name, errno);
+      return true;
+    }
+    if (start)
+      metrics_mirror_fsync(my_micro_time() - start);
+  }
+  pthread_mutex_lock(&mirror_lock);
+  if (seq > mirror_synced)
+    mirror_synced= seq;
+  pthread_cond_broadcast(&synced_cond);
+  pthread_mutex_unlock(&mirror_lock);
+  return false;
+}
+
+
+static void close_file()
+{
+  if (file_fd >= 0)
+    close(file_fd);
+  file_fd= -1;
+}
+
+
+/**
+  Open the mirror copy of log_name and bring it to size bytes.
+*/
+static bool open_file(const char *log_name, my_off_t size)
+{
+  struct stat st;
+
+  close_file();
+  strncpy(file_name, log_name, FN_REFLEN);
+  file_name[FN_REFLEN]= 0;
+  if ((file_fd= openat(dir_fd, log_name, O_WRONLY | O_CREAT, 0666)) < 0 ||
+      fstat(file_fd, &st))
+  {
+    sql_print_error("Mirror: could not open '%s/%s', errno %d", mirror_dir,
+                    log_name, errno);
+    return true;
+  }
+  if ((my_off_t) st.st_size > size && ftruncate(file_fd, size))
+  {
+    sql_print_error("Mirror: could not truncate '%s/%s', errno %d",
+                    mirror_dir, log_name, errno);
+    return true;
+  }
+  if ((my_off_t) st.st_size < size)
+  {
+    if (copy_from_binlog(log_name, st.st_size, size))
+    {
+      sql_print_error("Mirror: could not copy '%s' to the mirror, errno %d",
+                      log_name, errno);
+      return true;
+    }
+    sql_print_information("Mirror: copied %llu bytes of '%s' it lacked",
+                          (ulonglong) (size - st.st_size), log_name);
+  }
+  if (lseek(file_fd, size, SEEK_SET) < 0)
+    return true;
+  return false;
+}
+
+
+/** Remove the mirror binlogs listed in the mirror index file. */
+static bool reset_files()
+{
+  string names;
+  char buf[4096];
+  ssize_t got;
+  int fd= openat(dir_fd, index_name, O_RDONLY);
+
+  close_file();
+  while (fd >= 0 && (got= read(fd, buf, sizeof(buf))) > 0)
+    names.append(buf, got);
+  if (fd >= 0)
+    close(fd);
+
+  size_t pos= 0;
+  while (pos < names.size())
+  {
+    size_t newline= names.find('\n', pos);
+    if (newline == string::npos)
+      newline= names.size();
+    string name= names.substr(pos, newline - pos);
+    if (!name.empty() && unlinkat(dir_fd, name.c_str(), 0) && errno != ENOENT)
+      sql_print_warning("Mirror: could not remove '%s/%s', errno %d",
+                        mirror_dir, name.c_str(), errno);
+    pos= newline + 1;
+  }
+  if (ftruncate(index_fd, 0))
+  {
+    sql_print_error("Mirror: could not truncate '%s/%s', errno %d",
+                    mirror_dir, index_name, errno);
+    return true;
+  }
+  return false;
+}
+
+
+/**
+  Replay a record.
+
+  @param[in,out] pending_sync  sequence number of the sync to do before
+                               the binlog changes or the batch ends
+
+  @retval false  ok
+  @retval true   failure, logged, the mirror is given up
+*/
+static bool replay(const Mirror_record *record, const uchar *data,
+                   ulonglong *pending_sync)
+{
+  string name;
+
+  switch (record->op)
+  {
+  case MIRROR_OP_OPEN:
+  case MIRROR_OP_CLOSE:
+  case MIRROR_OP_RESET:
+    /* the sync is for the binlog being left */
+    if (*pending_sync && sync_mirror(*pending_sync))
+      return true;
+    *pending_sync= 0;
+    if (record->op == MIRROR_OP_CLOSE)
+      close_file();
+    else if (record->op == MIRROR_OP_RESET)
+      return reset_files();
+    else
+    {
+      name.assign((const char *) data, record->len);
+      return open_file(name.c_str(), record->arg);
+    }
+    return false;
+  case MIRROR_OP_WRITE:
+    if (file_fd >= 0 && write_all(file_fd, data, record->len))
+    {
+      sql_print_error("Mirror: could not write '%s/%s', errno %d",
+                      mirror_dir, file_name, errno);
+      return true;
+    }
+    return false;
+  case MIRROR_OP_TRUNCATE:
+    if (file_fd >= 0 &&
+        (ftruncate(file_fd, record->arg) ||
+         lseek(file_fd, record->arg, SEEK_SET) < 0))
+    {
+      sql_print_error("Mirror: could not truncate '%s/%s', errno %d",
+                      mirror_dir, file_name, errno);
+      return true;
+    }
+    return false;
+  case MIRROR_OP_SYNC:
+    /* syncs queued back to back are done once */
+    *pending_sync= record->arg;
+    return false;
+  case MIRROR_OP_INDEX:
+    name.assign((const char *) data, record->len);
+    name+= '\n';
+    if (write_all(index_fd, (const uchar *) name.data(), name.size()))
+    {
+      sql_print_error("Mirror: could not write '%s/%s', errno %d",
+                      mirror_dir, index_name, errno);
+      return true;
+    }
+    return false;
+  default:
+    return false;
+  }
+}
+
+
+static void *mirror_thread_func(void *)
+{
+  ulonglong pending_sync= 0;
+  bool failed= false;
+
+  pthread_mutex_lock(&mirror_lock);
+  for (;;)
+  {
+    while (queue_tail == queue_head && !mirror_stopping)
+    {
+      reader_waiting= true;
+      pthread_cond_wait(&queue_cond, &mirror_lock);
+      reader_waiting= false;
+    }
+    if (queue_tail == queue_head)
+      break;
+    ulonglong head= queue_head;
+    ulonglong tail= queue_tail;
+    failed= mirror_failed;
+    pthread_mutex_unlock(&mirror_lock);
+
+    while (tail < head)
+    {
+      size_t pos= (size_t) (tail % MIRROR_QUEUE_SIZE);
+      if (MIRROR_QUEUE_SIZE - pos < sizeof(Mirror_record))
+      {
+        tail+= MIRROR_QUEUE_SIZE - pos;
+        continue;
+      }
+      const Mirror_record *record= (const Mirror_record *) (queue + pos);
+      if (!failed && record->op != MIRROR_OP_PAD &&
+          replay(record, queue + pos + sizeof(Mirror_record), &pending_sync))
+      {
+        failed= true;
+        mirror_fail();
+      }
+      tail+= record_size(record->len);
+      if (tail - queue_tail >= MIRROR_QUEUE_SIZE / 8)
+      {
+        /* let a waiting receive thread go on before the batch ends */
+        pthread_mutex_lock(&mirror_lock);
+        queue_tail= tail;
+        if (writer_waiting)
+          pthread_cond_signal(&room_cond);
+        pthread_mutex_unlock(&mirror_lock);
+      }
+    }
+    if (!failed && pending_sync && sync_mirror(pending_sync))
+    {
+      failed= true;
+      mirror_fail();
+    }
+    pending_sync= 0;
+
+    pthread_mutex_lock(&mirror_lock);
+    queue_tail= tail;
+    if (writer_waiting)
+      pthread_cond_signal(&room_cond);
+  }
+  pthread_mutex_unlock(&mirror_lock);
+
+  /* a clean stop leaves the mirror durable */
+  if (!failed && file_fd >= 0 && fdatasync(file_fd))
+    sql_print_error("Mirror: could not sync '%s/%s', errno %d", mirror_dir,
+                    file_name, errno);
+  close_file();
+  return NULL;
+}
+
+
+/**
+  MIRROR_ACK_FIRST: sync the binlog on request, so the receive thread
+  can go on as soon as the mirror is durable.
+*/
+static void *primary_thread_func(void *)
+{
+  pthread_mutex_lock(&mirror_lock);
+  for (;;)
+  {
+    while ((primary_failed || primary_synced >= primary_requested) &&
+           !mirror_stopping)
+      pthread_cond_wait(&primary_cond, &mirror_lock);
+    if (primary_failed || primary_synced >= primary_requested)
+      break;
+    ulonglong seq= primary_requested;
+    int fd= primary_fd;
+    ulonglong start= primary_measure ? my_micro_time() : 0;
+    pthread_mutex_unlock(&mirror_lock);
+
+    int err= fdatasync(fd) ? errno : 0;
+    if (err)
+      sql_print_error("Sync of the binlog failed, errno %d", err);
+    else if (start)
+      metrics_fsync(my_micro_time() - start);
+
+    pthread_mutex_lock(&mirror_lock);
+    if (err)
+      primary_failed= true;
+    else
+      primary_synced= seq;
+    pthread_cond_broadcast(&synced_cond);
+  }
+  pthread_mutex_unlock(&mirror_lock);
+  return NULL;
+}
+
+
+////////////////////////////////////////////////////////////
+//
+// Receive thread
+//
+////////////////////////////////////////////////////////////
+
+/**
+  Queue a record, waiting for room with MIRROR_ACK_ALL and giving the
+  mirror up with MIRROR_ACK_FIRST.
+*/
+static void enqueue(uint op, ulonglong arg, const uchar *data, size_t len)
+{
+  size_t need= record_size(len);
+  /* only this thread moves the head */
+  ulonglong head= queue_head;
+  size_t pos= (size_t) (head % MIRROR_QUEUE_SIZE);
+  size_t pad= MIRROR_QUEUE_SIZE - pos < need ? MIRROR_QUEUE_SIZE - pos : 0;
+
+  pthread_mutex_lock(&mirror_lock);
+  while (!mirror_failed &&
+         MIRROR_QUEUE_SIZE - (head - queue_tail) < pad + need)
+  {
+    if (mirror_ack == MIRROR_ACK_FIRST)
+    {
+      mirror_failed= true;
+      pthread_cond_broadcast(&synced_cond);
+      pthread_mutex_unlock(&mirror_lock);
+      sql_print_error("Mirror: %lu MB behind the binlog, given up until the "
+                      "next start", (ulong) (MIRROR_QUEUE_SIZE >> 20));
+      return;
+    }
+    writer_waiting= true;
+    pthread_cond_wait(&room_cond, &mirror_lock);
+    writer_waiting= false;
+  }
+  bool failed= mirror_failed;
+  pthread_mutex_unlock(&mirror_lock);
+  if (failed)
+    return;
+
+  if (pad)
+  {
+    if (pad >= sizeof(Mirror_record))
+    {
+      Mirror_record *filler= (Mirror_record *) (queue + pos);
+      filler->op= MIRROR_OP_PAD;
+      filler->len= (uint32) (pad - sizeof(Mirror_record));
+      filler->arg= 0;
+    }
+    head+= pad;
+    pos= 0;
+  }
+  Mirror_record *record= (Mirror_record *) (queue + pos);
+  record->op= op;
+  record->len= (uint32) len;
+  record->arg= arg;
+  if (len)
+    memcpy(queue + pos + sizeof(Mirror_record), data, len);
+
+  pthread_mutex_lock(&mirror_lock);
+  queue_head= head + need;
+  if (reader_waiting)
+    pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&mirror_lock);
+}
+
+
+/** Wait until the binlog sync thread no longer uses the binlog. */
+static void wait_primary_idle()
+{
+  if (mirror_ack != MIRROR_ACK_FIRST)
+    return;
+  pthread_mutex_lock(&mirror_lock);
+  while (!primary_failed && primary_synced < primary_requested)
+    pthread_cond_wait(&synced_cond, &mirror_lock);
+  pthread_mutex_unlock(&mirror_lock);
+}
+
+
+bool binlog_mirror_start(const char *dir, const char *index_file,
+                         Mirror_ack ack)
+{
+  struct stat dir_st, binlog_st;
+
+  strncpy(mirror_dir, dir, FN_REFLEN);
+  strncpy(index_name, index_file, FN_REFLEN);
+  if ((dir_fd= open(dir, O_RDONLY | O_DIRECTORY)) < 0)
+  {
+    sql_print_error("Mirror: could not open directory '%s', errno %d", dir,
+                    errno);
+    return true;
+  }
+  if (!fstat(dir_fd, &dir_st) && !stat(".", &binlog_st))
+  {
+    if (dir_st.st_dev == binlog_st.st_dev && dir_st.st_ino == binlog_st.st_ino)
+    {
+      sql_print_error("Mirror: '%s' is binlog_dir itself", dir);
+      close(dir_fd);
+      dir_fd= -1;
+      return true;
+    }
+    if (dir_st.st_dev == binlog_st.st_dev)
+      sql_print_warning("Mirror: '%s' is on the same device as binlog_dir",
+                        dir);
+  }
+  if ((index_fd= openat(dir_fd, index_file, O_WRONLY | O_CREAT | O_APPEND,
+                        0666)) < 0 ||
+      !(queue= (uchar *) malloc(MIRROR_QUEUE_SIZE)))
+  {
+    sql_print_error("Mirror: could not set up '%s', errno %d", dir, errno);
+    goto err;
+  }
+
+  mirror_ack= ack;
+  mirror_stopping= false;
+  if (pthread_create(&mirror_thread, NULL, mirror_thread_func, NULL))
+  {
+    sql_print_error("Mirror: could not create the mirror thread");
+    goto err;
+  }
+  if (ack == MIRROR_ACK_FIRST &&
+      pthread_create(&primary_thread, NULL, primary_thread_func, NULL))
+  {
+    sql_print_error("Mirror: could not create the binlog sync thread");
+    pthread_mutex_lock(&mirror_lock);
+    mirror_stopping= true;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&mirror_lock);
+    pthread_join(mirror_thread, NULL);
+    goto err;
+  }
+  mirror_running= true;
+  sql_print_information("Mirror: writing a copy of the binlogs to '%s', "
+                        "ACK once %s durable", dir,
+                        ack == MIRROR_ACK_ALL ? "both are" : "one is");
+  return false;
+
+err:
+  free(queue);
+  queue= NULL;
+  if (index_fd >= 0)
+    close(index_fd);
+  index_fd= -1;
+  close(dir_fd);
+  dir_fd= -1;
+  return true;
+}
+
+
+void binlog_mirror_stop()
+{
+  if (!mirror_running)
+    return;
+  wait_primary_idle();
+  pthread_mutex_lock(&mirror_lock);
+  mirror_stopping= true;
+  pthread_cond_signal(&queue_cond);
+  pthread_cond_signal(&primary_cond);
+  pthread_mutex_unlock(&mirror_lock);
+  pthread_join(mirror_thread, NULL);
+  if (mirror_ack == MIRROR_ACK_FIRST)
+    pthread_join(primary_thread, NULL);
+  mirror_running= false;
+
+  free(queue);
+  queue= NULL;
+  close(index_fd);
+  index_fd= -1;
+  close(dir_fd);
+  dir_fd= -1;
+}
+
+
+bool binlog_mirror_enabled()
+{
+  return mirror_running;
+}
+
+
+void binlog_mirror_open(const char *log_name, my_off_t size)
+{
+  if (!mirror_running)
+    return;
+  wait_primary_idle();
+  enqueue(MIRROR_OP_OPEN, size, (const uchar *) log_name, strlen(log_name));
+}
+
+
+void binlog_mirror_close()
+{
+  if (!mirror_running)
+    return;
+  wait_primary_idle();
+  enqueue(MIRROR_OP_CLOSE, 0, NULL, 0);
+}
+
+
+void binlog_mirror_write(const uchar *buf, size_t len)
+{
+  if (!mirror_running)
+    return;
+  while (len)
+  {
+    size_t chunk= min(len, MIRROR_RECORD_MAX);
+    enqueue(MIRROR_OP_WRITE, 0, buf, chunk);
+    buf+= chunk;
+    len-= chunk;
+  }
+}
+
+
+void binlog_mirror_truncate(my_off_t len)
+{
+  if (mirror_running)
+    enqueue(MIRROR_OP_TRUNCATE, len, NULL, 0);
+}
+
+
+void binlog_mirror_index(const char *log_name)
+{
+  if (mirror_running)
+    enqueue(MIRROR_OP_INDEX, 0, (const uchar *) log_name, strlen(log_name));
+}
+
+
+void binlog_mirror_reset()
+{
+  if (mirror_running)
+    enqueue(MIRROR_OP_RESET, 0, NULL, 0);
+}
+
+
+bool binlog_mirror_sync(int fd, bool measure)
+{
+  pthread_mutex_lock(&mirror_lock);
+  ulonglong seq= ++sync_requested;
+  pthread_mutex_unlock(&mirror_lock);
+  enqueue(MIRROR_OP_SYNC, seq, NULL, 0);
+
+  if (mirror_ack == MIRROR_ACK_FIRST)
+  {
+    pthread_mutex_lock(&mirror_lock);
+    primary_fd= fd;
+    primary_measure= measure;
+    primary_requested= seq;
+    pthread_cond_signal(&primary_cond);
+    while (!primary_failed && primary_synced < seq &&
+           (mirror_failed || mirror_synced < seq))
+      pthread_cond_wait(&synced_cond, &mirror_lock);
+    bool failed= primary_failed;
+    pthread_mutex_unlock(&mirror_lock);
+    return failed;
+  }
+
+  /* the mirror thread syncs its copy meanwhile */
+  ulonglong start= measure ? my_micro_time() : 0;
+  if (fdatasync(fd))
+  {
+    sql_print_error("Sync of the binlog failed, errno %d", errno);
+    return true;
+  }
+  if (start)
+    metrics_fsync(my_micro_time() - start);
+
+  pthread_mutex_lock(&mirror_lock);
+  while (!mirror_failed && mirror_synced < seq)
+    pthread_cond_wait(&synced_cond, &mirror_lock);
+  bool failed= mirror_failed;
+  pthread_mutex_unlock(&mirror_lock);
+  if (failed)
+    sql_print_error("Mirror: the mirror is not durable, no ACK is sent "
+                    "with mirror_ack all");
+  return failed;
+}
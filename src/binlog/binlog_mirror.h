@@ -0,0 +1,99 @@
+/**
+  @file
+
+  @brief
+  A second copy of the binlogs in another directory, meant to be on
+  another disk.
+
+  The receive thread does not write the mirror itself: what it does to
+  the binlog (open, write, cut a partial event, sync) and to the index
+  file is queued and replayed by a mirror thread, so the second copy
+  costs it a memcpy. The queue holds MIRROR_QUEUE_SIZE bytes.
+
+  When ack_policy syncs before an ACK, both copies are synced at once,
+  the mirror thread syncs its copy while the binlog is synced, and the
+  ACK waits for
+
+    all    both copies to be durable; a failing mirror stops the
+           receive thread like a failing binlog, and a full queue makes
+           it wait for the mirror
+    first  the first copy to be durable, the binlog is then synced by
+           a thread of its own so a slow disk on either side is not
+           waited for; a mirror that fails or falls a whole queue
+           behind is dropped until the next start
+
+  A mirror binlog opened in append mode is first brought to the length
+  of the binlog, copying what it lacks from it. Binlogs written before
+  the mirror was configured are not copied.
+*/
+
+#ifndef MYSQL_BINLOG_MIRROR_H
+#define MYSQL_BINLOG_MIRROR_H
+
+#include "my_global.h"
+
+enum Mirror_ack
+{
+  /* ACK once the binlog and the mirror are durable */
+  MIRROR_ACK_ALL= 0,
+  /* ACK once either of them is durable */
+  MIRROR_ACK_FIRST
+};
+
+/**
+  Start the mirror thread.
+
+  @param dir         the mirror directory, absolute
+  @param index_file  name of the binlog index file, the mirror keeps
+                     its own under the same name
+  @param ack         when a sync is done, see Mirror_ack
+
+  @retval false  ok
+  @retval true   failure, the reason has been logged
+*/
+bool binlog_mirror_start(const char *dir, const char *index_file,
+                         Mirror_ack ack);
+
+/** Replay what is queued, sync the mirror and stop the threads. */
+void binlog_mirror_stop();
+
+/** true if binlog_mirror_start() succeeded. */
+bool binlog_mirror_enabled();
+
+/**
+  The binlog log_name was opened, size bytes long, by the receive thread.
+  The binlog opened before is closed and must not be synced any more.
+*/
+void binlog_mirror_open(const char *log_name, my_off_t size);
+
+/**
+  The receive thread is about to close the binlog, a sync of it still
+  running is waited for.
+*/
+void binlog_mirror_close();
+
+/** Bytes were appended to the binlog. */
+void binlog_mirror_write(const uchar *buf, size_t len);
+
+/** The binlog was cut to len bytes. */
+void binlog_mirror_truncate(my_off_t len);
+
+/** log_name was appended to the index file. */
+void binlog_mirror_index(const char *log_name);
+
+/** The binlogs and the index file were removed. */
+void binlog_mirror_reset();
+
+/**
+  Make what was written durable, on both copies or the first one as
+  configured. The binlog is flushed to the kernel already.
+
+  @param fd       descriptor of the binlog
+  @param measure  true to time the syncs for the metrics
+
+  @retval false  durable
+  @retval true   failure, logged
+*/
+bool binlog_mirror_sync(int fd, bool measure);
+
+#endif //MYSQL_BINLOG_MIRROR_H
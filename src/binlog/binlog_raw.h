@@ -0,0 +1,234 @@
+/**
+  @file
+
+  @brief
+  Accessors for the common header and a few well known bodies of a raw
+  binlog event, for code paths that only need to look at an event and
+  not construct a Log_event object for it.
+
+  All functions expect a complete event starting at the common header.
+*/
+
+#ifndef MYSQL_BINLOG_RAW_H
+#define MYSQL_BINLOG_RAW_H
+
+#include "my_global.h"
+#include "binlog_event.h"
+
+/** Flag set in the common header of events made up by the sender. */
+#define RAW_LOG_EVENT_ARTIFICIAL_F 0x20
+/**
+  Flag of an FDE whose binlog was not closed properly, it is cleared
+  before the checksum of the FDE is computed.
+*/
+#define RAW_LOG_EVENT_BINLOG_IN_USE_F 0x1
+
+/** Size of the post header of a ROTATE_EVENT (the 8 byte position). */
+#define RAW_ROTATE_HEADER_LEN 8
+
+/** Offset of the checksum algorithm descriptor from the end of an FDE. */
+#define RAW_FDE_CHECKSUM_ALG_TAIL \
+  (BINLOG_CHECKSUM_LEN + BINLOG_CHECKSUM_ALG_DESC_LEN)
+
+/** Offset of the server version string in the body of an FDE. */
+#define RAW_FDE_SERVER_VERSION_OFFSET (LOG_EVENT_HEADER_LEN + 2)
+
+/** Offset of the 4 byte create time of an FDE, after the server version. */
+#define RAW_FDE_CREATE_TIME_OFFSET \
+  (RAW_FDE_SERVER_VERSION_OFFSET + ST_SERVER_VER_LEN)
+
+/** Offset of the SID in a GTID_LOG_EVENT, it follows the commit flag. */
+#define RAW_GTID_SID_OFFSET (LOG_EVENT_HEADER_LEN + 1)
+/** Offset of the GNO in a GTID_LOG_EVENT. */
+#define RAW_GTID_GNO_OFFSET (RAW_GTID_SID_OFFSET + 16)
+/** Shortest valid GTID_LOG_EVENT, without the checksum. */
+#define RAW_GTID_MIN_LEN (RAW_GTID_GNO_OFFSET + 8)
+
+/** Size of the post header of a QUERY_EVENT. */
+#define RAW_QUERY_HEADER_LEN 13
+/** Offsets in the post header of a QUERY_EVENT. */
+#define RAW_QUERY_DB_LEN_OFFSET 8
+#define RAW_QUERY_STATUS_VARS_LEN_OFFSET 11
+
+static inline uint32 raw_event_when(const uchar *buf)
+{
+  return uint4korr(buf);
+}
+
+static inline binary_log::Log_event_type raw_event_type(const uchar *buf)
+{
+  return (binary_log::Log_event_type) buf[EVENT_TYPE_OFFSET];
+}
+
+static inline uint32 raw_event_server_id(const uchar *buf)
+{
+  return uint4korr(buf + SERVER_ID_OFFSET);
+}
+
+static inline uint32 raw_event_len(const uchar *buf)
+{
+  return uint4korr(buf + EVENT_LEN_OFFSET);
+}
+
+static inline uint32 raw_event_log_pos(const uchar *buf)
+{
+  return uint4korr(buf + LOG_POS_OFFSET);
+}
+
+static inline uint16 raw_event_flags(const uchar *buf)
+{
+  return uint2korr(buf + FLAGS_OFFSET);
+}
+
+/**
+  Return the checksum algorithm a FORMAT_DESCRIPTION_EVENT announces for
+  the events following it.
+
+  Servers older than 5.6.1 do not write the descriptor, for them the
+  answer is BINLOG_CHECKSUM_ALG_OFF.
+
+  @param buf  the FORMAT_DESCRIPTION_EVENT
+  @param len  length of the event
+*/
+static inline binary_log::enum_binlog_checksum_alg
+raw_fde_checksum_alg(const uchar *buf, size_t len)
+{
+  if (len < RAW_FDE_SERVER_VERSION_OFFSET + ST_SERVER_VER_LEN +
+            RAW_FDE_CHECKSUM_ALG_TAIL)
+    return binary_log::BINLOG_CHECKSUM_ALG_OFF;
+
+  const char *version= (const char *) buf + RAW_FDE_SERVER_VERSION_OFFSET;
+  char *end;
+  ulong major= strtoul(version, &end, 10);
+  ulong minor= (*end == '.') ? strtoul(end + 1, &end, 10) : 0;
+  ulong patch= (*end == '.') ? strtoul(end + 1, &end, 10) : 0;
+  if (major * 10000 + minor * 100 + patch < 50601)
+    return binary_log::BINLOG_CHECKSUM_ALG_OFF;
+
+  return (binary_log::enum_binlog_checksum_alg)
+    buf[len - RAW_FDE_CHECKSUM_ALG_TAIL];
+}
+
+/**
+  Length of the event without its checksum trailer.
+*/
+static inline size_t
+raw_event_data_len(size_t len, binary_log::enum_binlog_checksum_alg alg)
+{
+  return alg == binary_log::BINLOG_CHECKSUM_ALG_CRC32 ?
+    len - BINLOG_CHECKSUM_LEN : len;
+}
+
+/**
+  Extract the name of the next binlog from a ROTATE_EVENT.
+
+  @param buf        the ROTATE_EVENT
+  @param len        length of the event
+  @param alg        checksum algorithm in effect for the event
+  @param[out] ident_len length of the returned name, it is not
+                    null terminated
+
+  @return pointer to the name inside buf, NULL if the event is malformed
+*/
+static inline const char *
+raw_rotate_ident(const uchar *buf, size_t len,
+                 binary_log::enum_binlog_checksum_alg alg, size_t *ident_len)
+{
+  size_t data_len= raw_event_data_len(len, alg);
+  if (data_len < LOG_EVENT_HEADER_LEN + RAW_ROTATE_HEADER_LEN)
+    return NULL;
+  *ident_len= data_len - LOG_EVENT_HEADER_LEN - RAW_ROTATE_HEADER_LEN;
+  return (const char *) buf + LOG_EVENT_HEADER_LEN + RAW_ROTATE_HEADER_LEN;
+}
+
+/**
+  Extract the binlog name of a HEARTBEAT_LOG_EVENT, the master position
+  in it is the log_pos of the header.
+
+  @param buf        the HEARTBEAT_LOG_EVENT
+  @param len        length of the event
+  @param alg        checksum algorithm in effect for the event
+  @param[out] name_len length of the returned name, it is not null
+                    terminated
+
+  @return pointer to the name inside buf, NULL if the event is malformed
+*/
+static inline const char *
+raw_heartbeat_log_name(const uchar *buf, size_t len,
+                       binary_log::enum_binlog_checksum_alg alg,
+                       size_t *name_len)
+{
+  size_t data_len= raw_event_data_len(len, alg);
+  if (len < LOG_EVENT_HEADER_LEN || data_len <= LOG_EVENT_HEADER_LEN)
+    return NULL;
+  *name_len= data_len - LOG_EVENT_HEADER_LEN;
+  return (const char *) buf + LOG_EVENT_HEADER_LEN;
+}
+
+/**
+  The 16 byte SID of a GTID_LOG_EVENT, the caller checks the event is at
+  least RAW_GTID_MIN_LEN long.
+*/
+static inline const uchar *raw_gtid_sid(const uchar *buf)
+{
+  return buf + RAW_GTID_SID_OFFSET;
+}
+
+static inline longlong raw_gtid_gno(const uchar *buf)
+{
+  return (longlong) uint8korr(buf + RAW_GTID_GNO_OFFSET);
+}
+
+/**
+  Extract the statement of a QUERY_EVENT.
+
+  @param buf        the QUERY_EVENT
+  @param len        length of the event
+  @param alg        checksum algorithm in effect for the event
+  @param[out] query_len length of the statement, it is not null terminated
+
+  @return pointer to the statement inside buf, NULL if the event is
+          malformed
+*/
+static inline const char *
+raw_query_text(const uchar *buf, size_t len,
+               binary_log::enum_binlog_checksum_alg alg, size_t *query_len)
+{
+  size_t data_len= raw_event_data_len(len, alg);
+  const uchar *post_header= buf + LOG_EVENT_HEADER_LEN;
+  if (data_len < LOG_EVENT_HEADER_LEN + RAW_QUERY_HEADER_LEN)
+    return NULL;
+  size_t offset= LOG_EVENT_HEADER_LEN + RAW_QUERY_HEADER_LEN +
+    uint2korr(post_header + RAW_QUERY_STATUS_VARS_LEN_OFFSET) +
+    post_header[RAW_QUERY_DB_LEN_OFFSET] + 1;
+  if (offset > data_len)
+    return NULL;
+  *query_len= data_len - offset;
+  return (const char *) buf + offset;
+}
+
+/**
+  true if the event is the last one of a transaction: an XID_EVENT, an
+  XA_PREPARE_LOG_EVENT or any QUERY_EVENT but BEGIN (COMMIT, DDL).
+*/
+static inline bool
+raw_event_ends_transaction(const uchar *buf, size_t len,
+                           binary_log::enum_binlog_checksum_alg alg)
+{
+  switch (raw_event_type(buf))
+  {
+  case binary_log::XID_EVENT:
+  case binary_log::XA_PREPARE_LOG_EVENT:
+    return true;
+  case binary_log::QUERY_EVENT:
+  {
+    size_t query_len= 0;
+    const char *query= raw_query_text(buf, len, alg, &query_len);
+    return !query || query_len != 5 || strncmp(query, "BEGIN", 5);
+  }
+  default:
+    return false;
+  }
+}
+
+#endif //MYSQL_BINLOG_RAW_H
@@ -0,0 +1,148 @@
+/**
+  @file
+
+  @brief
+  Catch-up and tail mode of the write path, see catchup_mode.h.
+*/
+
+#include "catchup_mode.h"
+#include "server/metrics.h"
+#include "log/vs_log.h"
+
+/* how long transactions stay over the lag before catch-up mode starts */
+static const ulonglong CATCHUP_ENTER_USEC= 1000000;
+/* longest time between two syncs in catch-up mode */
+static const ulonglong CATCHUP_SYNC_MAX_USEC= 1000000;
+
+static uint lag_threshold= 0;
+static ulonglong sync_bytes= 0;
+static bool active= false;
+/*
+  Arrival of the first transaction of the current run over the lag
+  threshold, 0 when the last one was under it.
+*/
+static ulonglong behind_since= 0;
+/* when the current catch-up started and the bytes received since */
+static ulonglong started= 0;
+static ulonglong received= 0;
+/* the last sync and the bytes received since, not in the metrics yet */
+static ulonglong last_sync= 0;
+static ulonglong unsynced= 0;
+
+
+void catchup_mode_init(uint lag_seconds, uint sync_mb)
+{
+  lag_threshold= lag_seconds;
+  sync_bytes= (ulonglong) sync_mb << 20;
+}
+
+
+bool catchup_mode_enabled()
+{
+  return lag_threshold != 0;
+}
+
+
+bool catchup_mode_active()
+{
+  return active;
+}
+
+
+void catchup_received(size_t len)
+{
+  if (!active)
+    return;
+  received+= len;
+  unsynced+= len;
+}
+
+
+static void enter_catchup(ulonglong lag, ulonglong now)
+{
+  active= true;
+  started= now;
+  last_sync= now;
+  received= 0;
+  unsynced= 0;
+  metrics_catchup(true, 0, 0);
+  if (sync_bytes)
+    sql_print_information("Catch-up mode: %llu s behind the master, the "
+                          "binlog is written in %u KB writes and synced "
+                          "every %llu MB", lag,
+                          CATCHUP_WRITE_BUFFER_SIZE >> 10, sync_bytes >> 20);
+  else
+    sql_print_information("Catch-up mode: %llu s behind the master, the "
+                          "binlog is written in %u KB writes", lag,
+                          CATCHUP_WRITE_BUFFER_SIZE >> 10);
+}
+
+
+static void leave_catchup(const char *reason, ulonglong now)
+{
+  ulonglong usec= now > started ? now - started : 0;
+  active= false;
+  behind_since= 0;
+  metrics_catchup(false, unsynced, now > last_sync ? now - last_sync : 0);
+  sql_print_information("Tail mode: %s, %llu MB received in %llu s of "
+                        "catch-up, %llu MB/s", reason, received >> 20,
+                        usec / 1000000,
+                        usec ? (received * 1000000 / usec) >> 20 : 0);
+}
+
+
+Catchup_change catchup_transaction(uint32 when, ulonglong now)
+{
+  if (!lag_threshold || !when)
+    return CATCHUP_UNCHANGED;
+  ulonglong now_sec= now / 1000000;
+  ulonglong lag= now_sec > when ? now_sec - when : 0;
+  if (lag >= lag_threshold)
+  {
+    if (!behind_since)
+      behind_since= now;
+    if (active || now - behind_since < CATCHUP_ENTER_USEC)
+      return CATCHUP_UNCHANGED;
+    enter_catchup(lag, now);
+    return CATCHUP_ENTERED;
+  }
+  behind_since= 0;
+  if (!active || lag >= (lag_threshold + 1) / 2)
+    return CATCHUP_UNCHANGED;
+  leave_catchup("caught up with the master", now);
+  return CATCHUP_LEFT;
+}
+
+
+Catchup_change catchup_at_tail(const char *reason, ulonglong now)
+{
+  behind_since= 0;
+  if (!active)
+    return CATCHUP_UNCHANGED;
+  leave_catchup(reason, now);
+  return CATCHUP_LEFT;
+}
+
+
+bool catchup_sync_due(ulonglong now)
+{
+  return active &&
+         ((sync_bytes && unsynced >= sync_bytes) ||
+          now - last_sync >= CATCHUP_SYNC_MAX_USEC);
+}
+
+
+ulonglong catchup_sync_deadline()
+{
+  return last_sync + CATCHUP_SYNC_MAX_USEC;
+}
+
+
+void catchup_synced(ulonglong now)
+{
+  if (!active)
+    return;
+  metrics_catchup(true, unsynced, now > last_sync ? now - last_sync : 0);
+  unsynced= 0;
+  last_sync= now;
+}
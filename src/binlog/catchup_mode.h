@@ -0,0 +1,89 @@
+/**
+  @file
+
+  @brief
+  Catch-up and tail mode of the write path.
+
+  Far behind the master, after a long stop or a reconnect, nobody waits
+  for the next transaction: no semi-sync ACK is asked for and readers of
+  the binlog server are behind too. Writing each transaction to the
+  kernel then only costs system calls. In catch-up mode the binlog is
+  written in CATCHUP_WRITE_BUFFER_SIZE writes, and flushed, synced and
+  published to the binlog server every catchup_sync_mb or every second.
+  At the tail, each transaction reaches the kernel once it is written.
+
+  Catch-up starts when the transactions arriving for a whole second are
+  catchup_lag_seconds or more older than their timestamp on the master,
+  so a single long statement does not start it. It ends when the lag
+  falls under half of that, or as soon as the master shows it waits for
+  us: a heartbeat, sent when it has nothing left to send, an event
+  asking for a semi-sync ACK, or no event at all until the next sync is
+  due, heartbeats may be off.
+*/
+
+#ifndef MYSQL_CATCHUP_MODE_H
+#define MYSQL_CATCHUP_MODE_H
+
+#include "my_global.h"
+
+/* stdio buffer of the binlog when catch-up mode is enabled */
+#define CATCHUP_WRITE_BUFFER_SIZE (1024 * 1024)
+
+enum Catchup_change
+{
+  CATCHUP_UNCHANGED= 0,
+  CATCHUP_ENTERED,
+  CATCHUP_LEFT
+};
+
+/**
+  Set the thresholds, before the receive thread starts.
+
+  @param lag_seconds  lag that starts catch-up mode, 0 disables it
+  @param sync_mb      bytes between two syncs in catch-up mode, 0 to
+                      flush every second without syncing
+*/
+void catchup_mode_init(uint lag_seconds, uint sync_mb);
+
+/** true unless catchup_lag_seconds is 0. */
+bool catchup_mode_enabled();
+
+/** true in catch-up mode. */
+bool catchup_mode_active();
+
+/** An event of len bytes was received, counted in catch-up mode. */
+void catchup_received(size_t len);
+
+/**
+  A transaction was received completely.
+
+  @param when  timestamp of its last event on the master
+  @param now   my_micro_time()
+
+  @return the mode change, logged
+*/
+Catchup_change catchup_transaction(uint32 when, ulonglong now);
+
+/**
+  The master waits for us, catch-up mode ends.
+
+  @param reason  what showed it, for the log
+  @param now     my_micro_time()
+
+  @return CATCHUP_LEFT if catch-up mode ended, logged
+*/
+Catchup_change catchup_at_tail(const char *reason, ulonglong now);
+
+/** true in catch-up mode when the binlog is due for a sync. */
+bool catchup_sync_due(ulonglong now);
+
+/**
+  In catch-up mode, when the binlog is due for a sync even if no event
+  arrives, in my_micro_time().
+*/
+ulonglong catchup_sync_deadline();
+
+/** The binlog was synced and published at now. */
+void catchup_synced(ulonglong now);
+
+#endif //MYSQL_CATCHUP_MODE_H
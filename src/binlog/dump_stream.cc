@@ -0,0 +1,381 @@
+/**
+  @file
+
+  @brief
+  Binlog dump packet reader, see dump_stream.h.
+
+  Protocol packets are a 3 byte length and a 1 byte sequence number
+  followed by the payload. A payload of MAX_PACKET_LENGTH bytes is
+  continued by the next protocol packet, the last one is shorter, empty
+  if need be.
+
+  With the compressed protocol the connection carries compressed
+  packets instead: a 3 byte length, a 1 byte sequence number and the 3
+  byte length of the data once inflated, 0 if it was sent as is. The
+  data is a piece of the stream of protocol packets, a compressed packet
+  may hold several of them or part of one. The compressed packets are
+  inflated into inflate_buf, the protocol packets are then read from
+  there as from the Vio. The sequence numbers of the compressed packets
+  are checked, those of the protocol packets inside mean nothing.
+*/
+
+#include "dump_stream.h"
+#include "my_sys.h"
+#include "mysql_com.h"
+#include "violite.h"
+#include "sql_common.h"
+#include "errmsg.h"
+#include "server/metrics.h"
+
+#include <zlib.h>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+
+#define PACKET_HEADER_LEN 4
+
+static uchar *read_buf= NULL;
+static size_t read_buf_size= 0;
+/* the last protocol packet read was full, another one follows */
+static bool continued= false;
+
+/* compressed packets as read and the stream inflated from them */
+static uchar *packed_buf= NULL;
+static size_t packed_buf_size= 0;
+static uchar *inflate_buf= NULL;
+static size_t inflate_buf_size= 0;
+/* inflated bytes not read yet are [inflate_pos, inflate_end) */
+static size_t inflate_pos= 0;
+static size_t inflate_end= 0;
+
+
+/**
+  Make buf at least len bytes, keeping its content.
+
+  @retval false  ok
+  @retval true   out of memory, set on mysql
+*/
+static bool reserve(MYSQL *mysql, uchar **buf, size_t *size, size_t len)
+{
+  if (*size >= len)
+    return false;
+  size_t new_size= std::max(len, (size_t) IO_SIZE);
+  uchar *new_buf= (uchar *) my_realloc(PSI_NOT_INSTRUMENTED, *buf, new_size,
+                                       MYF(MY_WME | MY_ALLOW_ZERO_PTR));
+  if (!new_buf)
+  {
+    set_mysql_error(mysql, CR_OUT_OF_MEMORY, unknown_sqlstate);
+    return true;
+  }
+  *buf= new_buf;
+  *size= new_size;
+  return false;
+}
+
+
+/** Read exactly len bytes from the Vio, like net_read_raw_loop(). */
+static bool read_vio(NET *net, uchar *buf, size_t len)
+{
+  while (len)
+  {
+    size_t n= vio_read(net->vio, buf, len);
+    if (n == VIO_SOCKET_ERROR && vio_should_retry(net->vio))
+      continue;
+    if (n == VIO_SOCKET_ERROR || n == 0)
+      return true;
+    buf+= n;
+    len-= n;
+  }
+  return false;
+}
+
+
+/**
+  Read the next compressed packet and append what it holds to
+  inflate_buf. A packet sent as is is read there directly.
+
+  @retval false  ok
+  @retval true   error, set on mysql
+*/
+static bool read_compressed_packet(MYSQL *mysql)
+{
+  NET *net= &mysql->net;
+  uchar header[NET_HEADER_SIZE + COMP_HEADER_SIZE];
+
+  if (read_vio(net, header, sizeof(header)))
+  {
+    set_mysql_error(mysql, CR_SERVER_LOST, unknown_sqlstate);
+    return true;
+  }
+  if (header[3] != (uchar) net->pkt_nr)
+  {
+    set_mysql_error(mysql, CR_NET_PACKETS_OUT_OF_ORDER, unknown_sqlstate);
+    return true;
+  }
+  net->pkt_nr++;
+  net->compress_pkt_nr= net->pkt_nr;
+
+  size_t packed_len= uint3korr(header);
+  size_t inflated_len= uint3korr(header + NET_HEADER_SIZE);
+  size_t len= inflated_len ? inflated_len : packed_len;
+
+  /* only the start of a protocol packet can be left, move it to the front */
+  if (inflate_pos)
+  {
+    memmove(inflate_buf, inflate_buf + inflate_pos, inflate_end - inflate_pos);
+    inflate_end-= inflate_pos;
+    inflate_pos= 0;
+  }
+  if (reserve(mysql, &inflate_buf, &inflate_buf_size, inflate_end + len))
+    return true;
+
+  if (!inflated_len)
+  {
+    if (read_vio(net, inflate_buf + inflate_end, len))
+    {
+      set_mysql_error(mysql, CR_SERVER_LOST, unknown_sqlstate);
+      return true;
+    }
+  }
+  else
+  {
+    if (reserve(mysql, &packed_buf, &packed_buf_size, packed_len))
+      return true;
+    if (read_vio(net, packed_buf, packed_len))
+    {
+      set_mysql_error(mysql, CR_SERVER_LOST, unknown_sqlstate);
+      return true;
+    }
+    ulonglong start= metrics_enabled() ? my_micro_time() : 0;
+    uLongf out_len= (uLongf) len;
+    if (uncompress(inflate_buf + inflate_end, &out_len, packed_buf,
+                   (uLong) packed_len) != Z_OK || out_len != len)
+    {
+      set_mysql_error(mysql, CR_MALFORMED_PACKET, unknown_sqlstate);
+      return true;
+    }
+    if (start)
+      metrics_decompressed(packed_len, len, my_micro_time() - start);
+  }
+  inflate_end+= len;
+  return false;
+}
+
+
+/**
+  Read exactly len bytes of the stream of protocol packets.
+
+  @retval false  ok
+  @retval true   error, set on mysql
+*/
+static bool read_full(MYSQL *mysql, uchar *buf, size_t len)
+{
+  NET *net= &mysql->net;
+
+  if (!net->compress)
+  {
+    if (read_vio(net, buf, len))
+    {
+      set_mysql_error(mysql, CR_SERVER_LOST, unknown_sqlstate);
+      return true;
+    }
+    return false;
+  }
+  while (len)
+  {
+    if (inflate_pos == inflate_end && read_compressed_packet(mysql))
+      return true;
+    size_t n= std::min(len, inflate_end - inflate_pos);
+    memcpy(buf, inflate_buf + inflate_pos, n);
+    inflate_pos+= n;
+    buf+= n;
+    len-= n;
+  }
+  return false;
+}
+
+
+/**
+  Read a protocol packet into read_buf.
+
+  @retval false  ok, *len is its length
+  @retval true   error, set on mysql
+*/
+static bool read_protocol_packet(MYSQL *mysql, size_t *len)
+{
+  NET *net= &mysql->net;
+  uchar header[PACKET_HEADER_LEN];
+
+  if (read_full(mysql, header, sizeof(header)))
+    return true;
+  if (!net->compress)
+  {
+    if (header[3] != (uchar) net->pkt_nr)
+    {
+      set_mysql_error(mysql, CR_NET_PACKETS_OUT_OF_ORDER, unknown_sqlstate);
+      return true;
+    }
+    net->pkt_nr++;
+    net->compress_pkt_nr= net->pkt_nr;
+  }
+
+  *len= uint3korr(header);
+  if (reserve(mysql, &read_buf, &read_buf_size, *len + 1) ||
+      read_full(mysql, read_buf, *len))
+    return true;
+  /* a terminating null, as my_net_read() leaves */
+  read_buf[*len]= 0;
+  continued= *len == MAX_PACKET_LENGTH;
+  return false;
+}
+
+
+/** Set the error of an error packet on mysql, like cli_safe_read(). */
+static void set_packet_error(MYSQL *mysql, const uchar *pos, size_t len)
+{
+  const char *sqlstate= unknown_sqlstate;
+  char state[SQLSTATE_LENGTH + 1];
+  uint errcode= CR_UNKNOWN_ERROR;
+
+  if (len > 3)
+  {
+    errcode= uint2korr(pos + 1);
+    pos+= 3;
+    len-= 3;
+    if (len > SQLSTATE_LENGTH && pos[0] == '#')
+    {
+      memcpy(state, pos + 1, SQLSTATE_LENGTH);
+      state[SQLSTATE_LENGTH]= 0;
+      sqlstate= state;
+      pos+= SQLSTATE_LENGTH + 1;
+      len-= SQLSTATE_LENGTH + 1;
+    }
+    set_mysql_extended_error(mysql, errcode, sqlstate, "%.*s",
+                             (int) std::min(len, (size_t) MYSQL_ERRMSG_SIZE - 1),
+                             (const char *) pos);
+  }
+  else
+    set_mysql_error(mysql, errcode, sqlstate);
+}
+
+
+ulong dump_stream_read(MYSQL *mysql, const uchar **packet, bool *partial)
+{
+  size_t len;
+
+  *partial= false;
+  if (read_protocol_packet(mysql, &len))
+    return packet_error;
+  if (len == 0)
+  {
+    set_mysql_error(mysql, CR_SERVER_LOST, unknown_sqlstate);
+    return packet_error;
+  }
+  if (read_buf[0] == 255 && !continued)
+  {
+    set_packet_error(mysql, read_buf, len);
+    return packet_error;
+  }
+  *partial= continued;
+  *packet= read_buf;
+  return (ulong) len;
+}
+
+
+bool dump_stream_more()
+{
+  return continued;
+}
+
+
+bool dump_stream_next(MYSQL *mysql, const uchar **chunk, size_t *len)
+{
+  DBUG_ASSERT(continued);
+  if (read_protocol_packet(mysql, len))
+    return true;
+  *chunk= read_buf;
+  return false;
+}
+
+
+bool dump_stream_pending(MYSQL *mysql)
+{
+  NET *net= &mysql->net;
+  if (net->compress && inflate_pos < inflate_end)
+    return true;
+  return vio_has_data(net->vio) ||
+         vio_io_wait(net->vio, VIO_IO_EVENT_READ, 0) > 0;
+}
+
+
+bool dump_stream_wait(MYSQL *mysql, int timeout_ms)
+{
+  NET *net= &mysql->net;
+  if (net->compress && inflate_pos < inflate_end)
+    return true;
+  return vio_has_data(net->vio) ||
+         vio_io_wait(net->vio, VIO_IO_EVENT_READ, timeout_ms) != 0;
+}
+
+
+bool dump_stream_ready(MYSQL *mysql)
+{
+  NET *net= &mysql->net;
+  Vio *vio= net->vio;
+  uchar header[PACKET_HEADER_LEN];
+  size_t buffered= 0;
+  int queued= 0;
+
+  if (net->compress)
+  {
+    size_t inflated= inflate_end - inflate_pos;
+    if (inflated >= PACKET_HEADER_LEN &&
+        inflated >= PACKET_HEADER_LEN + uint3korr(inflate_buf + inflate_pos))
+      return true;
+    /* what is on the wire has to be inflated to know */
+    return dump_stream_pending(mysql);
+  }
+  if (vio->type == VIO_TYPE_SSL)
+    return dump_stream_pending(mysql);
+
+  /* what the Vio read ahead comes first, then what the kernel holds */
+  if (vio->read_buffer)
+    buffered= (size_t) (vio->read_end - vio->read_pos);
+  if (ioctl(vio_fd(vio), FIONREAD, &queued) || queued < 0)
+    queued= 0;
+  size_t available= buffered + (size_t) queued;
+  if (available < PACKET_HEADER_LEN)
+    return false;
+
+  size_t from_buffer= std::min(buffered, (size_t) PACKET_HEADER_LEN);
+  memcpy(header, vio->read_pos, from_buffer);
+  if (from_buffer < PACKET_HEADER_LEN)
+  {
+    ssize_t peeked= recv(vio_fd(vio), header + from_buffer,
+                         PACKET_HEADER_LEN - from_buffer,
+                         MSG_PEEK | MSG_DONTWAIT);
+    if (peeked != (ssize_t) (PACKET_HEADER_LEN - from_buffer))
+      return false;
+  }
+  return available >= PACKET_HEADER_LEN + uint3korr(header);
+}
+
+
+void dump_stream_reset()
+{
+  continued= false;
+  inflate_pos= inflate_end= 0;
+}
+
+
+void dump_stream_end()
+{
+  my_free(read_buf);
+  my_free(packed_buf);
+  my_free(inflate_buf);
+  read_buf= packed_buf= inflate_buf= NULL;
+  read_buf_size= packed_buf_size= inflate_buf_size= 0;
+  dump_stream_reset();
+}
@@ -0,0 +1,85 @@
+/**
+  @file
+
+  @brief
+  Reader of the packets of a binlog dump connection.
+
+  cli_safe_read() assembles a packet that spans several protocol packets
+  of MAX_PACKET_LENGTH bytes in the NET buffer, so receiving a 1GB row
+  event takes 1GB of memory. This reader reads the protocol packets from
+  the Vio itself, the way my_net_read() does. A packet that fits in one
+  protocol packet is returned whole. For a longer one, only an event in
+  a dump, the first protocol packet is returned and the caller takes the
+  rest with dump_stream_next(), one protocol packet at a time, so memory
+  stays at one protocol packet whatever the size of the event.
+
+  With the compressed protocol (master_compress) the reader inflates the
+  compressed packets itself, in the receive thread, into a buffer the
+  protocol packets are then read from, so large events are still
+  received one protocol packet at a time.
+*/
+
+#ifndef MYSQL_DUMP_STREAM_H
+#define MYSQL_DUMP_STREAM_H
+
+#include "my_global.h"
+#include "mysql.h"
+
+/**
+  Read the next packet.
+
+  @param mysql         the connection the dump was requested on
+  @param[out] packet   the packet, valid until the next call
+  @param[out] partial  true if only the first protocol packet of a
+                       longer packet was read, see dump_stream_next()
+
+  @return length of the packet (of its first protocol packet if
+          partial), packet_error with the error set on mysql
+*/
+ulong dump_stream_read(MYSQL *mysql, const uchar **packet, bool *partial);
+
+/** true while the packet being read has protocol packets left. */
+bool dump_stream_more();
+
+/**
+  Read the next protocol packet of a partial packet.
+
+  @param mysql       the connection
+  @param[out] chunk  its payload, valid until the next call
+  @param[out] len    its length, may be 0 for the last one
+
+  @retval false  ok
+  @retval true   read error, set on mysql
+*/
+bool dump_stream_next(MYSQL *mysql, const uchar **chunk, size_t *len);
+
+/**
+  true if more of the stream has arrived already, so the next
+  dump_stream_read() does not wait for the master, or hardly: only the
+  start of the packet may be there.
+*/
+bool dump_stream_pending(MYSQL *mysql);
+
+/**
+  true if the whole next protocol packet has arrived, so the next
+  dump_stream_read() returns without waiting. With the compressed
+  protocol or SSL only dump_stream_pending() is known.
+*/
+bool dump_stream_ready(MYSQL *mysql);
+
+/**
+  Wait up to timeout_ms for more of the stream, true if it arrived or
+  the connection failed, the next dump_stream_read() then tells.
+*/
+bool dump_stream_wait(MYSQL *mysql, int timeout_ms);
+
+/**
+  Forget what was read on the previous connection, called once the dump
+  is requested on a new one.
+*/
+void dump_stream_reset();
+
+/** Free the read buffers. */
+void dump_stream_end();
+
+#endif //MYSQL_DUMP_STREAM_H
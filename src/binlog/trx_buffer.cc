@@ -0,0 +1,44 @@
+/**
+  @file
+
+  @brief
+  Transaction write buffer, see trx_buffer.h.
+*/
+
+#include "trx_buffer.h"
+
+#include <stdlib.h>
+
+/* first allocation, enough for most OLTP transactions */
+static const size_t TRX_BUFFER_MIN_SIZE= 16 * 1024;
+
+
+Trx_buffer::Trx_buffer()
+  : buf(NULL), size(0), used(0)
+{
+}
+
+
+Trx_buffer::~Trx_buffer()
+{
+  free(buf);
+}
+
+
+bool Trx_buffer::append(const uchar *event, size_t len)
+{
+  if (used + len > size)
+  {
+    size_t new_size= size ? size : TRX_BUFFER_MIN_SIZE;
+    while (new_size < used + len)
+      new_size*= 2;
+    uchar *new_buf= (uchar *) realloc(buf, new_size);
+    if (!new_buf)
+      return true;
+    buf= new_buf;
+    size= new_size;
+  }
+  memcpy(buf + used, event, len);
+  used+= len;
+  return false;
+}
@@ -0,0 +1,48 @@
+/**
+  @file
+
+  @brief
+  Buffer collecting the events of one transaction, from its GTID event
+  to its XID or COMMIT, so they reach the binlog with a single write.
+
+  The memory is kept from one transaction to the next and only grows up
+  to the size cap, a transaction that does not fit is written event by
+  event from the point where it overflowed.
+*/
+
+#ifndef MYSQL_TRX_BUFFER_H
+#define MYSQL_TRX_BUFFER_H
+
+#include "my_global.h"
+
+class Trx_buffer
+{
+public:
+  Trx_buffer();
+  ~Trx_buffer();
+
+  /**
+    Append an event.
+
+    @retval false  ok
+    @retval true   out of memory, nothing appended
+  */
+  bool append(const uchar *event, size_t len);
+
+  const uchar *data() const { return buf; }
+  size_t length() const { return used; }
+  bool is_empty() const { return used == 0; }
+
+  /** Forget the events, the memory is kept for the next transaction. */
+  void clear() { used= 0; }
+
+private:
+  Trx_buffer(const Trx_buffer &);
+  Trx_buffer &operator=(const Trx_buffer &);
+
+  uchar *buf;
+  size_t size;
+  size_t used;
+};
+
+#endif //MYSQL_TRX_BUFFER_H
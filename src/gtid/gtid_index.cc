@@ -0,0 +1,628 @@
+/**
+  @file
+
+  @brief
+  Per-binlog GTID index, see gtid_index.h.
+
+  All sets share one Sid_map and are only touched with index_lock held,
+  the receive thread and the reader threads of the binlog server are the
+  users.
+*/
+
+#define MYSQL_CLIENT
+#undef MYSQL_SERVER
+#include "gtid_index.h"
+#include "binlog/binlog_raw.h"
+#include "binlog/binlog_file.h"
+#include "log/vs_log.h"
+#include "rpl_gtid.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+
+using std::string;
+using std::vector;
+using std::map;
+
+static const char GTID_INDEX_FILE[]= "virtual_slave-bin.gtid_index";
+static const char GTID_INDEX_TMP_FILE[]= "virtual_slave-bin.gtid_index.tmp";
+
+/* like the default format, but on one line so an entry is one line */
+static const Gtid_set::String_format gtid_index_format=
+{
+  "", "", ":", "-", ":", ",", "",
+  0, 0, 1, 1, 1, 1, 0
+};
+
+struct Gtid_index_entry
+{
+  char log_name[FN_REFLEN + 1];
+  Gtid_set previous_gtids;
+  Gtid_set added_gtids;
+  binary_log::enum_binlog_checksum_alg checksum_alg;
+  /* false if a GTID could not be recorded, the binlog is never skipped */
+  bool complete;
+
+  Gtid_index_entry(Sid_map *sid_map, const char *name)
+    : previous_gtids(sid_map), added_gtids(sid_map),
+      checksum_alg(binary_log::BINLOG_CHECKSUM_ALG_OFF), complete(true)
+  {
+    strncpy(log_name, name, FN_REFLEN);
+    log_name[FN_REFLEN]= 0;
+  }
+};
+
+struct Gtid_index_filter
+{
+  Gtid_set gtids;
+
+  Gtid_index_filter(Sid_map *sid_map) : gtids(sid_map) {}
+};
+
+static pthread_mutex_t index_lock= PTHREAD_MUTEX_INITIALIZER;
+static Sid_map *index_sid_map= NULL;
+/* in binlog order */
+static vector<Gtid_index_entry *> entries;
+/* the entry of the binlog being written, NULL between ROTATE and FDE */
+static Gtid_index_entry *active_entry= NULL;
+static FILE *gtid_index_file= NULL;
+
+
+/**
+  Add the GTID of a GTID_LOG_EVENT to entry->added_gtids.
+*/
+static void add_gtid(Gtid_index_entry *entry, const uchar *event, size_t len)
+{
+  rpl_sid sid;
+  rpl_sidno sidno;
+
+  if (len < RAW_GTID_MIN_LEN)
+  {
+    entry->complete= false;
+    return;
+  }
+  sid.copy_from(raw_gtid_sid(event));
+  if ((sidno= index_sid_map->add_sid(sid)) <= 0 ||
+      entry->added_gtids.ensure_sidno(sidno) != RETURN_STATUS_OK)
+  {
+    entry->complete= false;
+    return;
+  }
+  entry->added_gtids._add_gtid(sidno, raw_gtid_gno(event));
+}
+
+
+/**
+  Set entry->previous_gtids from a PREVIOUS_GTIDS_LOG_EVENT.
+*/
+static void set_previous_gtids(Gtid_index_entry *entry, const uchar *event,
+                               size_t len)
+{
+  size_t data_len= raw_event_data_len(len, entry->checksum_alg);
+
+  entry->previous_gtids.clear();
+  if (data_len < LOG_EVENT_HEADER_LEN ||
+      entry->previous_gtids.add_gtid_encoding(event + LOG_EVENT_HEADER_LEN,
+                                              data_len -
+                                              LOG_EVENT_HEADER_LEN) !=
+      RETURN_STATUS_OK)
+  {
+    sql_print_warning("GTID index: bad PREVIOUS_GTIDS_LOG_EVENT in '%s'",
+                      entry->log_name);
+    entry->complete= false;
+  }
+}
+
+
+/**
+  Write the entry of a closed binlog to the index file.
+*/
+static void write_entry(FILE *file, const Gtid_index_entry *entry)
+{
+  char *previous= NULL;
+  char *added= NULL;
+
+  if (!file || !entry->complete)
+    return;
+  if (entry->previous_gtids.to_string(&previous, false,
+                                      &gtid_index_format) < 0 ||
+      entry->added_gtids.to_string(&added, false, &gtid_index_format) < 0 ||
+      fprintf(file, "%s\t%s\t%s\n", entry->log_name, previous, added) < 0 ||
+      fflush(file))
+    sql_print_warning("GTID index: could not record '%s', it will be "
+                      "scanned at the next start", entry->log_name);
+  my_free(previous);
+  my_free(added);
+}
+
+
+/**
+  Build the entry of a binlog by reading it.
+
+  @param[out] closed  true if the binlog ends with a ROTATE_EVENT
+
+  @return the entry, NULL if the file can not be read at all
+*/
+static Gtid_index_entry *scan_file(const char *log_name, bool *closed)
+{
+  uchar header[LOG_EVENT_HEADER_LEN];
+  uchar *buf= NULL;
+  size_t buf_size= 0;
+  my_off_t pos= BIN_LOG_HEADER_SIZE;
+  Binlog_file *file;
+
+  *closed= false;
+  if (!(file= binlog_file_open(log_name)))
+  {
+    sql_print_error("GTID index: could not open binlog '%s'", log_name);
+    return NULL;
+  }
+  Gtid_index_entry *entry= new Gtid_index_entry(index_sid_map, log_name);
+
+  /* A truncated event at the end is the tail of an unfinished write. */
+  while (binlog_file_pread(file, header, sizeof(header), pos) ==
+         sizeof(header))
+  {
+    uint32 len= raw_event_len(header);
+    if (len < LOG_EVENT_HEADER_LEN)
+      break;
+    if (buf_size < len)
+    {
+      uchar *new_buf= (uchar *) realloc(buf, len);
+      if (!new_buf)
+      {
+        entry->complete= false;
+        break;
+      }
+      buf= new_buf;
+      buf_size= len;
+    }
+    if (binlog_file_pread(file, buf, len, pos) != (ssize_t) len)
+      break;
+    pos+= len;
+
+    switch (raw_event_type(buf))
+    {
+    case binary_log::FORMAT_DESCRIPTION_EVENT:
+      entry->checksum_alg= raw_fde_checksum_alg(buf, len);
+      break;
+    case binary_log::PREVIOUS_GTIDS_LOG_EVENT:
+      set_previous_gtids(entry, buf, len);
+      break;
+    case binary_log::GTID_LOG_EVENT:
+      add_gtid(entry, buf, len);
+      break;
+    case binary_log::ROTATE_EVENT:
+      *closed= true;
+      break;
+    default:
+      break;
+    }
+  }
+
+  free(buf);
+  binlog_file_close(file);
+  return entry;
+}
+
+
+static void clear_entries()
+{
+  for (size_t i= 0; i < entries.size(); i++)
+    delete entries[i];
+  entries.clear();
+  active_entry= NULL;
+}
+
+
+/**
+  Parse the stored entries into name -> (previous gtids, added gtids).
+*/
+static void load_stored_entries(map<string, std::pair<string, string> > *stored)
+{
+  std::ifstream in(GTID_INDEX_FILE);
+  string line;
+
+  while (std::getline(in, line))
+  {
+    size_t tab1= line.find('\t');
+    size_t tab2= tab1 == string::npos ? tab1 : line.find('\t', tab1 + 1);
+    if (tab2 == string::npos)
+      continue;
+    (*stored)[line.substr(0, tab1)]=
+      std::make_pair(line.substr(tab1 + 1, tab2 - tab1 - 1),
+                     line.substr(tab2 + 1));
+  }
+}
+
+
+bool gtid_index_init(const char *binlog_index_file)
+{
+  map<string, std::pair<string, string> > stored;
+  vector<string> binlogs;
+  string line;
+  size_t scanned= 0;
+
+  index_sid_map= new Sid_map(NULL);
+  load_stored_entries(&stored);
+
+  std::ifstream in(binlog_index_file);
+  while (std::getline(in, line))
+  {
+    if (!line.empty())
+      binlogs.push_back(line);
+  }
+
+  pthread_mutex_lock(&index_lock);
+  for (size_t i= 0; i < binlogs.size(); i++)
+  {
+    const char *log_name= binlogs[i].c_str();
+    bool last= i + 1 == binlogs.size();
+    bool closed= !last;
+    Gtid_index_entry *entry= NULL;
+
+    map<string, std::pair<string, string> >::const_iterator it=
+      stored.find(binlogs[i]);
+    if (!last && it != stored.end())
+    {
+      entry= new Gtid_index_entry(index_sid_map, log_name);
+      if (entry->previous_gtids.add_gtid_text(it->second.first.c_str()) !=
+          RETURN_STATUS_OK ||
+          entry->added_gtids.add_gtid_text(it->second.second.c_str()) !=
+          RETURN_STATUS_OK)
+      {
+        delete entry;
+        entry= NULL;
+      }
+    }
+    if (!entry)
+    {
+      /* No usable entry, or the active binlog that may have grown. */
+      if (!(entry= scan_file(log_name, &closed)))
+        continue;
+      if (!last)
+        closed= true;
+      scanned++;
+    }
+    entries.push_back(entry);
+    if (!closed)
+      active_entry= entry;
+  }
+
+  /* Rewrite the index, which drops the entries of removed binlogs. */
+  FILE *tmp= fopen(GTID_INDEX_TMP_FILE, "w");
+  if (tmp)
+  {
+    for (size_t i= 0; i < entries.size(); i++)
+    {
+      if (entries[i] != active_entry)
+        write_entry(tmp, entries[i]);
+    }
+    if (fclose(tmp) || rename(GTID_INDEX_TMP_FILE, GTID_INDEX_FILE))
+      sql_print_warning("GTID index: could not rewrite '%s'", GTID_INDEX_FILE);
+  }
+  if (!(gtid_index_file= fopen(GTID_INDEX_FILE, "a")))
+  {
+    pthread_mutex_unlock(&index_lock);
+    sql_print_error("GTID index: could not open '%s'", GTID_INDEX_FILE);
+    return true;
+  }
+  pthread_mutex_unlock(&index_lock);
+
+  sql_print_information("GTID index: %lu binlogs, %lu of them scanned",
+                        (ulong) entries.size(), (ulong) scanned);
+  return false;
+}
+
+
+void gtid_index_reset()
+{
+  pthread_mutex_lock(&index_lock);
+  clear_entries();
+  if (gtid_index_file && ftruncate(fileno(gtid_index_file), 0))
+    sql_print_warning("GTID index: could not truncate '%s'", GTID_INDEX_FILE);
+  pthread_mutex_unlock(&index_lock);
+}
+
+
+void gtid_index_append(const char *log_name, const uchar *event, size_t len)
+{
+  if (!index_sid_map || len < LOG_EVENT_HEADER_LEN)
+    return;
+
+  switch (raw_event_type(event))
+  {
+  case binary_log::FORMAT_DESCRIPTION_EVENT:
+    pthread_mutex_lock(&index_lock);
+    if (!entries.empty() && !strcmp(entries.back()->log_name, log_name))
+    {
+      /* The binlog is written again from the start. */
+      delete entries.back();
+      entries.pop_back();
+    }
+    else if (active_entry)
+    {
+      /* The previous binlog ended without a ROTATE_EVENT. */
+      write_entry(gtid_index_file, active_entry);
+    }
+    active_entry= new Gtid_index_entry(index_sid_map, log_name);
+    active_entry->checksum_alg= raw_fde_checksum_alg(event, len);
+    entries.push_back(active_entry);
+    pthread_mutex_unlock(&index_lock);
+    break;
+  case binary_log::PREVIOUS_GTIDS_LOG_EVENT:
+    pthread_mutex_lock(&index_lock);
+    if (active_entry)
+      set_previous_gtids(active_entry, event, len);
+    pthread_mutex_unlock(&index_lock);
+    break;
+  case binary_log::GTID_LOG_EVENT:
+    pthread_mutex_lock(&index_lock);
+    if (active_entry)
+      add_gtid(active_entry, event, len);
+    pthread_mutex_unlock(&index_lock);
+    break;
+  case binary_log::ROTATE_EVENT:
+    pthread_mutex_lock(&index_lock);
+    if (active_entry)
+      write_entry(gtid_index_file, active_entry);
+    active_entry= NULL;
+    pthread_mutex_unlock(&index_lock);
+    break;
+  default:
+    break;
+  }
+}
+
+
+Gtid_index_filter *gtid_index_filter_create(const char *gtid_text,
+                                            char *start_file,
+                                            const char **errmsg)
+{
+  Gtid_index_filter *filter;
+  size_t lo= 0, hi;
+
+  if (!index_sid_map)
+  {
+    *errmsg= "the GTID index is not available";
+    return NULL;
+  }
+
+  pthread_mutex_lock(&index_lock);
+  filter= new Gtid_index_filter(index_sid_map);
+  if (filter->gtids.add_gtid_text(gtid_text) != RETURN_STATUS_OK)
+  {
+    *errmsg= "malformed GTID set";
+    goto err;
+  }
+  if (entries.empty())
+  {
+    *errmsg= "there are no binlogs yet";
+    goto err;
+  }
+  if (!entries[0]->previous_gtids.is_subset(&filter->gtids))
+  {
+    *errmsg= "the reader needs GTIDs that are no longer in the binlogs";
+    goto err;
+  }
+
+  /*
+    The previous GTIDs only grow from one binlog to the next, find the
+    last binlog the reader has everything before.
+  */
+  hi= entries.size();
+  while (hi - lo > 1)
+  {
+    size_t mid= lo + (hi - lo) / 2;
+    if (entries[mid]->previous_gtids.is_subset(&filter->gtids))
+      lo= mid;
+    else
+      hi= mid;
+  }
+  /* Then skip the closed binlogs the reader has as a whole. */
+  while (lo + 1 < entries.size() && entries[lo]->complete &&
+         entries[lo]->added_gtids.is_subset(&filter->gtids))
+    lo++;
+
+  strcpy(start_file, entries[lo]->log_name);
+  pthread_mutex_unlock(&index_lock);
+  return filter;
+
+err:
+  delete filter;
+  pthread_mutex_unlock(&index_lock);
+  return NULL;
+}
+
+
+void gtid_index_filter_free(Gtid_index_filter *filter)
+{
+  pthread_mutex_lock(&index_lock);
+  delete filter;
+  pthread_mutex_unlock(&index_lock);
+}
+
+
+bool gtid_index_filter_file_clean(Gtid_index_filter *filter,
+                                  const char *log_name)
+{
+  bool clean= false;
+
+  pthread_mutex_lock(&index_lock);
+  /* Readers are almost always in one of the last binlogs. */
+  for (size_t i= entries.size(); i-- > 0;)
+  {
+    if (!strcmp(entries[i]->log_name, log_name))
+    {
+      clean= entries[i]->complete &&
+             !entries[i]->added_gtids.is_intersection_nonempty(&filter->gtids);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&index_lock);
+  return clean;
+}
+
+
+size_t gtid_index_filter_events(Gtid_index_filter *filter, uchar *buf,
+                                size_t len, bool *skipping)
+{
+  size_t in= 0, out= 0;
+
+  pthread_mutex_lock(&index_lock);
+  while (in + LOG_EVENT_HEADER_LEN <= len)
+  {
+    uchar *event= buf + in;
+    uint32 event_len= raw_event_len(event);
+    if (event_len < LOG_EVENT_HEADER_LEN || event_len > len - in)
+      break;
+
+    switch (raw_event_type(event))
+    {
+    case binary_log::GTID_LOG_EVENT:
+      if (event_len >= RAW_GTID_MIN_LEN)
+      {
+        rpl_sid sid;
+        sid.copy_from(raw_gtid_sid(event));
+        rpl_sidno sidno= index_sid_map->sid_to_sidno(sid);
+        *skipping= sidno > 0 &&
+                   filter->gtids.contains_gtid(sidno, raw_gtid_gno(event));
+      }
+      else
+        *skipping= false;
+      break;
+    case binary_log::ANONYMOUS_GTID_LOG_EVENT:
+    case binary_log::FORMAT_DESCRIPTION_EVENT:
+    case binary_log::PREVIOUS_GTIDS_LOG_EVENT:
+    case binary_log::ROTATE_EVENT:
+    case binary_log::STOP_EVENT:
+      /* Not part of a transaction, always sent. */
+      *skipping= false;
+      break;
+    default:
+      break;
+    }
+
+    if (!*skipping)
+    {
+      if (out != in)
+        memmove(buf + out, event, event_len);
+      out+= event_len;
+    }
+    in+= event_len;
+  }
+  pthread_mutex_unlock(&index_lock);
+  return out;
+}
+
+
+void gtid_index_closed_binlogs(vector<Gtid_index_binlog> *binlogs)
+{
+  pthread_mutex_lock(&index_lock);
+  for (size_t i= 0; i < entries.size(); i++)
+  {
+    const Gtid_index_entry *entry= entries[i];
+    char *previous= NULL;
+    char *added= NULL;
+
+    if (entry == active_entry || !entry->complete ||
+        entry->previous_gtids.to_string(&previous, false,
+                                        &gtid_index_format) < 0 ||
+        entry->added_gtids.to_string(&added, false, &gtid_index_format) < 0)
+    {
+      my_free(previous);
+      break;
+    }
+    Gtid_index_binlog binlog;
+    binlog.log_name= entry->log_name;
+    binlog.previous_gtids= previous;
+    binlog.added_gtids= added;
+    binlogs->push_back(binlog);
+    my_free(previous);
+    my_free(added);
+  }
+  pthread_mutex_unlock(&index_lock);
+}
+
+
+bool gtid_index_add_fetched(const char *file_name,
+                            const Gtid_index_binlog &binlog,
+                            const char **errmsg)
+{
+  bool closed;
+  Gtid_index_entry *entry;
+
+  if (!index_sid_map)
+  {
+    *errmsg= "the GTID index is not available";
+    return true;
+  }
+  /* Read without the lock, nobody else knows the file yet. */
+  if (!(entry= scan_file(file_name, &closed)))
+  {
+    *errmsg= "could not read the binlog";
+    return true;
+  }
+  strncpy(entry->log_name, binlog.log_name.c_str(), FN_REFLEN);
+  entry->log_name[FN_REFLEN]= 0;
+
+  pthread_mutex_lock(&index_lock);
+  Gtid_set listed_previous(index_sid_map);
+  Gtid_set listed_added(index_sid_map);
+  bool replace= !entries.empty() &&
+                !strcmp(entries.back()->log_name, entry->log_name);
+  const Gtid_index_entry *last= NULL;
+  if (entries.size() > (replace ? 1U : 0U))
+    last= entries[entries.size() - (replace ? 2 : 1)];
+
+  if (!closed)
+    *errmsg= "the binlog does not end with a ROTATE_EVENT";
+  else if (!entry->complete)
+    *errmsg= "the GTIDs of the binlog could not be read";
+  else if (listed_previous.add_gtid_text(binlog.previous_gtids.c_str()) !=
+           RETURN_STATUS_OK ||
+           listed_added.add_gtid_text(binlog.added_gtids.c_str()) !=
+           RETURN_STATUS_OK)
+    *errmsg= "the peer listed a malformed GTID set";
+  else if (!entry->previous_gtids.equals(&listed_previous) ||
+           !entry->added_gtids.equals(&listed_added))
+    *errmsg= "the GTIDs of the binlog are not those the peer listed";
+  else if (last && last == active_entry)
+    *errmsg= "the binlog before it is not closed";
+  else
+  {
+    *errmsg= NULL;
+    if (last && last->complete)
+    {
+      /* Nothing may be missing between the last binlog and this one. */
+      Gtid_set expected(index_sid_map);
+      if (expected.add_gtid_set(&last->previous_gtids) != RETURN_STATUS_OK ||
+          expected.add_gtid_set(&last->added_gtids) != RETURN_STATUS_OK ||
+          !expected.equals(&entry->previous_gtids))
+        *errmsg= "the binlog does not follow the last binlog of the index";
+    }
+  }
+  if (*errmsg)
+  {
+    pthread_mutex_unlock(&index_lock);
+    delete entry;
+    return true;
+  }
+
+  if (replace)
+  {
+    if (entries.back() == active_entry)
+      active_entry= NULL;
+    delete entries.back();
+    entries.pop_back();
+  }
+  entries.push_back(entry);
+  write_entry(gtid_index_file, entry);
+  pthread_mutex_unlock(&index_lock);
+  return false;
+}
@@ -0,0 +1,137 @@
+/**
+  @file
+
+  @brief
+  Per-binlog GTID index: for every binlog in binlog_dir, the set of its
+  PREVIOUS_GTIDS_LOG_EVENT and the GTIDs of the transactions in it.
+
+  The receive thread feeds every event it writes to gtid_index_append(),
+  so the index is always current without reading the files again. When a
+  binlog is closed its entry is appended to the file
+  virtual_slave-bin.gtid_index, one line per binlog:
+
+    <binlog>\t<previous gtids>\t<gtids added in the binlog>\n
+
+  At startup the entries are loaded from there, only binlogs without an
+  entry (and the active one) are scanned.
+
+  The binlog server uses the index to serve readers that position with a
+  GTID set: a binary search over the previous GTIDs finds the first binlog
+  to send and whole binlogs whose GTIDs the reader has are skipped.
+
+  It also lists the closed binlogs with their GTIDs to a peer catching up
+  (peer_catchup.h), which checks the binlogs it fetched against that list
+  before adding them to its own index.
+*/
+
+#ifndef MYSQL_GTID_INDEX_H
+#define MYSQL_GTID_INDEX_H
+
+#include "my_global.h"
+
+#include <string>
+#include <vector>
+
+/**
+  Load the index, scanning the binlogs that have no entry in it.
+
+  @param binlog_index_file  name of the binlog index file, relative to
+                            the current work dir (binlog_dir)
+
+  @retval false  ok
+  @retval true   failure, the reason has been logged
+*/
+bool gtid_index_init(const char *binlog_index_file);
+
+/** Forget all entries, called when the binlogs are removed. */
+void gtid_index_reset();
+
+/**
+  Account for an event the receive thread has written.
+
+  FORMAT_DESCRIPTION_EVENT starts a new entry, PREVIOUS_GTIDS_LOG_EVENT
+  and GTID_LOG_EVENT fill it and ROTATE_EVENT closes it, other events
+  are ignored.
+
+  @param log_name  binlog the event was written to
+  @param event     the event
+  @param len       length of the event
+*/
+void gtid_index_append(const char *log_name, const uchar *event, size_t len);
+
+/** The GTID set a reader has, opaque to the binlog server. */
+struct Gtid_index_filter;
+
+/**
+  Parse the GTID set of a reader and find the binlog to start with.
+
+  @param gtid_text        the reader's GTID set in text form
+  @param[out] start_file  first binlog with a transaction the reader lacks,
+                          at least FN_REFLEN + 1 bytes
+  @param[out] errmsg      why the reader can not be served
+
+  @return the filter, NULL on error
+*/
+Gtid_index_filter *gtid_index_filter_create(const char *gtid_text,
+                                            char *start_file,
+                                            const char **errmsg);
+
+void gtid_index_filter_free(Gtid_index_filter *filter);
+
+/**
+  true if no transaction of log_name is in the reader's set so far, i.e.
+  the binlog can be sent without looking at it.
+*/
+bool gtid_index_filter_file_clean(Gtid_index_filter *filter,
+                                  const char *log_name);
+
+/**
+  Drop the transactions the reader already has from a buffer of whole
+  events, in place.
+
+  @param filter         the reader's set
+  @param buf            events
+  @param len            length of the events in buf
+  @param[in,out] skipping  true while inside a transaction being dropped,
+                        carried from one call to the next
+
+  @return length of the events left in buf
+*/
+size_t gtid_index_filter_events(Gtid_index_filter *filter, uchar *buf,
+                                size_t len, bool *skipping);
+
+/** A closed binlog and its GTIDs, in the text form of the index file. */
+struct Gtid_index_binlog
+{
+  std::string log_name;
+  std::string previous_gtids;
+  std::string added_gtids;
+};
+
+/**
+  List the closed binlogs in order, up to the first one whose GTIDs are
+  not all known.
+*/
+void gtid_index_closed_binlogs(std::vector<Gtid_index_binlog> *binlogs);
+
+/**
+  Check a binlog fetched from a peer and index it.
+
+  The binlog must end with a ROTATE_EVENT, have the GTIDs the peer listed
+  for it and follow the last closed binlog of the index: its previous
+  GTIDs are those of that binlog plus the GTIDs added in it. When
+  log_name is the last binlog of the index, the local copy was not
+  complete and its entry is replaced.
+
+  @param file_name  where the binlog was stored
+  @param binlog     name and GTIDs as listed by the peer
+  @param[out] errmsg  why the binlog was refused
+
+  @retval false  indexed as binlog->log_name
+  @retval true   refused
+*/
+bool gtid_index_add_fetched(const char *file_name,
+                            const Gtid_index_binlog &binlog,
+                            const char **errmsg);
+
+#endif //MYSQL_GTID_INDEX_H
@@ -0,0 +1,181 @@
+/**
+  @file
+
+  @brief
+  GTID set parser, see gtid_text_parser.h.
+
+  The 32 hex digits of a UUID are gathered without the dashes and, with
+  SSE2, validated and converted 16 digits at a time. GNOs are plain
+  decimal loops.
+*/
+
+#include "gtid_text_parser.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* length of a UUID in text form, with the four dashes */
+static const size_t UUID_TEXT_LEN= 36;
+/* largest GNO, GNO_END - 1 in rpl_gtid.h */
+static const longlong GNO_MAX= 0x7fffffffffffffffLL - 1;
+
+
+static inline bool is_space(char c)
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+
+static inline const char *skip_space(const char *p)
+{
+  while (is_space(*p))
+    p++;
+  return p;
+}
+
+
+/**
+  Convert 32 hex digits to 16 bytes.
+
+  @retval false  ok
+  @retval true   a character is not a hex digit
+*/
+static bool hex_to_bytes(const char *hex, uchar *out)
+{
+#ifdef __SSE2__
+  for (int half= 0; half < 2; half++)
+  {
+    __m128i v= _mm_loadu_si128((const __m128i *) (hex + 16 * half));
+    /* 'A'-'F' become 'a'-'f', digits stay as they are */
+    __m128i lower= _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i digit= _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                 _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i alpha= _mm_and_si128(_mm_cmpgt_epi8(lower,
+                                                _mm_set1_epi8('a' - 1)),
+                                 _mm_cmplt_epi8(lower,
+                                                _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff)
+      return true;
+
+    /* digits: c - '0', letters: c - 'a' + 10 */
+    __m128i nibbles=
+      _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+                   _mm_and_si128(alpha, _mm_sub_epi8(lower,
+                                                     _mm_set1_epi8('a' - 10))));
+    /* each 16 bit lane holds two nibbles, high one in the low byte */
+    __m128i high= _mm_slli_epi16(_mm_and_si128(nibbles,
+                                               _mm_set1_epi16(0x00ff)), 4);
+    __m128i low= _mm_srli_epi16(nibbles, 8);
+    __m128i bytes= _mm_packus_epi16(_mm_or_si128(high, low),
+                                    _mm_setzero_si128());
+    _mm_storel_epi64((__m128i *) (out + 8 * half), bytes);
+  }
+  return false;
+#else
+  for (int i= 0; i < 32; i++)
+  {
+    char c= hex[i];
+    uchar nibble;
+    if (c >= '0' && c <= '9')
+      nibble= c - '0';
+    else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+      nibble= (c | 0x20) - 'a' + 10;
+    else
+      return true;
+    if (i & 1)
+      out[i / 2]|= nibble;
+    else
+      out[i / 2]= nibble << 4;
+  }
+  return false;
+#endif
+}
+
+
+/**
+  Parse a UUID in text form.
+
+  @return the position after it, NULL on error
+*/
+static const char *parse_uuid(const char *p, uchar *sid)
+{
+  char hex[32];
+
+  /* The terminating null is reached before any dash is missing. */
+  for (size_t i= 0; i < UUID_TEXT_LEN; i++)
+  {
+    if (!p[i])
+      return NULL;
+  }
+  if (p[8] != '-' || p[13] != '-' || p[18] != '-' || p[23] != '-')
+    return NULL;
+  memcpy(hex, p, 8);
+  memcpy(hex + 8, p + 9, 4);
+  memcpy(hex + 12, p + 14, 4);
+  memcpy(hex + 16, p + 19, 4);
+  memcpy(hex + 20, p + 24, 12);
+  if (hex_to_bytes(hex, sid))
+    return NULL;
+  return p + UUID_TEXT_LEN;
+}
+
+
+/**
+  Parse a GNO, 1 to GNO_MAX.
+
+  @return the position after it, NULL on error
+*/
+static const char *parse_gno(const char *p, longlong *gno)
+{
+  ulonglong value= 0;
+  const char *start= p;
+
+  while (*p >= '0' && *p <= '9')
+  {
+    if (value > (ulonglong) GNO_MAX / 10)
+      return NULL;
+    value= value * 10 + (*p - '0');
+    p++;
+  }
+  if (p == start || value == 0 || value > (ulonglong) GNO_MAX)
+    return NULL;
+  *gno= (longlong) value;
+  return p;
+}
+
+
+bool gtid_text_parse(const char *text, Received_gtid_set *set)
+{
+  const char *p= skip_space(text);
+
+  while (*p)
+  {
+    uchar sid[RECEIVED_GTID_SID_LEN];
+    if (!(p= parse_uuid(p, sid)))
+      return true;
+    p= skip_space(p);
+
+    while (*p == ':')
+    {
+      longlong start, end;
+      if (!(p= parse_gno(skip_space(p + 1), &start)))
+        return true;
+      p= skip_space(p);
+      end= start;
+      if (*p == '-')
+      {
+        if (!(p= parse_gno(skip_space(p + 1), &end)) || end < start)
+          return true;
+        p= skip_space(p);
+      }
+      set->add_interval(sid, start, end + 1);
+    }
+
+    if (*p == ',')
+      p= skip_space(p + 1);
+    else if (*p)
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,38 @@
+/**
+  @file
+
+  @brief
+  Single pass parser for GTID sets in text form, as returned for
+  @@global.gtid_executed:
+
+    3E11FA47-71CA-11E1-9E33-C80AA9429562:1-5:11-18,
+    3E11FA47-71CA-11E1-9E33-C80AA9429563:1-27
+
+  The intervals go straight into a Received_gtid_set, which the caller
+  turns into a Gtid_set with one add_gtid_encoding(). That inserts every
+  SID into the Sid_map once and every interval in order, instead of the
+  per interval lookups of Gtid_set::add_gtid_text(), and the parsing
+  itself needs no lock.
+*/
+
+#ifndef MYSQL_GTID_TEXT_PARSER_H
+#define MYSQL_GTID_TEXT_PARSER_H
+
+#include "my_global.h"
+#include "received_gtid_set.h"
+
+/**
+  Parse a GTID set and add it to set.
+
+  Only the plain syntax is accepted, callers fall back to
+  Gtid_set::add_gtid_text() on error, which explains what is wrong.
+
+  @param text  the GTID set, may be empty
+  @param set   where the GTIDs go
+
+  @retval false  ok
+  @retval true   syntax error, set may hold part of the text
+*/
+bool gtid_text_parse(const char *text, Received_gtid_set *set);
+
+#endif //MYSQL_GTID_TEXT_PARSER_H
@@ -0,0 +1,203 @@
+/**
+  @file
+
+  @brief
+  Received GTID set, see received_gtid_set.h.
+*/
+
+#include "received_gtid_set.h"
+
+#include <algorithm>
+
+using std::vector;
+
+
+Received_gtid_set::Received_gtid_set()
+  : last_sid(0)
+{
+}
+
+
+/**
+  The intervals of a SID, added on first use. There are few SIDs, one
+  per master the cluster ever had, so a linear search is enough.
+*/
+Received_gtid_set::Sid_intervals *
+Received_gtid_set::find_sid(const uchar *sid)
+{
+  for (size_t i= 0; i < sids.size(); i++)
+  {
+    if (!memcmp(sids[i].sid, sid, RECEIVED_GTID_SID_LEN))
+    {
+      last_sid= i;
+      return &sids[i];
+    }
+  }
+  sids.push_back(Sid_intervals());
+  memcpy(sids.back().sid, sid, RECEIVED_GTID_SID_LEN);
+  last_sid= sids.size() - 1;
+  return &sids.back();
+}
+
+
+/**
+  Merge [start, end) into the intervals of a SID, joining the intervals
+  it overlaps or touches.
+*/
+void Received_gtid_set::add_slow(Sid_intervals *intervals, longlong start,
+                                 longlong end)
+{
+  vector<Interval> &list= intervals->intervals;
+
+  /* first interval that reaches start */
+  size_t lo= 0, hi= list.size();
+  while (lo < hi)
+  {
+    size_t mid= lo + (hi - lo) / 2;
+    if (list[mid].end < start)
+      lo= mid + 1;
+    else
+      hi= mid;
+  }
+  size_t first= lo;
+
+  /* first interval entirely after end */
+  hi= list.size();
+  while (lo < hi)
+  {
+    size_t mid= lo + (hi - lo) / 2;
+    if (list[mid].start <= end)
+      lo= mid + 1;
+    else
+      hi= mid;
+  }
+  size_t last= lo;
+
+  if (first == last)
+  {
+    Interval interval;
+    interval.start= start;
+    interval.end= end;
+    list.insert(list.begin() + first, interval);
+    return;
+  }
+  list[first].start= std::min(list[first].start, start);
+  list[first].end= std::max(list[last - 1].end, end);
+  list.erase(list.begin() + first + 1, list.begin() + last);
+}
+
+
+void Received_gtid_set::add_interval(const uchar *sid, longlong start,
+                                     longlong end)
+{
+  Sid_intervals *intervals= last_sid < sids.size() &&
+    !memcmp(sids[last_sid].sid, sid, RECEIVED_GTID_SID_LEN) ?
+    &sids[last_sid] : find_sid(sid);
+  vector<Interval> &list= intervals->intervals;
+
+  if (start >= end)
+    return;
+  if (list.empty() || start > list.back().end)
+  {
+    Interval interval;
+    interval.start= start;
+    interval.end= end;
+    list.push_back(interval);
+  }
+  else if (start >= list.back().start)
+    list.back().end= std::max(list.back().end, end);
+  else
+    add_slow(intervals, start, end);
+}
+
+
+bool Received_gtid_set::contains(const uchar *sid, longlong gno) const
+{
+  for (size_t i= 0; i < sids.size(); i++)
+  {
+    if (memcmp(sids[i].sid, sid, RECEIVED_GTID_SID_LEN))
+      continue;
+    const vector<Interval> &list= sids[i].intervals;
+    size_t lo= 0, hi= list.size();
+    while (lo < hi)
+    {
+      size_t mid= lo + (hi - lo) / 2;
+      if (list[mid].end <= gno)
+        lo= mid + 1;
+      else
+        hi= mid;
+    }
+    return lo < list.size() && list[lo].start <= gno;
+  }
+  return false;
+}
+
+
+bool Received_gtid_set::is_empty() const
+{
+  for (size_t i= 0; i < sids.size(); i++)
+  {
+    if (!sids[i].intervals.empty())
+      return false;
+  }
+  return true;
+}
+
+
+ulonglong Received_gtid_set::count() const
+{
+  ulonglong n= 0;
+  for (size_t i= 0; i < sids.size(); i++)
+  {
+    const vector<Interval> &list= sids[i].intervals;
+    for (size_t j= 0; j < list.size(); j++)
+      n+= (ulonglong) (list[j].end - list[j].start);
+  }
+  return n;
+}
+
+
+void Received_gtid_set::clear()
+{
+  sids.clear();
+  last_sid= 0;
+}
+
+
+size_t Received_gtid_set::get_encoded_length() const
+{
+  size_t len= 8;
+  for (size_t i= 0; i < sids.size(); i++)
+  {
+    if (!sids[i].intervals.empty())
+      len+= RECEIVED_GTID_SID_LEN + 8 + sids[i].intervals.size() * 16;
+  }
+  return len;
+}
+
+
+void Received_gtid_set::encode(uchar *buf) const
+{
+  uchar *n_sids_pos= buf;
+  ulonglong n_sids= 0;
+
+  buf+= 8;
+  for (size_t i= 0; i < sids.size(); i++)
+  {
+    const vector<Interval> &list= sids[i].intervals;
+    if (list.empty())
+      continue;
+    n_sids++;
+    memcpy(buf, sids[i].sid, RECEIVED_GTID_SID_LEN);
+    buf+= RECEIVED_GTID_SID_LEN;
+    int8store(buf, (ulonglong) list.size());
+    buf+= 8;
+    for (size_t j= 0; j < list.size(); j++)
+    {
+      int8store(buf, (ulonglong) list[j].start);
+      int8store(buf + 8, (ulonglong) list[j].end);
+      buf+= 16;
+    }
+  }
+  int8store(n_sids_pos, n_sids);
+}
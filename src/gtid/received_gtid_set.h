@@ -0,0 +1,102 @@
+/**
+  @file
+
+  @brief
+  The set of GTIDs received from the master, kept by the receive thread.
+
+  Gtid_set is built for many writers and arbitrary merges, adding a GTID
+  walks the interval list and takes the free intervals lock. The receive
+  thread is the only writer here and GTIDs almost always arrive in order,
+  so a GTID is normally added by extending the last interval of its SID.
+  Only gaps and out of order GTIDs go through a sorted insert.
+
+  The set is turned into a Gtid_set through its encoding, which is the
+  one COM_BINLOG_DUMP_GTID and Gtid_set::add_gtid_encoding() use.
+*/
+
+#ifndef MYSQL_RECEIVED_GTID_SET_H
+#define MYSQL_RECEIVED_GTID_SET_H
+
+#include "my_global.h"
+
+#include <vector>
+
+/** Bytes of a binary SID. */
+#define RECEIVED_GTID_SID_LEN 16
+
+class Received_gtid_set
+{
+public:
+  Received_gtid_set();
+
+  /**
+    Add a GTID.
+
+    @param sid  the 16 byte binary SID
+    @param gno  the GNO
+  */
+  void add(const uchar *sid, longlong gno)
+  {
+    Sid_intervals *intervals= last_sid < sids.size() &&
+      !memcmp(sids[last_sid].sid, sid, RECEIVED_GTID_SID_LEN) ?
+      &sids[last_sid] : find_sid(sid);
+
+    if (!intervals->intervals.empty() &&
+        intervals->intervals.back().end == gno)
+      intervals->intervals.back().end++;
+    else
+      add_slow(intervals, gno, gno + 1);
+  }
+
+  /**
+    Add the GNOs [start, end) of a SID, in O(1) when they come after
+    the last interval of the SID.
+  */
+  void add_interval(const uchar *sid, longlong start, longlong end);
+
+  /** true if the GTID is in the set. */
+  bool contains(const uchar *sid, longlong gno) const;
+
+  bool is_empty() const;
+
+  /** Number of GTIDs in the set. */
+  ulonglong count() const;
+
+  void clear();
+
+  /** Length of the encoding, see encode(). */
+  size_t get_encoded_length() const;
+
+  /**
+    Encode the set like Gtid_set::encode(): the number of SIDs, then for
+    each SID the SID, the number of intervals and the intervals, all
+    integers 8 bytes little endian.
+
+    @param buf  get_encoded_length() bytes
+  */
+  void encode(uchar *buf) const;
+
+private:
+  /** [start, end) like in Gtid_set. */
+  struct Interval
+  {
+    longlong start;
+    longlong end;
+  };
+
+  struct Sid_intervals
+  {
+    uchar sid[RECEIVED_GTID_SID_LEN];
+    /* sorted and disjoint, never adjacent */
+    std::vector<Interval> intervals;
+  };
+
+  Sid_intervals *find_sid(const uchar *sid);
+  void add_slow(Sid_intervals *intervals, longlong start, longlong end);
+
+  std::vector<Sid_intervals> sids;
+  /* the SID of the last add(), usually the one of the next */
+  size_t last_sid;
+};
+
+#endif //MYSQL_RECEIVED_GTID_SET_H
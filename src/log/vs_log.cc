@@ -30,6 +30,7 @@
 
 #include "vs_log.h"
 #include "mysqld_error.h"
+#include "my_atomic.h"
 
 //#include "sql_audit.h"    // mysql_audit_general_log
 //#include "sql_base.h"     // close_log_table
@@ -51,6 +52,8 @@
 #endif
 
 #include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
 
 
 using std::min;
@@ -75,6 +78,23 @@ static void ull2timeval(ulonglong utime, struct timeval *tv)
 }
 
 
+/* offset of the microseconds in a timestamp, after "YYYY-MM-DDTHH:MM:SS." */
+static const int iso8601_usec_offset= 20;
+
+/*
+  The last timestamp a thread made. Within the same second only its
+  microseconds change, so localtime_r() and the formatting are done once
+  a second per thread.
+*/
+struct Iso8601_cache
+{
+  time_t seconds;
+  int length;
+  char timestamp[iso8601_size];
+};
+static __thread Iso8601_cache iso8601_cache= { -1, 0, "" };
+
+
 /**
   Make and return an ISO 8601 / RFC 3339 compliant timestamp.
   Heeds log_timestamps.
@@ -92,6 +112,7 @@ static int make_iso8601_timestamp(char *buf, ulonglong utime= 0)
   char       tzinfo[7]="Z";  // max 6 chars plus \0
   size_t     len;
   time_t     seconds;
+  Iso8601_cache *cache= &iso8601_cache;
 
   if (utime == 0)
     utime= my_micro_time();
@@ -99,6 +120,17 @@ static int make_iso8601_timestamp(char *buf, ulonglong utime= 0)
   seconds= utime / 1000000;
   utime = utime % 1000000;
 
+  if (seconds == cache->seconds)
+  {
+    memcpy(buf, cache->timestamp, cache->length + 1);
+    for (int i= iso8601_usec_offset + 5; i >= iso8601_usec_offset; i--)
+    {
+      buf[i]= '0' + utime % 10;
+      utime/= 10;
+    }
+    return cache->length;
+  }
+
   {
     localtime_r(&seconds, &my_tm);
 
@@ -133,8 +165,16 @@ static int make_iso8601_timestamp(char *buf, ulonglong utime= 0)
                    my_tm.tm_sec,
                    (unsigned long) utime,
                    tzinfo);
+  len= min<int>(len, iso8601_size - 1);
 
-  return min<int>(len, iso8601_size - 1);
+  /* a year past 9999 would move the microseconds */
+  if (len > iso8601_usec_offset + 6 && buf[iso8601_usec_offset - 1] == '.')
+  {
+    cache->seconds= seconds;
+    cache->length= (int) len;
+    memcpy(cache->timestamp, buf, len + 1);
+  }
+  return (int) len;
 }
 
 
@@ -156,6 +196,238 @@ static bool error_log_buffering= true;
 static std::string *buffered_messages= NULL;
 
 
+////////////////////////////////////////////////////////////
+//
+// Asynchronous writer
+//
+////////////////////////////////////////////////////////////
+
+/*
+  Once the error log is open, messages are formatted by the calling
+  thread into a slot of a bounded queue and written to the file by a
+  background thread, several at a time, under mutex_error_log like the
+  lines callers write themselves. Callers take no lock: a slot is
+  claimed with a compare and swap on the tail (a bounded MPSC queue,
+  each slot carries the sequence number it is ready for). When the
+  queue is full the message is dropped and counted, the writer reports
+  the count in the log. An ERROR waits until it has been written, so it
+  is in the file if the process dies right after.
+*/
+
+/* number of slots, a power of 2 */
+static const int64 LOG_QUEUE_SIZE= 1024;
+/* a formatted line: timestamp, thread id, level, message and newline */
+static const size_t LOG_LINE_SIZE= MAX_LOG_BUFFER_SIZE + 64;
+/* how long the writer sleeps when the queue is empty */
+static const long LOG_WRITER_IDLE_MS= 10;
+
+struct Log_slot
+{
+  /* pos when the slot can be filled, pos + 1 once filled */
+  volatile int64 seq;
+  size_t length;
+  char line[LOG_LINE_SIZE];
+};
+
+static Log_slot *log_queue= NULL;
+/* next position to claim, shared by the callers */
+static volatile int64 log_queue_tail= 0;
+/* next position to write, only moved by the writer */
+static volatile int64 log_queue_head= 0;
+static volatile int64 log_messages_dropped= 0;
+static volatile int32 log_writer_running= 0;
+static bool log_writer_stop= false;
+static pthread_t log_writer_thread;
+/* wakes the writer for a flush, and the callers waiting for one */
+static pthread_mutex_t log_writer_lock;
+static pthread_cond_t log_writer_wakeup;
+static pthread_cond_t log_writer_written;
+
+
+/**
+  Claim a slot and copy a line into it.
+
+  @return position of the line, -1 if the queue is full
+*/
+static int64 log_queue_push(const char *line, size_t length)
+{
+  int64 pos= my_atomic_load64(&log_queue_tail);
+  Log_slot *slot;
+
+  for (;;)
+  {
+    slot= &log_queue[pos & (LOG_QUEUE_SIZE - 1)];
+    int64 diff= my_atomic_load64(&slot->seq) - pos;
+    if (diff == 0)
+    {
+      if (my_atomic_cas64(&log_queue_tail, &pos, pos + 1))
+        break;
+    }
+    else if (diff < 0)
+      return -1;
+    else
+      pos= my_atomic_load64(&log_queue_tail);
+  }
+
+  memcpy(slot->line, line, length);
+  slot->length= length;
+  my_atomic_store64(&slot->seq, pos + 1);
+  return pos;
+}
+
+
+/**
+  Write the lines queued so far, several per write. Only the writer
+  calls this, or the thread that stopped it.
+
+  @return true if there was anything to write
+*/
+static bool log_queue_drain()
+{
+  static char batch[64 * 1024];
+  static int64 dropped_reported= 0;
+  int64 head= my_atomic_load64(&log_queue_head);
+  int64 start= head;
+  size_t batch_len= 0;
+  bool wrote= false;
+
+  int64 dropped= my_atomic_load64(&log_messages_dropped);
+  if (dropped != dropped_reported)
+  {
+    char timestamp[iso8601_size];
+    make_iso8601_timestamp(timestamp);
+    batch_len= my_snprintf(batch, LOG_LINE_SIZE,
+                           "%s 0 [Warning] %lld log messages dropped, "
+                           "the log queue was full\n", timestamp,
+                           (long long) (dropped - dropped_reported));
+    dropped_reported= dropped;
+  }
+
+  for (;;)
+  {
+    Log_slot *slot= &log_queue[head & (LOG_QUEUE_SIZE - 1)];
+    bool ready= my_atomic_load64(&slot->seq) == head + 1;
+    if (!ready || batch_len + slot->length > sizeof(batch))
+    {
+      if (batch_len)
+      {
+        /* lines written by callers themselves, or a reopen, wait */
+        if (error_log_initialized)
+          pthread_mutex_lock(&mutex_error_log);
+        fwrite(batch, 1, batch_len, stderr);
+        if (error_log_initialized)
+          pthread_mutex_unlock(&mutex_error_log);
+        batch_len= 0;
+        wrote= true;
+      }
+      /* free the written slots for the callers */
+      for (; start < head; start++)
+        my_atomic_store64(&log_queue[start & (LOG_QUEUE_SIZE - 1)].seq,
+                          start + LOG_QUEUE_SIZE);
+      my_atomic_store64(&log_queue_head, head);
+      if (!ready)
+        break;
+    }
+    memcpy(batch + batch_len, slot->line, slot->length);
+    batch_len+= slot->length;
+    head++;
+  }
+  return wrote;
+}
+
+
+static void *log_writer(void *)
+{
+  pthread_mutex_lock(&log_writer_lock);
+  for (;;)
+  {
+    pthread_mutex_unlock(&log_writer_lock);
+    bool wrote= log_queue_drain();
+    pthread_mutex_lock(&log_writer_lock);
+    pthread_cond_broadcast(&log_writer_written);
+    if (log_writer_stop)
+      break;
+    /* more may have come in while writing */
+    if (wrote)
+      continue;
+
+    struct timeval now;
+    struct timespec deadline;
+    gettimeofday(&now, NULL);
+    long nsec= now.tv_usec * 1000L + LOG_WRITER_IDLE_MS * 1000000L;
+    deadline.tv_sec= now.tv_sec + nsec / 1000000000L;
+    deadline.tv_nsec= nsec % 1000000000L;
+    pthread_cond_timedwait(&log_writer_wakeup, &log_writer_lock, &deadline);
+  }
+  pthread_mutex_unlock(&log_writer_lock);
+  /* lines queued while stopping */
+  log_queue_drain();
+  return NULL;
+}
+
+
+/**
+  Wait until the line at pos, and all before it, are written.
+*/
+static void log_writer_flush(int64 pos)
+{
+  pthread_mutex_lock(&log_writer_lock);
+  pthread_cond_signal(&log_writer_wakeup);
+  while (my_atomic_load64(&log_queue_head) <= pos &&
+         my_atomic_load32(&log_writer_running))
+    pthread_cond_wait(&log_writer_written, &log_writer_lock);
+  pthread_mutex_unlock(&log_writer_lock);
+}
+
+
+static void stop_log_writer()
+{
+  if (!my_atomic_load32(&log_writer_running))
+    return;
+  pthread_mutex_lock(&log_writer_lock);
+  log_writer_stop= true;
+  pthread_cond_signal(&log_writer_wakeup);
+  pthread_mutex_unlock(&log_writer_lock);
+  pthread_join(log_writer_thread, NULL);
+  /* from here on callers write themselves again */
+  my_atomic_store32(&log_writer_running, 0);
+  log_queue_drain();
+  pthread_mutex_lock(&log_writer_lock);
+  pthread_cond_broadcast(&log_writer_written);
+  pthread_mutex_unlock(&log_writer_lock);
+}
+
+
+/**
+  Start the writer, the first time the log is opened. It is stopped, and
+  the queue written out, by destroy_error_log() or at exit.
+*/
+static void start_log_writer()
+{
+  if (log_queue)
+    return;
+  log_queue= (Log_slot *) my_malloc(PSI_NOT_INSTRUMENTED,
+                                    LOG_QUEUE_SIZE * sizeof(Log_slot), MYF(0));
+  if (!log_queue)
+    return;
+  for (int64 i= 0; i < LOG_QUEUE_SIZE; i++)
+    log_queue[i].seq= i;
+  pthread_mutex_init(&log_writer_lock, NULL);
+  pthread_cond_init(&log_writer_wakeup, NULL);
+  pthread_cond_init(&log_writer_written, NULL);
+  if (pthread_create(&log_writer_thread, NULL, log_writer, NULL))
+    return;
+  my_atomic_store32(&log_writer_running, 1);
+  atexit(stop_log_writer);
+}
+
+
+ulonglong error_log_dropped()
+{
+  return (ulonglong) my_atomic_load64(&log_messages_dropped);
+}
+
+
 void flush_error_log_messages()
 {
   if (buffered_messages && !buffered_messages->empty())
@@ -206,6 +478,7 @@ bool open_error_log(const char *filename)
 
   // Write any messages buffered while we were figuring out the filename
   flush_error_log_messages();
+  start_log_writer();
   return false;
 }
 
@@ -216,6 +489,7 @@ void destroy_error_log()
   DBUG_ASSERT(!error_log_buffering);
   // ... but play it safe on release builds
   flush_error_log_messages();
+  stop_log_writer();
   if (error_log_initialized)
   {
     error_log_initialized= false;
@@ -254,6 +528,28 @@ static void print_buffer_to_file(enum loglevel level, const char *buffer,
   */
   make_iso8601_timestamp(my_timestamp);
 
+  if (my_atomic_load32(&log_writer_running))
+  {
+    char line[LOG_LINE_SIZE];
+    size_t line_len= my_snprintf(line, sizeof(line), "%s %u [%s] %.*s\n",
+                                 my_timestamp, thread_id,
+                                 (level == ERROR_LEVEL ? "ERROR" :
+                                  level == WARNING_LEVEL ? "Warning" : "Note"),
+                                 (int) length, buffer);
+    int64 pos= log_queue_push(line, line_len);
+    if (pos < 0 && level == ERROR_LEVEL)
+    {
+      /* errors are not dropped, wait for the queue to be written once */
+      log_writer_flush(my_atomic_load64(&log_queue_tail) - 1);
+      pos= log_queue_push(line, line_len);
+    }
+    if (pos < 0)
+      my_atomic_add64(&log_messages_dropped, 1);
+    else if (level == ERROR_LEVEL)
+      log_writer_flush(pos);
+    DBUG_VOID_RETURN;
+  }
+
   /*
     This must work even if the mutex has not been initialized yet.
     At that point we should still be single threaded so that it is
@@ -84,6 +84,12 @@ bool open_error_log(const char *filename);
 */
 void destroy_error_log();
 
+/**
+  Number of messages dropped because the queue of the log writer was
+  full, they are counted in the log itself as well.
+*/
+ulonglong error_log_dropped();
+
 /**
   Flush any pending data to disk and reopen the error log.
 */
@@ -0,0 +1,268 @@
+/**
+  @file
+
+  @brief
+  Master candidates and reconnect backoff, see master_reconnect.h.
+*/
+
+#include "master_reconnect.h"
+#include "gtid/gtid_text_parser.h"
+#include "log/vs_log.h"
+#include "my_sys.h"
+#include "mysql.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/* first delay of the backoff */
+static const ulong BACKOFF_BASE_MS= 100;
+
+static vector<Master_address> configured_candidates;
+static string candidates_file;
+static uint32 backoff_seed= 2463534242U;
+
+struct Master_probe
+{
+  Master_address address;
+  const char *user;
+  const char *password;
+  uint timeout;
+  pthread_t thread;
+  bool started;
+  /* results */
+  bool answered;
+  bool writable;
+  ulonglong gtid_count;
+};
+
+
+/**
+  Parse "host:port", surrounding whitespace allowed.
+
+  @retval false  ok
+  @retval true   malformed
+*/
+static bool parse_address(string entry, Master_address *address)
+{
+  size_t begin= entry.find_first_not_of(" \t\r\n");
+  size_t end= entry.find_last_not_of(" \t\r\n");
+  if (begin == string::npos)
+    return true;
+  entry= entry.substr(begin, end - begin + 1);
+
+  size_t colon= entry.rfind(':');
+  if (colon == string::npos || colon == 0 || colon > MASTER_HOST_MAX ||
+      colon + 1 == entry.size())
+    return true;
+  char *port_end;
+  ulong port= strtoul(entry.c_str() + colon + 1, &port_end, 10);
+  if (*port_end || port == 0 || port > 65535)
+    return true;
+
+  memcpy(address->host, entry.data(), colon);
+  address->host[colon]= 0;
+  address->port= (uint) port;
+  return false;
+}
+
+
+static void add_candidate(vector<Master_address> *candidates,
+                          const Master_address &address)
+{
+  for (size_t i= 0; i < candidates->size(); i++)
+  {
+    if ((*candidates)[i].port == address.port &&
+        !strcmp((*candidates)[i].host, address.host))
+      return;
+  }
+  candidates->push_back(address);
+}
+
+
+bool master_reconnect_init(const char *host, uint port, const char *list,
+                           const char *file)
+{
+  Master_address address;
+
+  configured_candidates.clear();
+  if (host && *host)
+  {
+    strncpy(address.host, host, MASTER_HOST_MAX);
+    address.host[MASTER_HOST_MAX]= 0;
+    address.port= port;
+    add_candidate(&configured_candidates, address);
+  }
+
+  string entries(list ? list : "");
+  size_t pos= 0;
+  while (pos <= entries.size())
+  {
+    size_t comma= entries.find(',', pos);
+    if (comma == string::npos)
+      comma= entries.size();
+    string entry= entries.substr(pos, comma - pos);
+    if (entry.find_first_not_of(" \t") != string::npos)
+    {
+      if (parse_address(entry, &address))
+      {
+        sql_print_error("Bad master candidate '%s', expected host:port",
+                        entry.c_str());
+        return true;
+      }
+      add_candidate(&configured_candidates, address);
+    }
+    pos= comma + 1;
+  }
+
+  candidates_file= file ? file : "";
+  /* xorshift needs a seed other than 0 */
+  backoff_seed= ((uint32) my_micro_time() ^ (uint32) getpid()) | 1;
+  return false;
+}
+
+
+bool master_reconnect_has_candidates()
+{
+  return configured_candidates.size() > 1 || !candidates_file.empty();
+}
+
+
+/**
+  The configured candidates and those of the file, as it is now. Bad
+  lines of the file are skipped with a warning, the HA tool may be in the
+  middle of writing it.
+*/
+static vector<Master_address> current_candidates()
+{
+  vector<Master_address> candidates= configured_candidates;
+  if (candidates_file.empty())
+    return candidates;
+
+  std::ifstream in(candidates_file.c_str());
+  string line;
+  while (std::getline(in, line))
+  {
+    Master_address address;
+    size_t first= line.find_first_not_of(" \t\r");
+    if (first == string::npos || line[first] == '#')
+      continue;
+    if (parse_address(line, &address))
+    {
+      sql_print_warning("Skipping bad line '%s' of %s", line.c_str(),
+                        candidates_file.c_str());
+      continue;
+    }
+    add_candidate(&candidates, address);
+  }
+  return candidates;
+}
+
+
+static void *probe_thread(void *arg)
+{
+  Master_probe *probe= (Master_probe *) arg;
+  const char *query= "SELECT @@global.read_only, @@global.gtid_executed";
+  MYSQL *mysql;
+
+  mysql_thread_init();
+  if (!(mysql= mysql_init(NULL)))
+  {
+    mysql_thread_end();
+    return NULL;
+  }
+  mysql_options(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &probe->timeout);
+  mysql_options(mysql, MYSQL_OPT_READ_TIMEOUT, &probe->timeout);
+  mysql_options(mysql, MYSQL_OPT_WRITE_TIMEOUT, &probe->timeout);
+
+  if (mysql_real_connect(mysql, probe->address.host, probe->user,
+                         probe->password, 0, probe->address.port, NULL, 0) &&
+      !mysql_real_query(mysql, query, (ulong) strlen(query)))
+  {
+    MYSQL_RES *res= mysql_store_result(mysql);
+    MYSQL_ROW row= res ? mysql_fetch_row(res) : NULL;
+    if (row && row[0])
+    {
+      Received_gtid_set executed;
+      probe->answered= true;
+      probe->writable= !atoi(row[0]);
+      if (row[1] && !gtid_text_parse(row[1], &executed))
+        probe->gtid_count= executed.count();
+    }
+    mysql_free_result(res);
+  }
+  if (!probe->answered)
+    sql_print_warning("Master candidate %s:%u: %s", probe->address.host,
+                      probe->address.port, mysql_error(mysql));
+
+  mysql_close(mysql);
+  mysql_thread_end();
+  return NULL;
+}
+
+
+bool master_reconnect_choose(const char *user, const char *password,
+                             uint connect_timeout, Master_address *chosen)
+{
+  vector<Master_address> candidates= current_candidates();
+  vector<Master_probe> probes(candidates.size());
+  Master_probe *best= NULL;
+
+  for (size_t i= 0; i < probes.size(); i++)
+  {
+    Master_probe &probe= probes[i];
+    probe.address= candidates[i];
+    probe.user= user;
+    probe.password= password;
+    probe.timeout= connect_timeout;
+    probe.answered= false;
+    probe.writable= false;
+    probe.gtid_count= 0;
+    probe.started= !pthread_create(&probe.thread, NULL, probe_thread, &probe);
+    if (!probe.started)
+      probe_thread(&probe);
+  }
+
+  for (size_t i= 0; i < probes.size(); i++)
+  {
+    Master_probe &probe= probes[i];
+    if (probe.started)
+      pthread_join(probe.thread, NULL);
+    /* ties go to the earlier candidate, the configured master first */
+    if (probe.answered && probe.writable &&
+        (!best || probe.gtid_count > best->gtid_count))
+      best= &probe;
+  }
+
+  if (!best)
+    return true;
+  *chosen= best->address;
+  sql_print_information("Chose master %s:%u, %llu GTIDs executed, "
+                        "out of %u candidates", chosen->host, chosen->port,
+                        best->gtid_count, (uint) probes.size());
+  return false;
+}
+
+
+ulong master_reconnect_backoff_ms(uint attempt, ulong max_ms)
+{
+  ulong delay= BACKOFF_BASE_MS;
+  while (attempt-- && delay < max_ms)
+    delay*= 2;
+  delay= std::min(delay, max_ms);
+
+  /* xorshift, only the receive thread calls this */
+  backoff_seed^= backoff_seed << 13;
+  backoff_seed^= backoff_seed >> 17;
+  backoff_seed^= backoff_seed << 5;
+  /* full jitter: attempts of the fleet spread over the whole delay */
+  return backoff_seed % (delay + 1);
+}
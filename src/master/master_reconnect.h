@@ -0,0 +1,75 @@
+/**
+  @file
+
+  @brief
+  Reconnecting the receive thread: which master, and when.
+
+  Besides the configured master, candidates come from the
+  master_candidates list and from master_candidates_file, one host:port
+  per line, which the HA tool may rewrite at any time. The file is read
+  again on every reconnect. All candidates are probed at once, each from
+  its own thread, for server_uuid, read_only and gtid_executed, and the
+  writable one with the most GTIDs is chosen.
+
+  Failed attempts are spaced by an exponential backoff with jitter, so a
+  fleet of virtual slaves does not hammer a master that just came back.
+*/
+
+#ifndef MYSQL_MASTER_RECONNECT_H
+#define MYSQL_MASTER_RECONNECT_H
+
+#include "my_global.h"
+
+/** Longest host name accepted for a candidate. */
+#define MASTER_HOST_MAX 255
+
+struct Master_address
+{
+  char host[MASTER_HOST_MAX + 1];
+  uint port;
+};
+
+/**
+  Set the candidates.
+
+  @param host  the configured master, always a candidate
+  @param port  its port
+  @param list  "host:port,host:port", may be empty
+  @param file  file with one host:port per line, may be empty
+
+  @retval false  ok
+  @retval true   a malformed entry in list, logged
+*/
+bool master_reconnect_init(const char *host, uint port, const char *list,
+                           const char *file);
+
+/** true if there is more than the configured master to choose from. */
+bool master_reconnect_has_candidates();
+
+/**
+  Probe all candidates in parallel and pick the writable one with the
+  largest gtid_executed.
+
+  @param user             user for the probes
+  @param password         its password
+  @param connect_timeout  seconds, for the connect and the query
+  @param[out] chosen      the master to connect to
+
+  @retval false  chosen is set
+  @retval true   no writable candidate answered
+*/
+bool master_reconnect_choose(const char *user, const char *password,
+                             uint connect_timeout, Master_address *chosen);
+
+/**
+  Delay before the next connection attempt.
+
+  @param attempt  failed attempts so far, from 0
+  @param max_ms   upper bound of the delay
+
+  @return a delay in milliseconds, between 0 and
+          min(max_ms, 100 * 2^attempt)
+*/
+ulong master_reconnect_backoff_ms(uint attempt, ulong max_ms);
+
+#endif //MYSQL_MASTER_RECONNECT_H
@@ -0,0 +1,166 @@
+/**
+  @file
+
+  @brief
+  Low latency settings, see master_tuning.h.
+*/
+
+#include "master_tuning.h"
+#include "log/vs_log.h"
+#include "violite.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <string>
+
+using std::string;
+
+static bool tuning_low_latency= false;
+static uint tuning_rcvbuf_kb= 0;
+static uint tuning_sndbuf_kb= 0;
+static uint tuning_busy_poll_usec= 0;
+#ifdef __linux__
+static cpu_set_t tuning_cpus;
+#endif
+static bool tuning_pin= false;
+
+
+/**
+  Parse "2", "2,3" or "0-3,6" into a CPU set.
+
+  @retval false  ok
+  @retval true   malformed or a CPU out of range
+*/
+static bool parse_cpus(const char *cpus)
+{
+#ifdef __linux__
+  string list(cpus);
+  size_t pos= 0;
+
+  CPU_ZERO(&tuning_cpus);
+  while (pos < list.size())
+  {
+    size_t comma= list.find(',', pos);
+    if (comma == string::npos)
+      comma= list.size();
+    string range= list.substr(pos, comma - pos);
+    char *end;
+    long first= strtol(range.c_str(), &end, 10);
+    long last= first;
+    if (end == range.c_str())
+      return true;
+    if (*end == '-')
+    {
+      const char *second= end + 1;
+      last= strtol(second, &end, 10);
+      if (end == second)
+        return true;
+    }
+    if (*end || first < 0 || last < first || last >= CPU_SETSIZE)
+      return true;
+    for (long cpu= first; cpu <= last; cpu++)
+      CPU_SET(cpu, &tuning_cpus);
+    pos= comma + 1;
+  }
+  return CPU_COUNT(&tuning_cpus) == 0;
+#else
+  return true;
+#endif
+}
+
+
+bool master_tuning_init(bool low_latency, uint rcvbuf_kb, uint sndbuf_kb,
+                        uint busy_poll_usec, const char *cpus)
+{
+  tuning_low_latency= low_latency;
+  tuning_rcvbuf_kb= rcvbuf_kb;
+  tuning_sndbuf_kb= sndbuf_kb;
+  tuning_busy_poll_usec= busy_poll_usec;
+  tuning_pin= cpus && *cpus;
+  if (tuning_pin && parse_cpus(cpus))
+  {
+    sql_print_error("Bad receive_thread_cpus '%s', expected a list like "
+                    "2,3 or 2-3", cpus);
+    return true;
+  }
+  return false;
+}
+
+
+static void set_option(int fd, int level, int name, int value,
+                       const char *option)
+{
+  if (setsockopt(fd, level, name, &value, sizeof(value)))
+    sql_print_warning("Could not set %s on the master connection, errno %d",
+                      option, errno);
+}
+
+
+void master_tuning_apply(MYSQL *mysql)
+{
+  int fd= vio_fd(mysql->net.vio);
+  struct sockaddr_storage addr;
+  socklen_t addr_len= sizeof(addr);
+
+  if (tuning_rcvbuf_kb)
+    set_option(fd, SOL_SOCKET, SO_RCVBUF, (int) tuning_rcvbuf_kb << 10,
+               "SO_RCVBUF");
+  if (tuning_sndbuf_kb)
+    set_option(fd, SOL_SOCKET, SO_SNDBUF, (int) tuning_sndbuf_kb << 10,
+               "SO_SNDBUF");
+#ifdef SO_BUSY_POLL
+  if (tuning_busy_poll_usec)
+    set_option(fd, SOL_SOCKET, SO_BUSY_POLL, (int) tuning_busy_poll_usec,
+               "SO_BUSY_POLL");
+#endif
+
+  /* the TCP options mean nothing on a Unix socket */
+  if (!tuning_low_latency ||
+      getsockname(fd, (struct sockaddr *) &addr, &addr_len) ||
+      (addr.ss_family != AF_INET && addr.ss_family != AF_INET6))
+    return;
+  set_option(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+#ifdef TCP_QUICKACK
+  set_option(fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+#endif
+}
+
+
+void master_tuning_quickack(MYSQL *mysql)
+{
+#ifdef TCP_QUICKACK
+  if (!tuning_low_latency)
+    return;
+  int one= 1;
+  /* errors were logged once by master_tuning_apply() */
+  setsockopt(vio_fd(mysql->net.vio), IPPROTO_TCP, TCP_QUICKACK, &one,
+             sizeof(one));
+#endif
+}
+
+
+bool master_tuning_pin_thread()
+{
+  if (!tuning_pin)
+    return false;
+#ifdef __linux__
+  int err= pthread_setaffinity_np(pthread_self(), sizeof(tuning_cpus),
+                                  &tuning_cpus);
+  if (err)
+  {
+    sql_print_error("Could not pin the receive thread, error %d", err);
+    return true;
+  }
+  sql_print_information("Receive thread pinned to %d CPUs",
+                        CPU_COUNT(&tuning_cpus));
+  return false;
+#else
+  sql_print_error("receive_thread_cpus is only supported on Linux");
+  return true;
+#endif
+}
@@ -0,0 +1,60 @@
+/**
+  @file
+
+  @brief
+  Low latency settings of the connection to the master and of the
+  receive thread.
+
+  With master_low_latency the socket gets TCP_NODELAY, so an ACK is not
+  held back by Nagle behind the previous one, and TCP_QUICKACK, which
+  the kernel clears on its own and is set again after every read, so
+  the master is not kept waiting for delayed ACKs of the TCP layer.
+  The socket buffers and SO_BUSY_POLL can be set on their own. The
+  buffers are set once connected, their maximum window scale was agreed
+  at connect from the system defaults (net.ipv4.tcp_rmem).
+
+  The receive thread can be pinned to CPUs, to keep its caches warm and
+  away from the threads of the binlog server.
+*/
+
+#ifndef MYSQL_MASTER_TUNING_H
+#define MYSQL_MASTER_TUNING_H
+
+#include "my_global.h"
+#include "mysql.h"
+
+/**
+  Set the options applied to every connection.
+
+  @param low_latency     TCP_NODELAY and TCP_QUICKACK
+  @param rcvbuf_kb       SO_RCVBUF, 0 leaves the default
+  @param sndbuf_kb       SO_SNDBUF, 0 leaves the default
+  @param busy_poll_usec  SO_BUSY_POLL, 0 leaves it off
+  @param cpus            CPUs of the receive thread, "2", "2,3" or "2-3",
+                         empty for all
+
+  @retval false  ok
+  @retval true   malformed cpus, logged
+*/
+bool master_tuning_init(bool low_latency, uint rcvbuf_kb, uint sndbuf_kb,
+                        uint busy_poll_usec, const char *cpus);
+
+/**
+  Apply the socket options to a new connection to the master. Options
+  the system refuses are logged and left out, the connection works
+  without them.
+*/
+void master_tuning_apply(MYSQL *mysql);
+
+/** Set TCP_QUICKACK again after a read, if low latency is on. */
+void master_tuning_quickack(MYSQL *mysql);
+
+/**
+  Pin the calling thread, the receive thread, to the configured CPUs.
+
+  @retval false  pinned, or no CPUs configured
+  @retval true   failure, logged
+*/
+bool master_tuning_pin_thread();
+
+#endif //MYSQL_MASTER_TUNING_H
@@ -0,0 +1,532 @@
+/**
+  @file
+
+  @brief
+  Catching up from a peer, see peer_catchup.h.
+*/
+
+#include "peer_catchup.h"
+#include "binlog/binlog_checksum.h"
+#include "binlog/binlog_file.h"
+#include "gtid/gtid_index.h"
+#include "log/vs_log.h"
+#include "my_sys.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using std::min;
+using std::string;
+using std::vector;
+
+/* a peer that sends nothing for this long is given up */
+static const int PEER_TIMEOUT= 60;
+/* receive buffer, also the most bytes written to a binlog at once */
+static const size_t PEER_CHUNK= 1024 * 1024;
+/* longest line of a LIST answer, a line holds two GTID sets */
+static const size_t PEER_LINE_MAX= 64 * 1024 * 1024;
+/* suffix of a binlog being fetched */
+static const char PEER_TMP_EXT[]= ".peer";
+
+struct Peer_binlog
+{
+  Gtid_index_binlog gtids;
+  my_off_t size;
+};
+
+/** A request to the peer and its answer, buffered. */
+struct Peer_connection
+{
+  int fd;
+  uchar *buf;
+  size_t pos;
+  size_t end;
+};
+
+
+/**
+  Connect to the peer and send a request line.
+
+  @retval false  ok
+  @retval true   failure, logged
+*/
+static bool peer_request(const char *peer, const string &request,
+                         Peer_connection *conn)
+{
+  string address(peer);
+  size_t colon= address.rfind(':');
+  struct addrinfo hints, *addrs= NULL;
+
+  conn->fd= -1;
+  conn->pos= conn->end= 0;
+  if (colon == string::npos || colon == 0 || colon + 1 == address.size())
+  {
+    sql_print_error("Peer catch-up: catchup_peer '%s' is not host:port", peer);
+    return true;
+  }
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family= AF_UNSPEC;
+  hints.ai_socktype= SOCK_STREAM;
+  int err= getaddrinfo(address.substr(0, colon).c_str(),
+                       address.c_str() + colon + 1, &hints, &addrs);
+  if (err)
+  {
+    sql_print_error("Peer catch-up: could not resolve %s: %s", peer,
+                    gai_strerror(err));
+    return true;
+  }
+  for (struct addrinfo *ai= addrs; ai && conn->fd < 0; ai= ai->ai_next)
+  {
+    if ((conn->fd= socket(ai->ai_family, ai->ai_socktype,
+                          ai->ai_protocol)) < 0)
+      continue;
+    if (connect(conn->fd, ai->ai_addr, ai->ai_addrlen))
+    {
+      close(conn->fd);
+      conn->fd= -1;
+    }
+  }
+  freeaddrinfo(addrs);
+  if (conn->fd < 0)
+  {
+    sql_print_error("Peer catch-up: could not connect to %s, errno %d", peer,
+                    errno);
+    return true;
+  }
+
+  struct timeval timeout;
+  timeout.tv_sec= PEER_TIMEOUT;
+  timeout.tv_usec= 0;
+  setsockopt(conn->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  string line= request + "\n";
+  const char *ptr= line.data();
+  size_t len= line.size();
+  while (len)
+  {
+    ssize_t sent= send(conn->fd, ptr, len, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+    {
+      sql_print_error("Peer catch-up: could not send '%s' to %s, errno %d",
+                      request.c_str(), peer, errno);
+      close(conn->fd);
+      conn->fd= -1;
+      return true;
+    }
+    ptr+= sent;
+    len-= sent;
+  }
+  return false;
+}
+
+
+static void peer_close(Peer_connection *conn)
+{
+  if (conn->fd >= 0)
+    close(conn->fd);
+  conn->fd= -1;
+}
+
+
+/**
+  Receive more of the answer after what is buffered.
+
+  @retval false  some bytes arrived
+  @retval true   the peer closed the connection, timed out or failed
+*/
+static bool peer_fill(Peer_connection *conn)
+{
+  if (conn->pos == conn->end)
+    conn->pos= conn->end= 0;
+  else if (conn->end == PEER_CHUNK)
+  {
+    memmove(conn->buf, conn->buf + conn->pos, conn->end - conn->pos);
+    conn->end-= conn->pos;
+    conn->pos= 0;
+  }
+  for (;;)
+  {
+    ssize_t got= recv(conn->fd, conn->buf + conn->end,
+                      PEER_CHUNK - conn->end, 0);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return true;
+    conn->end+= got;
+    return false;
+  }
+}
+
+
+/**
+  Read a line of the answer, without its newline.
+
+  @retval false  ok
+  @retval true   the connection ended first or the line is too long
+*/
+static bool peer_read_line(Peer_connection *conn, string *line)
+{
+  line->clear();
+  for (;;)
+  {
+    uchar *start= conn->buf + conn->pos;
+    uchar *newline= (uchar *) memchr(start, '\n', conn->end - conn->pos);
+    if (newline)
+    {
+      line->append((const char *) start, newline - start);
+      conn->pos+= newline - start + 1;
+      return false;
+    }
+    /* keep the buffer for the rest, lines may be longer than it */
+    line->append((const char *) start, conn->end - conn->pos);
+    conn->pos= conn->end;
+    if (line->size() > PEER_LINE_MAX || peer_fill(conn))
+      return true;
+  }
+}
+
+
+/**
+  Read the first line of an answer, "OK[ ...]" or "ERR <reason>".
+
+  @param[out] rest  what follows "OK "
+
+  @retval false  OK
+  @retval true   an error answer or no answer, logged
+*/
+static bool peer_read_status(Peer_connection *conn, const char *peer,
+                             const char *request, string *rest)
+{
+  string line;
+  if (peer_read_line(conn, &line))
+  {
+    sql_print_error("Peer catch-up: no answer from %s to %s", peer, request);
+    return true;
+  }
+  if (line.compare(0, 2, "OK") || (line.size() > 2 && line[2] != ' '))
+  {
+    sql_print_error("Peer catch-up: %s refused %s: %s", peer, request,
+                    line.c_str());
+    return true;
+  }
+  rest->assign(line, min(line.size(), (size_t) 3), string::npos);
+  return false;
+}
+
+
+/**
+  Ask the peer for its closed binlogs.
+
+  @param[out] binlogs  the closed binlogs, in order
+  @param[out] next     the binlog after the last one, "" if none
+
+  @retval false  ok
+  @retval true   failure, logged
+*/
+static bool peer_list(const char *peer, Peer_connection *conn,
+                      vector<Peer_binlog> *binlogs, string *next)
+{
+  string line;
+  bool failed= true;
+
+  if (peer_request(peer, "LIST", conn))
+    return true;
+  if (peer_read_status(conn, peer, "LIST", &line))
+    goto end;
+  while (!peer_read_line(conn, &line))
+  {
+    if (!line.compare(0, 3, "END"))
+    {
+      next->assign(line, min(line.size(), (size_t) 4), string::npos);
+      failed= false;
+      goto end;
+    }
+    size_t tab1= line.find('\t');
+    size_t tab2= tab1 == string::npos ? tab1 : line.find('\t', tab1 + 1);
+    size_t tab3= tab2 == string::npos ? tab2 : line.find('\t', tab2 + 1);
+    char *size_end;
+    Peer_binlog binlog;
+    if (tab3 == string::npos)
+      break;
+    binlog.gtids.log_name= line.substr(0, tab1);
+    binlog.size= strtoull(line.c_str() + tab1 + 1, &size_end, 10);
+    binlog.gtids.previous_gtids= line.substr(tab2 + 1, tab3 - tab2 - 1);
+    binlog.gtids.added_gtids= line.substr(tab3 + 1);
+    if (size_end != line.c_str() + tab2 || binlog.gtids.log_name.empty() ||
+        binlog.gtids.log_name.size() > FN_REFLEN ||
+        binlog.gtids.log_name.find('/') != string::npos)
+      break;
+    binlogs->push_back(binlog);
+  }
+  sql_print_error("Peer catch-up: malformed or cut LIST answer from %s", peer);
+
+end:
+  peer_close(conn);
+  return failed;
+}
+
+
+static bool write_all(int fd, const uchar *buf, size_t len)
+{
+  while (len)
+  {
+    ssize_t written= write(fd, buf, len);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return true;
+    buf+= written;
+    len-= written;
+  }
+  return false;
+}
+
+
+/**
+  Fetch a binlog to file_name, checking its size and CRC32.
+
+  @retval false  ok, synced to disk
+  @retval true   failure, logged, file_name may be left behind
+*/
+static bool peer_fetch(const char *peer, Peer_connection *conn,
+                       const Peer_binlog &binlog, const char *file_name)
+{
+  const char *log_name= binlog.gtids.log_name.c_str();
+  string request= "FETCH " + binlog.gtids.log_name;
+  string rest;
+  uint32 crc= 0;
+  uchar crc_buf[4];
+  size_t crc_len= 0;
+  bool failed= true;
+  int fd= -1;
+
+  if (peer_request(peer, request, conn))
+    return true;
+  if (peer_read_status(conn, peer, request.c_str(), &rest))
+    goto end;
+  if (strtoull(rest.c_str(), NULL, 10) != binlog.size)
+  {
+    sql_print_error("Peer catch-up: %s changed size since LIST", log_name);
+    goto end;
+  }
+  if ((fd= open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+  {
+    sql_print_error("Peer catch-up: could not create '%s', errno %d",
+                    file_name, errno);
+    goto end;
+  }
+
+  for (my_off_t left= binlog.size; left || crc_len < sizeof(crc_buf);)
+  {
+    if (conn->pos == conn->end && peer_fill(conn))
+    {
+      sql_print_error("Peer catch-up: %s ended the transfer of %s early",
+                      peer, log_name);
+      goto end;
+    }
+    const uchar *data= conn->buf + conn->pos;
+    size_t len= conn->end - conn->pos;
+    if (left)
+    {
+      len= (size_t) min<my_off_t>(len, left);
+      crc= binlog_crc32(crc, data, len);
+      if (write_all(fd, data, len))
+      {
+        sql_print_error("Peer catch-up: could not write '%s', errno %d",
+                        file_name, errno);
+        goto end;
+      }
+      left-= len;
+    }
+    else
+    {
+      len= min(len, sizeof(crc_buf) - crc_len);
+      memcpy(crc_buf + crc_len, data, len);
+      crc_len+= len;
+    }
+    conn->pos+= len;
+  }
+  if (uint4korr(crc_buf) != crc)
+  {
+    sql_print_error("Peer catch-up: checksum mismatch on %s", log_name);
+    goto end;
+  }
+  if (fdatasync(fd))
+  {
+    sql_print_error("Peer catch-up: could not sync '%s', errno %d",
+                    file_name, errno);
+    goto end;
+  }
+  failed= false;
+
+end:
+  if (fd >= 0 && close(fd) && !failed)
+  {
+    sql_print_error("Peer catch-up: could not close '%s', errno %d",
+                    file_name, errno);
+    failed= true;
+  }
+  peer_close(conn);
+  return failed;
+}
+
+
+/**
+  Append a binlog to the index file, on disk before its events are
+  dumped into the next one.
+*/
+static bool append_to_index(const char *index_file, const string &log_name)
+{
+  FILE *index= fopen(index_file, "a");
+  bool failed= !index || fprintf(index, "%s\n", log_name.c_str()) < 0 ||
+               fflush(index) || fsync(fileno(index));
+  if ((index && fclose(index)) || failed)
+  {
+    sql_print_error("Peer catch-up: could not add %s to '%s'",
+                    log_name.c_str(), index_file);
+    return true;
+  }
+  return false;
+}
+
+
+/**
+  Where to start in the peer's list: right after the last local binlog,
+  or at it when the peer has more of it.
+
+  @param[out] start  index in binlogs of the first binlog to fetch
+  @param[out] have   true if the binlog before start is local and closed
+
+  @retval false  ok
+  @retval true   the peer can not continue the local binlogs, logged
+*/
+static bool find_start(const vector<Peer_binlog> &binlogs,
+                       const vector<string> &local, size_t *start,
+                       bool *have)
+{
+  *start= 0;
+  *have= false;
+  if (local.empty())
+    return false;
+
+  const string &last= local.back();
+  for (size_t i= 0; i < binlogs.size(); i++)
+  {
+    if (binlogs[i].gtids.log_name != last)
+      continue;
+    Binlog_file *file= binlog_file_open(last.c_str());
+    my_off_t size= file ? binlog_file_size(file) : 0;
+    binlog_file_close(file);
+    if (size > binlogs[i].size)
+    {
+      sql_print_warning("Peer catch-up: the local %s is longer than the "
+                        "peer's, not catching up", last.c_str());
+      return true;
+    }
+    *have= size == binlogs[i].size;
+    *start= *have ? i + 1 : i;
+    return false;
+  }
+  sql_print_information("Peer catch-up: the peer has no closed %s, not "
+                        "catching up", last.c_str());
+  return true;
+}
+
+
+bool peer_catchup(const char *peer, const char *index_file, char *next_file)
+{
+  vector<Peer_binlog> binlogs;
+  vector<string> local;
+  string next;
+  string line;
+  Peer_connection conn;
+  size_t start, i;
+  bool have;
+  ulonglong fetched_bytes= 0;
+  ulonglong begin= my_micro_time();
+
+  if (!(conn.buf= (uchar *) malloc(PEER_CHUNK)))
+  {
+    sql_print_error("Peer catch-up: out of memory");
+    return true;
+  }
+  conn.fd= -1;
+
+  std::ifstream in(index_file);
+  while (std::getline(in, line))
+  {
+    if (!line.empty())
+      local.push_back(line);
+  }
+
+  if (peer_list(peer, &conn, &binlogs, &next) ||
+      find_start(binlogs, local, &start, &have))
+  {
+    free(conn.buf);
+    return true;
+  }
+  sql_print_information("Peer catch-up: %lu binlogs to fetch from %s",
+                        (ulong) (binlogs.size() - start), peer);
+
+  for (i= start; i < binlogs.size(); i++)
+  {
+    const Peer_binlog &binlog= binlogs[i];
+    string file_name= binlog.gtids.log_name + PEER_TMP_EXT;
+    const char *errmsg;
+    bool replace= !local.empty() && binlog.gtids.log_name == local.back();
+    ulonglong file_begin= my_micro_time();
+
+    if (peer_fetch(peer, &conn, binlog, file_name.c_str()))
+      break;
+    if (gtid_index_add_fetched(file_name.c_str(), binlog.gtids, &errmsg))
+    {
+      sql_print_error("Peer catch-up: refused %s from %s: %s",
+                      binlog.gtids.log_name.c_str(), peer, errmsg);
+      break;
+    }
+    if (rename(file_name.c_str(), binlog.gtids.log_name.c_str()))
+    {
+      sql_print_error("Peer catch-up: could not rename '%s', errno %d",
+                      file_name.c_str(), errno);
+      break;
+    }
+    if (!replace && append_to_index(index_file, binlog.gtids.log_name))
+      break;
+    have= true;
+    fetched_bytes+= binlog.size;
+    sql_print_information("Peer catch-up: fetched %s, %llu bytes in %llu ms",
+                          binlog.gtids.log_name.c_str(),
+                          (ulonglong) binlog.size,
+                          (my_micro_time() - file_begin) / 1000);
+  }
+  if (i < binlogs.size())
+    unlink((binlogs[i].gtids.log_name + PEER_TMP_EXT).c_str());
+  free(conn.buf);
+
+  ulonglong usec= std::max(my_micro_time() - begin, 1ULL);
+  sql_print_information("Peer catch-up: %lu binlogs, %llu MB in %llu s, "
+                        "%llu MB/s", (ulong) (i - start),
+                        fetched_bytes >> 20, usec / 1000000,
+                        (fetched_bytes * 1000000 / usec) >> 20);
+
+  if (i < binlogs.size())
+    next= binlogs[i].gtids.log_name;
+  if (!have || next.empty())
+    return true;
+  strncpy(next_file, next.c_str(), FN_REFLEN);
+  next_file[FN_REFLEN]= 0;
+  sql_print_information("Peer catch-up: continuing from the master at %s",
+                        next_file);
+  return false;
+}
@@ -0,0 +1,41 @@
+/**
+  @file
+
+  @brief
+  Catching up from a peer: after a long stop, the closed binlogs missing
+  in binlog_dir are copied from the binlog server (binlog_server.h) of
+  another virtual_slave of the same master, and only the binlog being
+  written is dumped from the master. The master's disk and dump thread
+  are spared the hours of backlog, and a new archive node is filled at
+  the speed of a file copy.
+
+  Every binlog is fetched to <binlog>.peer, checked against the CRC32
+  the peer sends and against the GTIDs the peer listed for it, which
+  must continue the GTIDs of the last local binlog, then synced, renamed
+  and added to the index file. The last local binlog is fetched again
+  when the peer has more of it, it was cut short by the stop.
+*/
+
+#ifndef MYSQL_PEER_CATCHUP_H
+#define MYSQL_PEER_CATCHUP_H
+
+#include "my_global.h"
+
+/**
+  Fetch the closed binlogs the peer has after the last local one.
+
+  Called at startup, before the receive thread, with the GTID index
+  loaded and binlog_dir as the work dir.
+
+  @param peer        binlog server of the peer, host:port
+  @param index_file  name of the binlog index file
+  @param[out] next_file  on success, the binlog to dump from the master,
+                     from its start; at least FN_REFLEN + 1 bytes
+
+  @retval false  the binlogs before next_file are all local and closed
+  @retval true   nothing usable was fetched, the reason has been logged,
+                 continue from the local binlogs
+*/
+bool peer_catchup(const char *peer, const char *index_file, char *next_file);
+
+#endif //MYSQL_PEER_CATCHUP_H
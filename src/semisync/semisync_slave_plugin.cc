@@ -105,6 +105,28 @@ int repl_semi_slave_request_dump(Binlog_relay_IO_param *param,
   return 0;
 }
 
+/*
+  The end of repl_semi_slave_request_dump(), for a caller that sent
+  "SELECT @@global.rpl_semi_sync_master_enabled" and
+  "SET @rpl_semi_sync_slave= 1" batched with its own statements.
+*/
+int repl_semi_slave_request_dump_probed(bool master_has_semisync)
+{
+  if (!repl_semisync.getSlaveEnabled())
+    return 0;
+
+  if (!master_has_semisync)
+  {
+    /* Master does not support semi-sync */
+    sql_print_warning("Master server does not support semi-sync, "
+                      "fallback to asynchronous replication");
+    rpl_semi_sync_slave_status= 0;
+    return 0;
+  }
+  rpl_semi_sync_slave_status= 1;
+  return 0;
+}
+
 int repl_semi_slave_read_event(Binlog_relay_IO_param *param,
 			       const char *packet, unsigned long len,
 			       const char **event_buf, unsigned long *event_len)
@@ -137,6 +159,33 @@ int repl_semi_slave_queue_event(Binlog_relay_IO_param *param,
   return 0;
 }
 
+/*
+  After an event that needs a reply, the master clears the packet number
+  of the connection and counts the reply, so the next event is packet 1
+  whenever the reply comes.
+*/
+void repl_semi_slave_defer_reply(Binlog_relay_IO_param *param)
+{
+  NET *net= &param->mysql->net;
+  net->pkt_nr= net->compress_pkt_nr= 1;
+}
+
+int repl_semi_slave_send_reply(Binlog_relay_IO_param *param)
+{
+  if (!rpl_semi_sync_slave_status)
+    return 0;
+  NET *net= &param->mysql->net;
+  uint pkt_nr= net->pkt_nr;
+  uint compress_pkt_nr= net->compress_pkt_nr;
+  /* slaveReply() numbers the reply as if it followed the event */
+  (void) repl_semisync.slaveReply(param->mysql,
+                                  param->master_log_name,
+                                  param->master_log_pos);
+  net->pkt_nr= pkt_nr;
+  net->compress_pkt_nr= compress_pkt_nr;
+  return 0;
+}
+
 int repl_semi_slave_io_start(Binlog_relay_IO_param *param)
 {
   return repl_semisync.slaveStart(param);
@@ -170,6 +219,14 @@ int handle_repl_semi_slave_request_dump(void *param,
 {
   return repl_semi_slave_request_dump((Binlog_relay_IO_param*) param,flags);
 }
+bool handle_repl_semi_slave_enabled()
+{
+  return repl_semisync.getSlaveEnabled();
+}
+int handle_repl_semi_slave_request_dump_probed(bool master_has_semisync)
+{
+  return repl_semi_slave_request_dump_probed(master_has_semisync);
+}
 int handle_repl_semi_slave_read_event(void *param,
                                       const char *packet, unsigned long len,
                                       const char **event_buf, unsigned long *event_len)
@@ -184,6 +241,15 @@ int handle_repl_semi_slave_queue_event(void *param,
   return repl_semi_slave_queue_event((Binlog_relay_IO_param*) param,event_buf,event_len,flags);
 }
 
+void handle_repl_semi_slave_defer_reply(void *param)
+{
+  repl_semi_slave_defer_reply((Binlog_relay_IO_param*) param);
+}
+int handle_repl_semi_slave_send_reply(void *param)
+{
+  return repl_semi_slave_send_reply((Binlog_relay_IO_param*) param);
+}
+
 int handle_repl_semi_slave_io_start(void *param)
 {
   return repl_semi_slave_io_start((Binlog_relay_IO_param*)param);
@@ -9,6 +9,8 @@ int symisync_slave_init();
 
 int handle_repl_semi_slave_request_dump(void *param,
                                  uint32 flags);
+bool handle_repl_semi_slave_enabled();
+int handle_repl_semi_slave_request_dump_probed(bool master_has_semisync);
 int handle_repl_semi_slave_read_event(void *param,
                                const char *packet, unsigned long len,
                                const char **event_buf, unsigned long *event_len);
@@ -17,4 +19,17 @@ int handle_repl_semi_slave_queue_event(void *param,
                                unsigned long event_len,
                                uint32 flags);
 
+/*
+  The reply to the event just read is sent later, with
+  handle_repl_semi_slave_send_reply(). The master numbers the packets
+  after that event as if the reply had been sent.
+*/
+void handle_repl_semi_slave_defer_reply(void *param);
+/*
+  Send a reply for the position in param now, whether or not the event
+  just read asked for one, leaving the numbering of the packets read
+  alone.
+*/
+int handle_repl_semi_slave_send_reply(void *param);
+
 #endif //MYSQL_SEMISYNC_SLAVE_PLUGIN_H
@@ -0,0 +1,369 @@
+/**
+  @file
+
+  @brief
+  Admin socket, see admin_socket.h.
+*/
+
+#include "admin_socket.h"
+#include "log/vs_log.h"
+
+#include <pthread.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <string>
+
+using std::string;
+
+/* how long a client may stay idle before it is disconnected */
+static const int ADMIN_IDLE_TIMEOUT_MS= 60000;
+/* max length of a command line */
+static const size_t ADMIN_LINE_MAX= 1024;
+
+/* held by the receive thread except while it waits for the master */
+static pthread_mutex_t admin_lock= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t admin_resume_cond= PTHREAD_COND_INITIALIZER;
+/* under admin_lock */
+static bool paused= false;
+
+static const Admin_command *registered_commands= NULL;
+static uint registered_count= 0;
+
+static int listen_fd= -1;
+static volatile bool admin_running= false;
+static pthread_t listener_thread;
+static char socket_file[FN_REFLEN + 1];
+
+
+void admin_state_release()
+{
+  if (admin_running)
+    pthread_mutex_unlock(&admin_lock);
+}
+
+
+void admin_state_acquire()
+{
+  if (!admin_running)
+    return;
+  pthread_mutex_lock(&admin_lock);
+  while (paused)
+    pthread_cond_wait(&admin_resume_cond, &admin_lock);
+}
+
+
+////////////////////////////////////////////////////////////
+//
+// Built in commands
+//
+////////////////////////////////////////////////////////////
+
+static bool admin_help(const char *, string *reply);
+
+
+static bool admin_pause(const char *, string *reply)
+{
+  pthread_mutex_lock(&admin_lock);
+  bool was_paused= paused;
+  paused= true;
+  pthread_mutex_unlock(&admin_lock);
+  if (!was_paused)
+    sql_print_information("Admin: receiving paused");
+  *reply= "receiving paused after the next event\n";
+  return false;
+}
+
+
+static bool admin_resume(const char *, string *reply)
+{
+  pthread_mutex_lock(&admin_lock);
+  bool was_paused= paused;
+  paused= false;
+  pthread_cond_broadcast(&admin_resume_cond);
+  pthread_mutex_unlock(&admin_lock);
+  if (was_paused)
+    sql_print_information("Admin: receiving resumed");
+  *reply= "receiving\n";
+  return false;
+}
+
+
+static bool admin_log_level(const char *args, string *reply)
+{
+  char line[64];
+  if (*args)
+  {
+    char *end;
+    long level= strtol(args, &end, 10);
+    if (*end || level < 0 || level > 3)
+    {
+      *reply= "log_level must be 0 to 3";
+      return true;
+    }
+    __atomic_store_n(&log_error_level, (int) level, __ATOMIC_RELAXED);
+    sql_print_information("Admin: log_level set to %ld", level);
+  }
+  my_snprintf(line, sizeof(line), "log_level %d\n",
+              __atomic_load_n(&log_error_level, __ATOMIC_RELAXED));
+  *reply= line;
+  return false;
+}
+
+
+static const Admin_command builtin_commands[]=
+{
+  { "help", "", false, admin_help },
+  { "pause", "", false, admin_pause },
+  { "resume", "", false, admin_resume },
+  { "log_level", "[0-3]", false, admin_log_level }
+};
+
+
+static void append_usage(string *reply, const Admin_command &command)
+{
+  reply->append(command.name);
+  if (*command.usage)
+  {
+    reply->append(" ");
+    reply->append(command.usage);
+  }
+  reply->append("\n");
+}
+
+
+static bool admin_help(const char *, string *reply)
+{
+  for (uint i= 0; i < array_elements(builtin_commands); i++)
+    append_usage(reply, builtin_commands[i]);
+  for (uint i= 0; i < registered_count; i++)
+    append_usage(reply, registered_commands[i]);
+  return false;
+}
+
+
+static const Admin_command *find_command(const string &name)
+{
+  for (uint i= 0; i < array_elements(builtin_commands); i++)
+  {
+    if (name == builtin_commands[i].name)
+      return &builtin_commands[i];
+  }
+  for (uint i= 0; i < registered_count; i++)
+  {
+    if (name == registered_commands[i].name)
+      return &registered_commands[i];
+  }
+  return NULL;
+}
+
+
+////////////////////////////////////////////////////////////
+//
+// Connections
+//
+////////////////////////////////////////////////////////////
+
+static bool send_all(int fd, const char *buf, size_t len)
+{
+  while (len)
+  {
+    ssize_t sent= send(fd, buf, len, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+      return true;
+    buf+= sent;
+    len-= sent;
+  }
+  return false;
+}
+
+
+/**
+  Run one command line.
+
+  @return the answer, ending with "OK" or "ERR <reason>"
+*/
+static string run_command(const string &line)
+{
+  string reply;
+  size_t name_end= line.find(' ');
+  string name= line.substr(0, name_end);
+  string args;
+  if (name_end != string::npos)
+  {
+    size_t args_begin= line.find_first_not_of(' ', name_end);
+    if (args_begin != string::npos)
+      args= line.substr(args_begin);
+  }
+
+  const Admin_command *command= find_command(name);
+  if (!command)
+    return "ERR unknown command '" + name + "', try help\n";
+
+  bool failed;
+  if (command->locked)
+  {
+    pthread_mutex_lock(&admin_lock);
+    failed= command->handler(args.c_str(), &reply);
+    pthread_mutex_unlock(&admin_lock);
+  }
+  else
+    failed= command->handler(args.c_str(), &reply);
+
+  if (failed)
+    return "ERR " + reply + "\n";
+  return reply + "OK\n";
+}
+
+
+/** Serve the commands of a client until it goes away or stays idle. */
+static void serve_client(int fd)
+{
+  string pending;
+  char buf[256];
+
+  while (admin_running)
+  {
+    size_t newline;
+    while ((newline= pending.find('\n')) != string::npos)
+    {
+      string line= pending.substr(0, newline);
+      pending.erase(0, newline + 1);
+      size_t end= line.find_last_not_of(" \t\r");
+      if (end == string::npos)
+        continue;
+      line.erase(end + 1);
+      line.erase(0, line.find_first_not_of(" \t"));
+      if (line == "quit")
+        return;
+      string reply= run_command(line);
+      if (send_all(fd, reply.data(), reply.size()))
+        return;
+    }
+    if (pending.size() > ADMIN_LINE_MAX)
+    {
+      const char *too_long= "ERR line too long\n";
+      send_all(fd, too_long, strlen(too_long));
+      return;
+    }
+
+    struct pollfd pfd;
+    pfd.fd= fd;
+    pfd.events= POLLIN;
+    if (poll(&pfd, 1, ADMIN_IDLE_TIMEOUT_MS) <= 0)
+      return;
+    ssize_t n= recv(fd, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+    {
+      /* a last command without a newline, as from echo -n */
+      if (!pending.empty())
+        pending+= '\n';
+      else
+        return;
+      continue;
+    }
+    pending.append(buf, n);
+  }
+}
+
+
+static void *listener_thread_func(void *)
+{
+  while (admin_running)
+  {
+    /* shutdown() does not wake accept() on a Unix socket, poll instead */
+    struct pollfd pfd;
+    pfd.fd= listen_fd;
+    pfd.events= POLLIN;
+    if (poll(&pfd, 1, 1000) == 0)
+      continue;
+    int fd= accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (admin_running)
+        sql_print_error("Admin: accept failed, errno %d", errno);
+      break;
+    }
+    /* one client at a time, commands are few and short */
+    serve_client(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+
+bool admin_socket_start(const char *socket_path, const Admin_command *commands,
+                        uint count)
+{
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family= AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path))
+  {
+    sql_print_error("Admin: socket path '%s' is too long", socket_path);
+    return true;
+  }
+  strcpy(addr.sun_path, socket_path);
+  if ((listen_fd= socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+  {
+    sql_print_error("Admin: could not create socket, errno %d", errno);
+    return true;
+  }
+  /* left over by a previous run */
+  unlink(socket_path);
+  if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+      listen(listen_fd, 4))
+  {
+    sql_print_error("Admin: could not listen on %s, errno %d", socket_path,
+                    errno);
+    close(listen_fd);
+    listen_fd= -1;
+    return true;
+  }
+  /* anyone who can connect can pause the replication */
+  chmod(socket_path, 0600);
+  strncpy(socket_file, socket_path, FN_REFLEN);
+
+  registered_commands= commands;
+  registered_count= count;
+  paused= false;
+  pthread_mutex_lock(&admin_lock);
+  admin_running= true;
+  if (pthread_create(&listener_thread, NULL, listener_thread_func, NULL))
+  {
+    sql_print_error("Admin: could not create the listener thread");
+    admin_running= false;
+    pthread_mutex_unlock(&admin_lock);
+    close(listen_fd);
+    listen_fd= -1;
+    unlink(socket_file);
+    return true;
+  }
+  sql_print_information("Admin: listening on %s", socket_file);
+  return false;
+}
+
+
+void admin_socket_stop()
+{
+  if (!admin_running)
+    return;
+  admin_running= false;
+  /* a command may be waiting for the lock */
+  pthread_mutex_unlock(&admin_lock);
+  pthread_join(listener_thread, NULL);
+  close(listen_fd);
+  listen_fd= -1;
+  unlink(socket_file);
+}
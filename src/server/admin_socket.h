@@ -0,0 +1,87 @@
+/**
+  @file
+
+  @brief
+  Admin socket: a Unix socket taking one command per line, to look at
+  and change a running virtual_slave without a restart, so without
+  dropping the connection to the master.
+
+  Each answer is zero or more lines of text followed by a line "OK" or
+  "ERR <reason>":
+
+    $ echo status | socat - UNIX-CONNECT:/tmp/virtual_slave.admin
+
+  The state of the receive thread (the binlog written, the GTIDs
+  received) is only touched by it, except while it waits for the master:
+  the thread holds the admin lock all along and releases it around the
+  reads with admin_state_release() and admin_state_acquire(). A command
+  that touches the state takes the lock, so it runs between two events
+  and never waits longer than the receive thread takes for one event.
+  Pausing keeps the receive thread in admin_state_acquire(), locked
+  commands still run meanwhile.
+
+  Commands are registered by the receive thread, the admin socket only
+  knows pause, resume, log_level and help.
+*/
+
+#ifndef MYSQL_ADMIN_SOCKET_H
+#define MYSQL_ADMIN_SOCKET_H
+
+#include "my_global.h"
+
+#include <string>
+
+/**
+  A command of the admin socket.
+
+  @param args        the rest of the line, "" if none
+  @param[out] reply  the answer, lines ending with '\n', or on error
+                     the reason on one line without it
+
+  @retval false  ok
+  @retval true   error
+*/
+typedef bool (*Admin_handler)(const char *args, std::string *reply);
+
+struct Admin_command
+{
+  const char *name;
+  /* the arguments, for help */
+  const char *usage;
+  /* true if it runs with the admin lock, between two events */
+  bool locked;
+  Admin_handler handler;
+};
+
+/**
+  Start serving commands, called by the receive thread, which holds the
+  admin lock from now on.
+
+  @param socket_path  Unix socket to listen on
+  @param commands     commands on top of the built in ones, they must
+                      stay valid until admin_socket_stop()
+  @param count        number of commands
+
+  @retval false  listener thread started
+  @retval true   failure, the reason has been logged
+*/
+bool admin_socket_start(const char *socket_path, const Admin_command *commands,
+                        uint count);
+
+/** Stop serving commands, called by the receive thread. */
+void admin_socket_stop();
+
+/**
+  The receive thread is about to wait for the master, or to sleep before
+  connecting again, commands may run until admin_state_acquire().
+  Nothing happens when the admin socket is not running.
+*/
+void admin_state_release();
+
+/**
+  The receive thread has a packet, it waits for a running command to end
+  and, while paused, for resume.
+*/
+void admin_state_acquire();
+
+#endif //MYSQL_ADMIN_SOCKET_H
@@ -0,0 +1,867 @@
+/**
+  @file
+
+  @brief
+  Downstream binlog server, see binlog_server.h for the protocol.
+
+  Every reader gets its own thread. The receive thread only publishes the
+  end of the active binlog through binlog_server_update_tail(), readers
+  never touch its FILE handle.
+*/
+
+#include "binlog_server.h"
+#include "tail_cache.h"
+#include "binlog/binlog_raw.h"
+#include "binlog/binlog_file.h"
+#include "binlog/binlog_checksum.h"
+#include "gtid/gtid_index.h"
+#include "log/vs_log.h"
+
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using std::min;
+using std::string;
+using std::vector;
+
+/* max length of a request line, including the newline */
+static const size_t SERVER_REQUEST_MAX= 64 * 1024;
+/* max length of an error line sent to a reader */
+static const size_t SERVER_ERROR_MAX= 512;
+/* a reader that does not drain its socket for this long is dropped */
+static const int SERVER_SEND_TIMEOUT= 60;
+/* how long a reader at the tail sleeps before checking its socket */
+static const int SERVER_TAIL_WAIT_MS= 1000;
+/* chunk size when sendfile() is not available */
+static const size_t SERVER_COPY_CHUNK= 64 * 1024;
+/* how much of a binlog is read at once when transactions are filtered */
+static const size_t SERVER_FILTER_CHUNK= 256 * 1024;
+/* how much of a binlog is read at once for FETCH */
+static const size_t SERVER_FETCH_CHUNK= 1024 * 1024;
+
+static int listen_fd= -1;
+static volatile bool server_running= false;
+static pthread_t listener_thread;
+static char server_index_file[FN_REFLEN + 1];
+
+/*
+  End of the active binlog as published by the receive thread. A file
+  that is not tail_file is closed and its size on disk is final.
+*/
+static pthread_mutex_t tail_lock= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tail_cond= PTHREAD_COND_INITIALIZER;
+static char tail_file[FN_REFLEN + 1];
+static my_off_t tail_pos= 0;
+/* bumped by each binlog_server_update_tail(), for readers of closed files */
+static ulonglong tail_updates= 0;
+/* readers waiting for tail_pos to move, see binlog_server_tail_wanted() */
+static volatile int file_tail_readers= 0;
+
+struct Reader_session
+{
+  int fd;
+  char peer[INET6_ADDRSTRLEN + 8];
+};
+
+
+/**
+  Send the whole buffer, retrying on short writes.
+
+  @retval false  ok
+  @retval true   the reader went away or the send timed out
+*/
+static bool send_all(int fd, const void *buf, size_t len)
+{
+  const char *ptr= (const char *) buf;
+  while (len > 0)
+  {
+    ssize_t sent= send(fd, ptr, len, MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return true;
+    }
+    ptr+= sent;
+    len-= sent;
+  }
+  return false;
+}
+
+
+/**
+  Send [*pos, end) of the binlog to the socket and advance *pos.
+  Compressed binlogs can not go through sendfile(), they are inflated and
+  copied.
+*/
+static bool send_file_range(int sock, Binlog_file *file, my_off_t *pos,
+                            my_off_t end)
+{
+#ifdef __linux__
+  int file_fd= binlog_file_fd(file);
+  while (file_fd >= 0 && *pos < end)
+  {
+    off_t offset= (off_t) *pos;
+    ssize_t sent= sendfile(sock, file_fd, &offset, (size_t) (end - *pos));
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return true;
+    }
+    if (sent == 0)
+      return true;                              // file was truncated
+    *pos= (my_off_t) offset;
+  }
+#endif
+  uchar buf[SERVER_COPY_CHUNK];
+  while (*pos < end)
+  {
+    size_t want= (size_t) min<my_off_t>(end - *pos, sizeof(buf));
+    ssize_t got= binlog_file_pread(file, buf, want, *pos);
+    if (got <= 0)
+      return true;
+    if (send_all(sock, buf, got))
+      return true;
+    *pos+= got;
+  }
+  return false;
+}
+
+
+/**
+  Read the event starting at pos into *buf, growing it as needed.
+
+  @retval false  ok, *len is the length of the event
+  @retval true   short read or a malformed header
+*/
+static bool read_event_at(Binlog_file *file, my_off_t pos, uchar **buf,
+                          size_t *buf_size, uint32 *len)
+{
+  uchar header[LOG_EVENT_HEADER_LEN];
+  if (binlog_file_pread(file, header, sizeof(header), pos) != sizeof(header))
+    return true;
+  *len= raw_event_len(header);
+  if (*len < LOG_EVENT_HEADER_LEN)
+    return true;
+  if (*buf_size < *len)
+  {
+    uchar *new_buf= (uchar *) realloc(*buf, *len);
+    if (!new_buf)
+      return true;
+    *buf= new_buf;
+    *buf_size= *len;
+  }
+  return binlog_file_pread(file, *buf, *len, pos) != (ssize_t) *len;
+}
+
+
+/**
+  Send [*pos, end) of the binlog without the transactions the reader has.
+  Only whole events are read, *pos stays at an event boundary.
+
+  @param skipping  see gtid_index_filter_events()
+*/
+static bool send_filtered_range(int sock, Binlog_file *file, my_off_t *pos,
+                                my_off_t end, Gtid_index_filter *filter,
+                                uchar **buf, size_t *buf_size, bool *skipping)
+{
+  while (*pos < end)
+  {
+    size_t want= (size_t) min<my_off_t>(end - *pos, SERVER_FILTER_CHUNK);
+    if (*buf_size < want)
+    {
+      uchar *new_buf= (uchar *) realloc(*buf, want);
+      if (!new_buf)
+        return true;
+      *buf= new_buf;
+      *buf_size= want;
+    }
+    ssize_t got= binlog_file_pread(file, *buf, want, *pos);
+    if (got <= 0)
+      return true;
+
+    size_t whole= 0;
+    while (whole + LOG_EVENT_HEADER_LEN <= (size_t) got)
+    {
+      uint32 len= raw_event_len(*buf + whole);
+      if (len < LOG_EVENT_HEADER_LEN)
+        return true;
+      if (whole + len > (size_t) got)
+        break;
+      whole+= len;
+    }
+    if (!whole)
+    {
+      /* An event larger than the chunk. */
+      uint32 len;
+      if (read_event_at(file, *pos, buf, buf_size, &len))
+        return true;
+      whole= len;
+    }
+
+    size_t keep= gtid_index_filter_events(filter, *buf, whole, skipping);
+    if (keep && send_all(sock, *buf, keep))
+      return true;
+    *pos+= whole;
+  }
+  return false;
+}
+
+
+/**
+  Look a binlog up in the index file.
+
+  @param log_name       file to look for
+  @param[out] next_name the file following log_name, or "" if log_name
+                        is the last one
+
+  @retval false  found
+  @retval true   log_name is not in the index
+*/
+static bool find_in_index(const char *log_name, char *next_name)
+{
+  char line[FN_REFLEN + 2];
+  bool found= false;
+  FILE *index= fopen(server_index_file, "r");
+
+  next_name[0]= 0;
+  if (!index)
+    return true;
+  while (fgets(line, sizeof(line), index))
+  {
+    size_t line_len= strlen(line);
+    if (line_len && line[line_len - 1] == '\n')
+      line[--line_len]= 0;
+    if (!line_len)
+      continue;
+    if (found)
+    {
+      strcpy(next_name, line);
+      break;
+    }
+    found= !strcmp(line, log_name);
+  }
+  fclose(index);
+  return !found;
+}
+
+
+/**
+  Return where a reader of log_name has to stop for now.
+
+  @param[out] active  true if log_name is the binlog being written
+*/
+static my_off_t get_file_end(const char *log_name, Binlog_file *file,
+                             bool *active)
+{
+  my_off_t end= 0;
+  pthread_mutex_lock(&tail_lock);
+  *active= !strcmp(tail_file, log_name);
+  if (*active)
+    end= tail_pos;
+  pthread_mutex_unlock(&tail_lock);
+
+  if (!*active)
+    end= binlog_file_size(file);
+  return end;
+}
+
+
+/**
+  Block until the tail moves past (log_name, pos) or the timeout expires.
+  When log_name is not the tail, the next binlog is not in the index
+  yet: block until the tail is updated, it is when a binlog starts.
+*/
+static void wait_for_tail(const char *log_name, my_off_t pos)
+{
+  struct timespec abstime;
+  clock_gettime(CLOCK_REALTIME, &abstime);
+  abstime.tv_sec+= SERVER_TAIL_WAIT_MS / 1000;
+
+  pthread_mutex_lock(&tail_lock);
+  ulonglong seen= tail_updates;
+  file_tail_readers++;
+  while (server_running &&
+         (!strcmp(tail_file, log_name) ? tail_pos <= pos :
+                                         tail_updates == seen))
+  {
+    if (pthread_cond_timedwait(&tail_cond, &tail_lock, &abstime) == ETIMEDOUT)
+      break;
+  }
+  file_tail_readers--;
+  pthread_mutex_unlock(&tail_lock);
+}
+
+
+/**
+  Readers do not send anything after the request, so a readable socket
+  means the reader closed the connection.
+*/
+static bool reader_gone(int sock)
+{
+  struct pollfd pfd;
+  char byte;
+  pfd.fd= sock;
+  pfd.events= POLLIN;
+  pfd.revents= 0;
+  if (poll(&pfd, 1, 0) <= 0)
+    return false;
+  if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+    return true;
+  ssize_t got= recv(sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  return got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR);
+}
+
+
+/**
+  Store a checksum over the first len bytes of an event at buf + len.
+*/
+static void store_event_checksum(uchar *buf, size_t len)
+{
+  int4store(buf + len, binlog_crc32(0, buf, len));
+}
+
+
+/**
+  Build the artificial ROTATE_EVENT a reader gets before the first event.
+
+  @return length of the event
+*/
+static size_t build_fake_rotate(uchar *buf, const char *log_name,
+                                my_off_t pos, uint32 server_id,
+                                binary_log::enum_binlog_checksum_alg alg)
+{
+  size_t ident_len= strlen(log_name);
+  size_t len= LOG_EVENT_HEADER_LEN + RAW_ROTATE_HEADER_LEN + ident_len;
+  size_t event_len= len;
+  if (alg == binary_log::BINLOG_CHECKSUM_ALG_CRC32)
+    event_len+= BINLOG_CHECKSUM_LEN;
+
+  int4store(buf, 0);
+  buf[EVENT_TYPE_OFFSET]= binary_log::ROTATE_EVENT;
+  int4store(buf + SERVER_ID_OFFSET, server_id);
+  int4store(buf + EVENT_LEN_OFFSET, event_len);
+  int4store(buf + LOG_POS_OFFSET, 0);
+  int2store(buf + FLAGS_OFFSET, RAW_LOG_EVENT_ARTIFICIAL_F);
+  int8store(buf + LOG_EVENT_HEADER_LEN, pos);
+  memcpy(buf + LOG_EVENT_HEADER_LEN + RAW_ROTATE_HEADER_LEN, log_name,
+         ident_len);
+  if (alg == binary_log::BINLOG_CHECKSUM_ALG_CRC32)
+    store_event_checksum(buf, len);
+  return event_len;
+}
+
+
+static void send_error(Reader_session *session, const char *msg)
+{
+  char line[SERVER_ERROR_MAX];
+  size_t len= my_snprintf(line, sizeof(line), "ERR %s\n", msg);
+  (void) send_all(session->fd, line, len);
+  sql_print_warning("Binlog server: reader %s: %s", session->peer, msg);
+}
+
+
+/**
+  Read the request line. Readers are expected to send it right away,
+  the socket receive timeout guards against the ones that do not.
+*/
+static bool read_request(int sock, char *request, size_t size)
+{
+  size_t len= 0;
+  while (len < size - 1)
+  {
+    ssize_t got= recv(sock, request + len, 1, 0);
+    if (got <= 0)
+    {
+      if (got < 0 && errno == EINTR)
+        continue;
+      return true;
+    }
+    if (request[len] == '\n')
+    {
+      request[len]= 0;
+      return false;
+    }
+    len++;
+  }
+  return true;
+}
+
+
+/**
+  Stream binlog events to a reader, starting at (log_name, pos).
+
+  @param filter  the GTID set of a reader positioned by GTIDs, its
+                 transactions are not sent; NULL for DUMP
+*/
+static void serve_dump(Reader_session *session, char *log_name, my_off_t pos,
+                       Gtid_index_filter *filter)
+{
+  char next_name[FN_REFLEN + 1];
+  uchar *event_buf= NULL;
+  size_t event_buf_size= 0;
+  uint32 fde_len;
+  Tail_cache_cursor cursor= 0;
+  bool in_cache= false;
+  bool skipping= false;
+  uchar rotate_buf[LOG_EVENT_HEADER_LEN + RAW_ROTATE_HEADER_LEN +
+                   FN_REFLEN + BINLOG_CHECKSUM_LEN];
+  Binlog_file *file= NULL;
+
+  if (find_in_index(log_name, next_name))
+  {
+    send_error(session, "binlog not found in the index");
+    return;
+  }
+  if (!(file= binlog_file_open(log_name)))
+  {
+    send_error(session, "could not open binlog");
+    return;
+  }
+  if (read_event_at(file, BIN_LOG_HEADER_SIZE, &event_buf, &event_buf_size,
+                    &fde_len) ||
+      raw_event_type(event_buf) != binary_log::FORMAT_DESCRIPTION_EVENT)
+  {
+    send_error(session, "could not read the format description event");
+    goto end;
+  }
+  if (pos < BIN_LOG_HEADER_SIZE)
+    pos= BIN_LOG_HEADER_SIZE;
+
+  {
+    binary_log::enum_binlog_checksum_alg alg=
+      raw_fde_checksum_alg(event_buf, fde_len);
+    size_t rotate_len= build_fake_rotate(rotate_buf, log_name, pos,
+                                         raw_event_server_id(event_buf), alg);
+    if (send_all(session->fd, "OK\n", 3) ||
+        send_all(session->fd, rotate_buf, rotate_len))
+      goto end;
+
+    if (pos > BIN_LOG_HEADER_SIZE)
+    {
+      /*
+        The reader does not start at the beginning of the file, it still
+        needs the FDE to decode what follows. Like a master we mark it
+        with log_pos 0 so it is not mistaken for a real position.
+      */
+      int4store(event_buf + LOG_POS_OFFSET, 0);
+      if (alg == binary_log::BINLOG_CHECKSUM_ALG_CRC32)
+        store_event_checksum(event_buf, fde_len - BINLOG_CHECKSUM_LEN);
+      if (send_all(session->fd, event_buf, fde_len))
+        goto end;
+    }
+  }
+
+  while (server_running)
+  {
+    if (in_cache)
+    {
+      size_t len;
+      if (tail_cache_read(&cursor, &event_buf, &event_buf_size, &len,
+                          log_name, &pos, SERVER_TAIL_WAIT_MS) ==
+          TAIL_CACHE_LAPPED)
+      {
+        /* Fell out of the window, continue from the files. */
+        in_cache= false;
+        if (!(file= binlog_file_open(log_name)))
+        {
+          sql_print_error("Binlog server: could not open binlog '%s'",
+                          log_name);
+          break;
+        }
+        continue;
+      }
+      if (!len)
+      {
+        if (reader_gone(session->fd))
+          break;
+        continue;
+      }
+      if (filter)
+        len= gtid_index_filter_events(filter, event_buf, len, &skipping);
+      if (len && send_all(session->fd, event_buf, len))
+        break;
+      continue;
+    }
+
+    bool active;
+    my_off_t end= get_file_end(log_name, file, &active);
+
+    if (pos < end)
+    {
+      /*
+        The receive thread indexes a GTID before it publishes the event,
+        so checking after reading end covers everything up to it.
+      */
+      if (filter && !gtid_index_filter_file_clean(filter, log_name) ?
+          send_filtered_range(session->fd, file, &pos, end, filter,
+                              &event_buf, &event_buf_size, &skipping) :
+          send_file_range(session->fd, file, &pos, end))
+        break;
+      continue;
+    }
+
+    if (!active)
+    {
+      if (pos > end)
+      {
+        send_error(session, "position is beyond the end of the binlog");
+        break;
+      }
+      if (!find_in_index(log_name, next_name) && next_name[0])
+      {
+        binlog_file_close(file);
+        if (!(file= binlog_file_open(next_name)))
+        {
+          sql_print_error("Binlog server: could not open binlog '%s'",
+                          next_name);
+          break;
+        }
+        strcpy(log_name, next_name);
+        pos= BIN_LOG_HEADER_SIZE;
+        continue;
+      }
+      /* The receive thread is between the ROTATE and the next FDE. */
+    }
+    else if (!tail_cache_seek(log_name, pos, &cursor))
+    {
+      /* Caught up with the files, follow the tail from memory. */
+      in_cache= true;
+      binlog_file_close(file);
+      file= NULL;
+      continue;
+    }
+
+    wait_for_tail(log_name, pos);
+    if (reader_gone(session->fd))
+      break;
+  }
+
+end:
+  free(event_buf);
+  binlog_file_close(file);
+}
+
+
+/**
+  DUMP_GTID <gtid set>: start at the first binlog with a transaction
+  that is not in the set, and leave out those that are.
+*/
+static void serve_dump_gtid(Reader_session *session, const char *gtid_text)
+{
+  char log_name[FN_REFLEN + 1];
+  const char *errmsg;
+  Gtid_index_filter *filter= gtid_index_filter_create(gtid_text, log_name,
+                                                      &errmsg);
+  if (!filter)
+  {
+    send_error(session, errmsg);
+    return;
+  }
+  sql_print_information("Binlog server: reader %s starts at %s by GTID",
+                        session->peer, log_name);
+  serve_dump(session, log_name, BIN_LOG_HEADER_SIZE, filter);
+  gtid_index_filter_free(filter);
+}
+
+
+/**
+  LIST: the closed binlogs with their sizes and GTIDs, for a peer to
+  choose what to fetch.
+*/
+static void serve_list(Reader_session *session)
+{
+  vector<Gtid_index_binlog> binlogs;
+  char next_name[FN_REFLEN + 1];
+  char size_buf[32];
+  string reply("OK\n");
+
+  gtid_index_closed_binlogs(&binlogs);
+  for (size_t i= 0; i < binlogs.size(); i++)
+  {
+    Binlog_file *file= binlog_file_open(binlogs[i].log_name.c_str());
+    if (!file)
+    {
+      /* removed since, the peer takes the binlogs before it */
+      binlogs.resize(i);
+      break;
+    }
+    my_snprintf(size_buf, sizeof(size_buf), "\t%llu\t",
+                (ulonglong) binlog_file_size(file));
+    binlog_file_close(file);
+    reply+= binlogs[i].log_name + size_buf + binlogs[i].previous_gtids +
+            "\t" + binlogs[i].added_gtids + "\n";
+  }
+  reply+= "END";
+  if (!binlogs.empty() &&
+      !find_in_index(binlogs.back().log_name.c_str(), next_name) &&
+      next_name[0])
+    reply+= string(" ") + next_name;
+  reply+= "\n";
+  (void) send_all(session->fd, reply.data(), reply.size());
+}
+
+
+/**
+  FETCH <binlog>: the whole of a closed binlog and the CRC32 of its bytes.
+  Compressed binlogs are sent inflated, as received from the master.
+*/
+static void serve_fetch(Reader_session *session, const char *log_name)
+{
+  char next_name[FN_REFLEN + 1];
+  char line[64];
+  uint32 crc= 0;
+  uchar crc_buf[4];
+  my_off_t pos= 0;
+  Binlog_file *file;
+  uchar *buf;
+
+  if (find_in_index(log_name, next_name))
+  {
+    send_error(session, "binlog not found in the index");
+    return;
+  }
+  if (!next_name[0])
+  {
+    send_error(session, "binlog is not closed");
+    return;
+  }
+  if (!(file= binlog_file_open(log_name)))
+  {
+    send_error(session, "could not open binlog");
+    return;
+  }
+  if (!(buf= (uchar *) malloc(SERVER_FETCH_CHUNK)))
+  {
+    send_error(session, "out of memory");
+    binlog_file_close(file);
+    return;
+  }
+
+  my_off_t size= binlog_file_size(file);
+  size_t len= my_snprintf(line, sizeof(line), "OK %llu\n", (ulonglong) size);
+  if (send_all(session->fd, line, len))
+    goto end;
+  /* read rather than sendfile(), the bytes go through the checksum */
+  while (pos < size)
+  {
+    size_t want= (size_t) min<my_off_t>(size - pos, SERVER_FETCH_CHUNK);
+    ssize_t got= binlog_file_pread(file, buf, want, pos);
+    if (got <= 0)
+    {
+      /* the peer sees the connection close before the checksum */
+      sql_print_error("Binlog server: could not read binlog '%s'", log_name);
+      goto end;
+    }
+    crc= binlog_crc32(crc, buf, got);
+    if (send_all(session->fd, buf, got))
+      goto end;
+    pos+= got;
+  }
+  int4store(crc_buf, crc);
+  (void) send_all(session->fd, crc_buf, sizeof(crc_buf));
+
+end:
+  free(buf);
+  binlog_file_close(file);
+}
+
+
+static void *reader_session_thread(void *arg)
+{
+  Reader_session *session= (Reader_session *) arg;
+  char *request= (char *) malloc(SERVER_REQUEST_MAX);
+  char log_name[FN_REFLEN + 1];
+  unsigned long long pos= 0;
+
+  if (!request || read_request(session->fd, request, SERVER_REQUEST_MAX))
+    goto end;
+
+  if (!strncmp(request, "DUMP_GTID", 9) &&
+      (request[9] == ' ' || request[9] == 0))
+  {
+    serve_dump_gtid(session, request + 9);
+  }
+  else if (!strcmp(request, "LIST"))
+  {
+    serve_list(session);
+    goto end;
+  }
+  else if (!strncmp(request, "FETCH ", 6))
+  {
+    if (sscanf(request, "FETCH %512s", log_name) != 1 ||
+        strchr(log_name, '/'))
+    {
+      send_error(session, "malformed request");
+      goto end;
+    }
+    sql_print_information("Binlog server: peer %s fetches %s",
+                          session->peer, log_name);
+    serve_fetch(session, log_name);
+    goto end;
+  }
+  else
+  {
+    if (sscanf(request, "DUMP %512s %llu", log_name, &pos) != 2 ||
+        strchr(log_name, '/'))
+    {
+      send_error(session, "malformed request");
+      goto end;
+    }
+
+    sql_print_information("Binlog server: reader %s starts at %s:%llu",
+                          session->peer, log_name, pos);
+    serve_dump(session, log_name, (my_off_t) pos, NULL);
+  }
+  sql_print_information("Binlog server: reader %s disconnected",
+                        session->peer);
+
+end:
+  free(request);
+  close(session->fd);
+  delete session;
+  return NULL;
+}
+
+
+static void *listener_thread_func(void *)
+{
+  while (server_running)
+  {
+    struct sockaddr_in addr;
+    socklen_t addr_len= sizeof(addr);
+    int fd= accept(listen_fd, (struct sockaddr *) &addr, &addr_len);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (server_running)
+        sql_print_error("Binlog server: accept failed, errno %d", errno);
+      break;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec= SERVER_SEND_TIMEOUT;
+    timeout.tv_usec= 0;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    Reader_session *session= new Reader_session;
+    session->fd= fd;
+    inet_ntop(AF_INET, &addr.sin_addr, session->peer, sizeof(session->peer));
+    size_t peer_len= strlen(session->peer);
+    my_snprintf(session->peer + peer_len, sizeof(session->peer) - peer_len,
+                ":%u", (uint) ntohs(addr.sin_port));
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, reader_session_thread, session))
+    {
+      sql_print_error("Binlog server: could not create a reader thread");
+      close(fd);
+      delete session;
+    }
+    pthread_attr_destroy(&attr);
+  }
+  return NULL;
+}
+
+
+bool binlog_server_start(const char *bind_addr, uint port,
+                         const char *index_file)
+{
+  struct sockaddr_in addr;
+  int one= 1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family= AF_INET;
+  addr.sin_port= htons((uint16) port);
+  if (inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1)
+  {
+    sql_print_error("Binlog server: invalid bind address '%s'", bind_addr);
+    return true;
+  }
+
+  if ((listen_fd= socket(AF_INET, SOCK_STREAM, 0)) < 0)
+  {
+    sql_print_error("Binlog server: could not create socket, errno %d", errno);
+    return true;
+  }
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+      listen(listen_fd, 64))
+  {
+    sql_print_error("Binlog server: could not listen on %s:%u, errno %d",
+                    bind_addr, port, errno);
+    close(listen_fd);
+    listen_fd= -1;
+    return true;
+  }
+
+  strncpy(server_index_file, index_file, FN_REFLEN);
+  server_running= true;
+  if (pthread_create(&listener_thread, NULL, listener_thread_func, NULL))
+  {
+    sql_print_error("Binlog server: could not create the listener thread");
+    server_running= false;
+    close(listen_fd);
+    listen_fd= -1;
+    return true;
+  }
+  sql_print_information("Binlog server: listening on %s:%u", bind_addr, port);
+  return false;
+}
+
+
+void binlog_server_stop()
+{
+  if (!server_running)
+    return;
+  server_running= false;
+  shutdown(listen_fd, SHUT_RDWR);
+  pthread_join(listener_thread, NULL);
+  close(listen_fd);
+  listen_fd= -1;
+
+  pthread_mutex_lock(&tail_lock);
+  pthread_cond_broadcast(&tail_cond);
+  pthread_mutex_unlock(&tail_lock);
+}
+
+
+bool binlog_server_enabled()
+{
+  return server_running;
+}
+
+
+bool binlog_server_tail_wanted()
+{
+  return file_tail_readers > 0;
+}
+
+
+void binlog_server_update_tail(const char *log_name, my_off_t end_pos)
+{
+  pthread_mutex_lock(&tail_lock);
+  if (strcmp(tail_file, log_name))
+    strncpy(tail_file, log_name, FN_REFLEN);
+  tail_pos= end_pos;
+  tail_updates++;
+  pthread_cond_broadcast(&tail_cond);
+  pthread_mutex_unlock(&tail_lock);
+}
@@ -0,0 +1,94 @@
+/**
+  @file
+
+  @brief
+  Serves the binlogs in binlog_dir to downstream readers.
+
+  A reader connects over TCP and sends one request line, either
+
+    DUMP <binlog file> <position>\n
+
+  or, to be positioned by the GTIDs it already has,
+
+    DUMP_GTID <gtid set>\n
+
+  The GTID index (gtid_index.h) picks the binlog to start with, and the
+  transactions of the set are left out of the stream.
+
+  The server answers "OK\n" (or "ERR <message>\n" and closes) and then
+  streams raw binlog events, starting with an artificial ROTATE_EVENT
+  naming the requested file.  When the position is past the
+  FORMAT_DESCRIPTION_EVENT, that event is sent next with log_pos set to 0,
+  exactly like a master dump thread does.  After that the files are sent
+  as they are on disk, following the index file, and the stream stays
+  open at the tail of the active binlog, waiting for more events.
+
+  Another virtual_slave catching up (peer_catchup.h) copies closed
+  binlogs as whole files instead, with one of
+
+    LIST\n
+    FETCH <binlog file>\n
+
+  LIST answers "OK\n", then one line per closed binlog in index order,
+
+    <binlog>\t<size>\t<previous gtids>\t<gtids added in the binlog>\n
+
+  as in the GTID index, and "END <binlog>\n" naming the binlog after the
+  last one listed ("END\n" if none is). FETCH answers "OK <size>\n", the
+  binlog as it was received from the master, and the CRC32 of those
+  bytes in 4 bytes little endian. Only closed binlogs can be fetched.
+
+  Closed files never need to be parsed, their event ranges go to the
+  socket with sendfile(), unless they hold transactions a DUMP_GTID
+  reader has. Readers that reach the tail of the active
+  binlog continue from the tail cache (tail_cache.h) when it is enabled.
+*/
+
+#ifndef MYSQL_BINLOG_SERVER_H
+#define MYSQL_BINLOG_SERVER_H
+
+#include "my_global.h"
+
+/**
+  Start listening for downstream readers.
+
+  @param bind_addr   address to listen on
+  @param port        TCP port
+  @param index_file  name of the binlog index file, relative to the
+                     current work dir (binlog_dir)
+
+  @retval false  listener thread started
+  @retval true   failure, the reason has been logged
+*/
+bool binlog_server_start(const char *bind_addr, uint port,
+                         const char *index_file);
+
+/**
+  Stop accepting new readers. Sessions already running end when their
+  reader goes away or at process exit.
+*/
+void binlog_server_stop();
+
+/** true if binlog_server_start() succeeded. */
+bool binlog_server_enabled();
+
+/**
+  true if some reader is waiting at the end of the active binlog on disk,
+  i.e. the receive thread should flush and publish its position now
+  instead of relying on the tail cache.
+*/
+bool binlog_server_tail_wanted();
+
+/**
+  Publish the end of the last complete event of the active binlog.
+
+  Must be called by the receive thread once the bytes up to end_pos have
+  reached the kernel (after fflush), readers at the tail never go past
+  this position.
+
+  @param log_name  name of the binlog being written
+  @param end_pos   file offset right after the last complete event
+*/
+void binlog_server_update_tail(const char *log_name, my_off_t end_pos);
+
+#endif //MYSQL_BINLOG_SERVER_H
@@ -0,0 +1,744 @@
+/**
+  @file
+
+  @brief
+  Prometheus metrics, see metrics.h.
+*/
+
+#include "metrics.h"
+#include "binlog/binlog_raw.h"
+#include "log/vs_log.h"
+
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <string>
+
+using std::string;
+
+/* how long a scraper gets to send its request and read the answer */
+static const int METRICS_IO_TIMEOUT_MS= 5000;
+/* max length of a request head */
+static const size_t METRICS_REQUEST_MAX= 4096;
+/* event types counted one by one, there are fewer in 5.7 */
+static const uint METRICS_EVENT_TYPES= 64;
+/* distinct errors counted, later ones are counted as "other" */
+static const uint METRICS_RECONNECT_ERRORS= 16;
+
+/*
+  Upper bounds of the latency histograms in microseconds, and the same
+  as they are printed in seconds. The last bucket is +Inf.
+*/
+static const ulonglong latency_bounds[]=
+{ 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000,
+  500000, 1000000 };
+static const char *latency_labels[]=
+{ "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01",
+  "0.025", "0.05", "0.1", "0.25", "0.5", "1" };
+static const uint LATENCY_BUCKETS= array_elements(latency_bounds) + 1;
+
+struct Latency_histogram
+{
+  volatile uint64 buckets[LATENCY_BUCKETS];
+  volatile uint64 sum_usec;
+};
+
+struct Reconnect_error
+{
+  volatile uint64 err;
+  volatile uint64 count;
+};
+
+static volatile uint64 events_received[METRICS_EVENT_TYPES];
+static volatile uint64 bytes_received[METRICS_EVENT_TYPES];
+static volatile uint64 transactions_received= 0;
+static volatile uint64 gtids_received= 0;
+static Latency_histogram fsync_latency;
+static Latency_histogram mirror_fsync_latency;
+static Latency_histogram ack_latency;
+static volatile uint64 acks_merged= 0;
+static volatile uint64 compressed_bytes= 0;
+static volatile uint64 decompressed_bytes= 0;
+static volatile uint64 decompress_usec= 0;
+static volatile uint64 catchup_active= 0;
+static volatile uint64 catchup_bytes= 0;
+static volatile uint64 catchup_usec= 0;
+static Reconnect_error reconnect_errors[METRICS_RECONNECT_ERRORS];
+static volatile uint64 reconnects_other= 0;
+static volatile uint64 binlog_pos= 0;
+/* position flushed to the binlog file up to */
+static volatile uint64 flushed_pos= 0;
+/*
+  Arrival time of the last transaction minus its timestamp on the
+  master, 0 once a heartbeat shows nothing is left to receive.
+*/
+static volatile uint64 lag_seconds= 0;
+/* timestamp on the master of the last transaction */
+static volatile uint64 last_trx_when= 0;
+/* when the last heartbeat arrived, seconds since the epoch */
+static volatile uint64 last_heartbeat= 0;
+/* master binlog position the last heartbeat was sent at */
+static volatile uint64 master_pos= 0;
+
+/*
+  The names change on rotation only, the scraper copies them under the
+  lock, together with the positions so they match.
+*/
+static pthread_mutex_t binlog_file_lock= PTHREAD_MUTEX_INITIALIZER;
+static char binlog_file[FN_REFLEN + 1];
+static char flushed_file[FN_REFLEN + 1];
+static char master_file[FN_REFLEN + 1];
+
+static int listen_fd= -1;
+static volatile bool metrics_running= false;
+static pthread_t listener_thread;
+static char socket_file[FN_REFLEN + 1];
+
+
+static inline uint64 load_relaxed(const volatile uint64 *counter)
+{
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+
+static inline void store_relaxed(volatile uint64 *counter, uint64 value)
+{
+  __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+
+/** Add to a counter only the receive thread writes, no locked add. */
+static inline void add_relaxed(volatile uint64 *counter, uint64 value)
+{
+  store_relaxed(counter, load_relaxed(counter) + value);
+}
+
+
+static void observe(Latency_histogram *histogram, ulonglong usec)
+{
+  uint bucket= 0;
+  while (bucket < LATENCY_BUCKETS - 1 && usec > latency_bounds[bucket])
+    bucket++;
+  add_relaxed(&histogram->buckets[bucket], 1);
+  add_relaxed(&histogram->sum_usec, usec);
+}
+
+
+void metrics_event_received(const uchar *event, size_t len)
+{
+  uint type= raw_event_type(event);
+  if (type >= METRICS_EVENT_TYPES)
+    type= 0;
+  add_relaxed(&events_received[type], 1);
+  add_relaxed(&bytes_received[type], len);
+}
+
+
+void metrics_heartbeat_received(const char *log_name, size_t name_len,
+                                ulonglong log_pos)
+{
+  store_relaxed(&last_heartbeat, (uint64) time(NULL));
+  if (!log_name)
+    return;
+  name_len= std::min(name_len, (size_t) FN_REFLEN);
+  pthread_mutex_lock(&binlog_file_lock);
+  memcpy(master_file, log_name, name_len);
+  master_file[name_len]= 0;
+  store_relaxed(&master_pos, log_pos);
+  /* everything the master has is in the binlog, there is no lag left */
+  if (!strcmp(master_file, flushed_file) &&
+      load_relaxed(&flushed_pos) >= log_pos)
+    store_relaxed(&lag_seconds, 0);
+  pthread_mutex_unlock(&binlog_file_lock);
+}
+
+
+void metrics_transaction_received(bool has_gtid, uint32 when)
+{
+  add_relaxed(&transactions_received, 1);
+  if (has_gtid)
+    add_relaxed(&gtids_received, 1);
+  if (when)
+  {
+    time_t now= time(NULL);
+    store_relaxed(&lag_seconds, now > (time_t) when ? now - when : 0);
+    store_relaxed(&last_trx_when, when);
+  }
+}
+
+
+void metrics_catchup(bool active, ulonglong bytes, ulonglong usec)
+{
+  store_relaxed(&catchup_active, active);
+  add_relaxed(&catchup_bytes, bytes);
+  add_relaxed(&catchup_usec, usec);
+}
+
+
+void metrics_fsync(ulonglong usec)
+{
+  observe(&fsync_latency, usec);
+}
+
+
+void metrics_mirror_fsync(ulonglong usec)
+{
+  observe(&mirror_fsync_latency, usec);
+}
+
+
+void metrics_ack_sent(ulonglong usec)
+{
+  observe(&ack_latency, usec);
+}
+
+
+void metrics_acks_merged(ulonglong count)
+{
+  if (count)
+    add_relaxed(&acks_merged, count);
+}
+
+
+void metrics_decompressed(ulonglong packed_len, ulonglong inflated_len,
+                          ulonglong usec)
+{
+  add_relaxed(&compressed_bytes, packed_len);
+  add_relaxed(&decompressed_bytes, inflated_len);
+  add_relaxed(&decompress_usec, usec);
+}
+
+
+void metrics_reconnect(uint err)
+{
+  for (uint i= 0; i < METRICS_RECONNECT_ERRORS; i++)
+  {
+    Reconnect_error *entry= &reconnect_errors[i];
+    if (load_relaxed(&entry->count) && load_relaxed(&entry->err) != err)
+      continue;
+    /* the error is set before the count makes the entry visible */
+    store_relaxed(&entry->err, err);
+    __atomic_store_n(&entry->count, load_relaxed(&entry->count) + 1,
+                     __ATOMIC_RELEASE);
+    return;
+  }
+  add_relaxed(&reconnects_other, 1);
+}
+
+
+void metrics_position(const char *log_name, ulonglong pos)
+{
+  /* only the receive thread writes binlog_file, it reads it unlocked */
+  if (strcmp(log_name, binlog_file))
+  {
+    pthread_mutex_lock(&binlog_file_lock);
+    strncpy(binlog_file, log_name, FN_REFLEN);
+    store_relaxed(&binlog_pos, pos);
+    pthread_mutex_unlock(&binlog_file_lock);
+  }
+  else
+    store_relaxed(&binlog_pos, pos);
+}
+
+
+void metrics_flushed(const char *log_name, ulonglong pos)
+{
+  /* only its writer changes flushed_file, it reads it unlocked */
+  if (strcmp(log_name, flushed_file))
+  {
+    pthread_mutex_lock(&binlog_file_lock);
+    strncpy(flushed_file, log_name, FN_REFLEN);
+    store_relaxed(&flushed_pos, pos);
+    pthread_mutex_unlock(&binlog_file_lock);
+  }
+  else
+    store_relaxed(&flushed_pos, pos);
+}
+
+
+/** Distance to the master, across binlogs it is unknown. */
+static longlong bytes_behind(const char *file, uint64 pos,
+                             const char *heartbeat_file, uint64 heartbeat_pos)
+{
+  if (!heartbeat_file[0] || strcmp(file, heartbeat_file))
+    return -1;
+  return heartbeat_pos > pos ? (longlong) (heartbeat_pos - pos) : 0;
+}
+
+
+void metrics_summary(Metrics_summary *summary)
+{
+  char file[FN_REFLEN + 1];
+  char heartbeat_file[FN_REFLEN + 1];
+
+  summary->events= summary->bytes= 0;
+  for (uint type= 0; type < METRICS_EVENT_TYPES; type++)
+  {
+    summary->events+= load_relaxed(&events_received[type]);
+    summary->bytes+= load_relaxed(&bytes_received[type]);
+  }
+  summary->transactions= load_relaxed(&transactions_received);
+  summary->reconnects= load_relaxed(&reconnects_other);
+  for (uint i= 0; i < METRICS_RECONNECT_ERRORS; i++)
+    summary->reconnects+= __atomic_load_n(&reconnect_errors[i].count,
+                                          __ATOMIC_ACQUIRE);
+  summary->seconds_behind= load_relaxed(&lag_seconds);
+
+  pthread_mutex_lock(&binlog_file_lock);
+  memcpy(file, flushed_file, sizeof(file));
+  memcpy(heartbeat_file, master_file, sizeof(heartbeat_file));
+  uint64 pos= load_relaxed(&flushed_pos);
+  uint64 heartbeat_pos= load_relaxed(&master_pos);
+  pthread_mutex_unlock(&binlog_file_lock);
+  summary->bytes_behind= bytes_behind(file, pos, heartbeat_file,
+                                      heartbeat_pos);
+}
+
+
+////////////////////////////////////////////////////////////
+//
+// Exposition
+//
+////////////////////////////////////////////////////////////
+
+static const char *event_type_name(uint type)
+{
+  static const char *names[]=
+  {
+    "unknown", "start_v3", "query", "stop", "rotate", "intvar", "load",
+    "slave", "create_file", "append_block", "exec_load", "delete_file",
+    "new_load", "rand", "user_var", "format_description", "xid",
+    "begin_load_query", "execute_load_query", "table_map",
+    "pre_ga_write_rows", "pre_ga_update_rows", "pre_ga_delete_rows",
+    "write_rows_v1", "update_rows_v1", "delete_rows_v1", "incident",
+    "heartbeat", "ignorable", "rows_query", "write_rows", "update_rows",
+    "delete_rows", "gtid", "anonymous_gtid", "previous_gtids",
+    "transaction_context", "view_change", "xa_prepare"
+  };
+  return type < array_elements(names) ? names[type] : NULL;
+}
+
+
+static void append(string *out, const char *format, ...)
+  MY_ATTRIBUTE((format(printf, 2, 3)));
+
+static void append(string *out, const char *format, ...)
+{
+  char line[FN_REFLEN + 256];
+  va_list args;
+  va_start(args, format);
+  size_t len= my_vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  out->append(line, len);
+}
+
+
+static void append_header(string *out, const char *name, const char *type,
+                          const char *help)
+{
+  append(out, "# HELP virtual_slave_%s %s\n", name, help);
+  append(out, "# TYPE virtual_slave_%s %s\n", name, type);
+}
+
+
+static void append_histogram(string *out, const char *name, const char *help,
+                             const Latency_histogram *histogram)
+{
+  uint64 cumulative= 0;
+  append_header(out, name, "histogram", help);
+  for (uint i= 0; i < LATENCY_BUCKETS; i++)
+  {
+    cumulative+= load_relaxed(&histogram->buckets[i]);
+    append(out, "virtual_slave_%s_bucket{le=\"%s\"} %llu\n", name,
+           i < LATENCY_BUCKETS - 1 ? latency_labels[i] : "+Inf",
+           (ulonglong) cumulative);
+  }
+  uint64 sum= load_relaxed(&histogram->sum_usec);
+  append(out, "virtual_slave_%s_sum %llu.%06llu\n", name,
+         (ulonglong) (sum / 1000000), (ulonglong) (sum % 1000000));
+  append(out, "virtual_slave_%s_count %llu\n", name, (ulonglong) cumulative);
+}
+
+
+static void build_metrics(string *out)
+{
+  char file[FN_REFLEN + 1];
+  char flushed[FN_REFLEN + 1];
+  char heartbeat_file[FN_REFLEN + 1];
+  uint64 now= (uint64) time(NULL);
+
+  append_header(out, "events_received_total", "counter",
+                "Events received from the master, by type.");
+  for (uint type= 0; type < METRICS_EVENT_TYPES; type++)
+  {
+    uint64 events= load_relaxed(&events_received[type]);
+    if (!events)
+      continue;
+    const char *name= event_type_name(type);
+    if (name)
+      append(out, "virtual_slave_events_received_total{type=\"%s\"} %llu\n",
+             name, (ulonglong) events);
+    else
+      append(out, "virtual_slave_events_received_total{type=\"%u\"} %llu\n",
+             type, (ulonglong) events);
+  }
+  append_header(out, "bytes_received_total", "counter",
+                "Bytes of events received from the master, by type.");
+  for (uint type= 0; type < METRICS_EVENT_TYPES; type++)
+  {
+    uint64 bytes= load_relaxed(&bytes_received[type]);
+    if (!bytes)
+      continue;
+    const char *name= event_type_name(type);
+    if (name)
+      append(out, "virtual_slave_bytes_received_total{type=\"%s\"} %llu\n",
+             name, (ulonglong) bytes);
+    else
+      append(out, "virtual_slave_bytes_received_total{type=\"%u\"} %llu\n",
+             type, (ulonglong) bytes);
+  }
+
+  append_header(out, "transactions_received_total", "counter",
+                "Transactions received completely.");
+  append(out, "virtual_slave_transactions_received_total %llu\n",
+         (ulonglong) load_relaxed(&transactions_received));
+  append_header(out, "gtids_received_total", "counter",
+                "GTIDs received since the start.");
+  append(out, "virtual_slave_gtids_received_total %llu\n",
+         (ulonglong) load_relaxed(&gtids_received));
+
+  append_histogram(out, "fsync_seconds", "Time taken by fsync() of the binlog.",
+                   &fsync_latency);
+  append_histogram(out, "mirror_fsync_seconds",
+                   "Time taken by fsync() of the mirror binlog.",
+                   &mirror_fsync_latency);
+  append_histogram(out, "ack_seconds",
+                   "Time from the arrival of an event to its semi-sync ACK.",
+                   &ack_latency);
+
+  append_header(out, "acks_merged_total", "counter",
+                "ACKs not sent because a later ACK covered them.");
+  append(out, "virtual_slave_acks_merged_total %llu\n",
+         (ulonglong) load_relaxed(&acks_merged));
+
+  /* the ratio is decompressed_bytes_total / compressed_bytes_received_total */
+  append_header(out, "compressed_bytes_received_total", "counter",
+                "Bytes of compressed packets received from the master.");
+  append(out, "virtual_slave_compressed_bytes_received_total %llu\n",
+         (ulonglong) load_relaxed(&compressed_bytes));
+  append_header(out, "decompressed_bytes_total", "counter",
+                "Bytes the compressed packets were inflated to.");
+  append(out, "virtual_slave_decompressed_bytes_total %llu\n",
+         (ulonglong) load_relaxed(&decompressed_bytes));
+  uint64 inflate_time= load_relaxed(&decompress_usec);
+  append_header(out, "decompress_seconds_total", "counter",
+                "Time the receive thread spent inflating compressed packets.");
+  append(out, "virtual_slave_decompress_seconds_total %llu.%06llu\n",
+         (ulonglong) (inflate_time / 1000000),
+         (ulonglong) (inflate_time % 1000000));
+
+  /* the catch-up throughput is catchup_bytes_total / catchup_seconds_total */
+  append_header(out, "catchup_mode", "gauge",
+                "1 while far behind the master, the binlog is then written "
+                "in large writes and synced periodically.");
+  append(out, "virtual_slave_catchup_mode %llu\n",
+         (ulonglong) load_relaxed(&catchup_active));
+  append_header(out, "catchup_bytes_total", "counter",
+                "Bytes of events received in catch-up mode.");
+  append(out, "virtual_slave_catchup_bytes_total %llu\n",
+         (ulonglong) load_relaxed(&catchup_bytes));
+  uint64 catchup_time= load_relaxed(&catchup_usec);
+  append_header(out, "catchup_seconds_total", "counter",
+                "Time spent in catch-up mode, up to its last sync.");
+  append(out, "virtual_slave_catchup_seconds_total %llu.%06llu\n",
+         (ulonglong) (catchup_time / 1000000),
+         (ulonglong) (catchup_time % 1000000));
+
+  append_header(out, "reconnects_total", "counter",
+                "Connections to the master lost, by MySQL error.");
+  for (uint i= 0; i < METRICS_RECONNECT_ERRORS; i++)
+  {
+    uint64 count= __atomic_load_n(&reconnect_errors[i].count,
+                                  __ATOMIC_ACQUIRE);
+    if (!count)
+      break;
+    append(out, "virtual_slave_reconnects_total{error=\"%llu\"} %llu\n",
+           (ulonglong) load_relaxed(&reconnect_errors[i].err),
+           (ulonglong) count);
+  }
+  if (load_relaxed(&reconnects_other))
+    append(out, "virtual_slave_reconnects_total{error=\"other\"} %llu\n",
+           (ulonglong) load_relaxed(&reconnects_other));
+
+  pthread_mutex_lock(&binlog_file_lock);
+  memcpy(file, binlog_file, sizeof(file));
+  memcpy(flushed, flushed_file, sizeof(flushed));
+  memcpy(heartbeat_file, master_file, sizeof(heartbeat_file));
+  uint64 pos= load_relaxed(&binlog_pos);
+  uint64 flushed_to= load_relaxed(&flushed_pos);
+  uint64 heartbeat_pos= load_relaxed(&master_pos);
+  pthread_mutex_unlock(&binlog_file_lock);
+  append_header(out, "binlog_position", "gauge",
+                "Position in the master binlog written up to.");
+  append(out, "virtual_slave_binlog_position{file=\"%s\"} %llu\n", file,
+         (ulonglong) pos);
+  append_header(out, "binlog_flushed_position", "gauge",
+                "Position in the master binlog flushed to the binlog "
+                "file up to.");
+  if (flushed[0])
+    append(out, "virtual_slave_binlog_flushed_position{file=\"%s\"} %llu\n",
+           flushed, (ulonglong) flushed_to);
+  append_header(out, "master_binlog_position", "gauge",
+                "Position of the master as of the last heartbeat.");
+  if (heartbeat_file[0])
+    append(out, "virtual_slave_master_binlog_position{file=\"%s\"} %llu\n",
+           heartbeat_file, (ulonglong) heartbeat_pos);
+
+  append_header(out, "bytes_behind_master", "gauge",
+                "Master position of the last heartbeat minus the position "
+                "flushed up to, -1 when not in the same binlog.");
+  append(out, "virtual_slave_bytes_behind_master %lld\n",
+         bytes_behind(flushed, flushed_to, heartbeat_file, heartbeat_pos));
+
+  append_header(out, "seconds_behind_master", "gauge",
+                "Arrival time of the last transaction minus its timestamp "
+                "on the master, 0 once a heartbeat shows all is in the binlog.");
+  append(out, "virtual_slave_seconds_behind_master %llu\n",
+         (ulonglong) load_relaxed(&lag_seconds));
+  append_header(out, "last_transaction_timestamp_seconds", "gauge",
+                "Timestamp on the master of the last transaction received.");
+  append(out, "virtual_slave_last_transaction_timestamp_seconds %llu\n",
+         (ulonglong) load_relaxed(&last_trx_when));
+
+  uint64 heartbeat= load_relaxed(&last_heartbeat);
+  append_header(out, "heartbeat_age_seconds", "gauge",
+                "Seconds since the last heartbeat, -1 before the first one.");
+  if (heartbeat)
+    append(out, "virtual_slave_heartbeat_age_seconds %llu\n",
+           (ulonglong) (now > heartbeat ? now - heartbeat : 0));
+  else
+    append(out, "virtual_slave_heartbeat_age_seconds -1\n");
+
+  append_header(out, "log_messages_dropped_total", "counter",
+                "Log messages dropped because the log queue was full.");
+  append(out, "virtual_slave_log_messages_dropped_total %llu\n",
+         error_log_dropped());
+}
+
+
+////////////////////////////////////////////////////////////
+//
+// HTTP
+//
+////////////////////////////////////////////////////////////
+
+static bool send_all(int fd, const char *buf, size_t len)
+{
+  while (len)
+  {
+    ssize_t sent= send(fd, buf, len, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+      return true;
+    buf+= sent;
+    len-= sent;
+  }
+  return false;
+}
+
+
+/**
+  Read the request head, up to the empty line.
+
+  @retval false  ok
+  @retval true   the scraper went away, timed out or sent too much
+*/
+static bool read_request(int fd, char *request, size_t size)
+{
+  size_t len= 0;
+  while (len < size - 1)
+  {
+    struct pollfd pfd;
+    pfd.fd= fd;
+    pfd.events= POLLIN;
+    if (poll(&pfd, 1, METRICS_IO_TIMEOUT_MS) <= 0)
+      return true;
+    ssize_t n= recv(fd, request + len, size - 1 - len, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return true;
+    len+= n;
+    request[len]= 0;
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+      return false;
+  }
+  return true;
+}
+
+
+static void serve_scrape(int fd)
+{
+  char request[METRICS_REQUEST_MAX];
+  string body;
+  const char *status= "200 OK";
+
+  if (read_request(fd, request, sizeof(request)))
+    return;
+  if (!strncmp(request, "GET /metrics ", 13) ||
+      !strncmp(request, "GET /metrics?", 13))
+    build_metrics(&body);
+  else
+  {
+    status= "404 Not Found";
+    body= "not found, try /metrics\n";
+  }
+
+  char head[256];
+  size_t head_len=
+    my_snprintf(head, sizeof(head),
+                "HTTP/1.0 %s\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %lu\r\n"
+                "Connection: close\r\n\r\n",
+                status, (ulong) body.size());
+  if (!send_all(fd, head, head_len))
+    send_all(fd, body.data(), body.size());
+}
+
+
+static void *listener_thread_func(void *)
+{
+  while (metrics_running)
+  {
+    /* shutdown() does not wake accept() on a Unix socket, poll instead */
+    struct pollfd pfd;
+    pfd.fd= listen_fd;
+    pfd.events= POLLIN;
+    if (poll(&pfd, 1, 1000) == 0)
+      continue;
+    int fd= accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (metrics_running)
+        sql_print_error("Metrics: accept failed, errno %d", errno);
+      break;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec= METRICS_IO_TIMEOUT_MS / 1000;
+    timeout.tv_usec= 0;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    /* scrapes are rare and short, they are answered one at a time */
+    serve_scrape(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+
+bool metrics_start(const char *bind_addr, uint port, const char *socket_path)
+{
+  int one= 1;
+
+  if (socket_path && *socket_path)
+  {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family= AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+      sql_print_error("Metrics: socket path '%s' is too long", socket_path);
+      return true;
+    }
+    strcpy(addr.sun_path, socket_path);
+    if ((listen_fd= socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+      sql_print_error("Metrics: could not create socket, errno %d", errno);
+      return true;
+    }
+    /* left over by a previous run */
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+        listen(listen_fd, 16))
+    {
+      sql_print_error("Metrics: could not listen on %s, errno %d",
+                      socket_path, errno);
+      close(listen_fd);
+      listen_fd= -1;
+      return true;
+    }
+    strncpy(socket_file, socket_path, FN_REFLEN);
+  }
+  else
+  {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family= AF_INET;
+    addr.sin_port= htons((uint16) port);
+    if (inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1)
+    {
+      sql_print_error("Metrics: invalid bind address '%s'", bind_addr);
+      return true;
+    }
+    if ((listen_fd= socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+      sql_print_error("Metrics: could not create socket, errno %d", errno);
+      return true;
+    }
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+        listen(listen_fd, 16))
+    {
+      sql_print_error("Metrics: could not listen on %s:%u, errno %d",
+                      bind_addr, port, errno);
+      close(listen_fd);
+      listen_fd= -1;
+      return true;
+    }
+  }
+
+  metrics_running= true;
+  if (pthread_create(&listener_thread, NULL, listener_thread_func, NULL))
+  {
+    sql_print_error("Metrics: could not create the listener thread");
+    metrics_running= false;
+    close(listen_fd);
+    listen_fd= -1;
+    return true;
+  }
+  if (socket_file[0])
+    sql_print_information("Metrics: listening on %s", socket_file);
+  else
+    sql_print_information("Metrics: listening on %s:%u", bind_addr, port);
+  return false;
+}
+
+
+void metrics_stop()
+{
+  if (!metrics_running)
+    return;
+  metrics_running= false;
+  pthread_join(listener_thread, NULL);
+  close(listen_fd);
+  listen_fd= -1;
+  if (socket_file[0])
+    unlink(socket_file);
+}
+
+
+bool metrics_enabled()
+{
+  return metrics_running;
+}
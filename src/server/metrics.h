@@ -0,0 +1,141 @@
+/**
+  @file
+
+  @brief
+  Prometheus metrics of the receive thread.
+
+  Lag is measured twice: in seconds, as the arrival time of the last
+  transaction minus its timestamp on the master, and in bytes, as the
+  position heartbeats carry minus the position flushed to the binlog up
+  to. Both read 0 once a heartbeat shows everything is in the binlog.
+  Events buffered by the receive thread (trx_buffer.h, catchup_mode.h)
+  still count as behind.
+
+  The counters are plain 64 bit words written with relaxed atomic
+  stores by a single writer, the receive thread or, for the fsync times
+  with a mirror (binlog_mirror.h), the thread doing the sync, and read
+  with relaxed loads by the metrics thread. Updating them costs the hot path a load
+  and a store, no lock and no locked instruction.
+
+  When metrics_port or metrics_socket is set, a thread answers
+
+    GET /metrics HTTP/1.x
+
+  on 127.0.0.1 (or metrics_bind) or on a Unix socket with the text
+  exposition format, one connection at a time. Metric names start with
+  virtual_slave_.
+*/
+
+#ifndef MYSQL_METRICS_H
+#define MYSQL_METRICS_H
+
+#include "my_global.h"
+
+/**
+  Start answering scrapes.
+
+  @param bind_addr    address to listen on with TCP
+  @param port         TCP port, 0 if socket_path is used
+  @param socket_path  Unix socket to listen on instead, may be empty
+
+  @retval false  listener thread started
+  @retval true   failure, the reason has been logged
+*/
+bool metrics_start(const char *bind_addr, uint port, const char *socket_path);
+
+/** Stop answering scrapes. */
+void metrics_stop();
+
+/**
+  true if metrics_start() succeeded, callers skip taking timestamps for
+  latencies otherwise.
+*/
+bool metrics_enabled();
+
+/**
+  An event arrived from the master.
+
+  @param event  the event, at least its common header
+  @param len    its full length
+*/
+void metrics_event_received(const uchar *event, size_t len);
+
+/**
+  A heartbeat arrived, the master has sent everything up to log_pos.
+  With the position written up to, it gives the bytes behind the master.
+
+  @param log_name  the binlog of the master, not null terminated, NULL
+                   if the heartbeat was malformed
+  @param name_len  its length
+  @param log_pos   position of the master in it
+*/
+void metrics_heartbeat_received(const char *log_name, size_t name_len,
+                                ulonglong log_pos);
+
+/**
+  A transaction was received completely.
+
+  @param has_gtid  true if it has a GTID, not an anonymous one
+  @param when      timestamp of its last event on the master, for the lag
+*/
+void metrics_transaction_received(bool has_gtid, uint32 when);
+
+/**
+  The binlog was fsync()ed, taking usec microseconds. With mirror_ack
+  first, only called by the binlog sync thread of the mirror.
+*/
+void metrics_fsync(ulonglong usec);
+
+/**
+  The mirror binlog was fsync()ed, taking usec microseconds. Only
+  called by the mirror thread.
+*/
+void metrics_mirror_fsync(ulonglong usec);
+
+/** A semi-sync ACK was sent usec microseconds after its event arrived. */
+void metrics_ack_sent(ulonglong usec);
+
+/** count ACKs were not sent, a later ACK covered their transactions. */
+void metrics_acks_merged(ulonglong count);
+
+/**
+  A compressed packet of packed_len bytes was inflated to inflated_len
+  bytes in usec microseconds.
+*/
+void metrics_decompressed(ulonglong packed_len, ulonglong inflated_len,
+                          ulonglong usec);
+
+/**
+  In catch-up mode (catchup_mode.h) or not, and bytes received in it
+  over usec microseconds since the previous call.
+*/
+void metrics_catchup(bool active, ulonglong bytes, ulonglong usec);
+
+/** The connection to the master was lost with MySQL error err. */
+void metrics_reconnect(uint err);
+
+/** Events up to pos in the master binlog log_name are written. */
+void metrics_position(const char *log_name, ulonglong pos);
+
+/**
+  The binlog log_name was flushed to the kernel up to pos, readers and
+  a sync see it. Called by the receive thread, or by an admin command
+  while the receive thread waits.
+*/
+void metrics_flushed(const char *log_name, ulonglong pos);
+
+/** Totals and lag, for the status command of the admin socket. */
+struct Metrics_summary
+{
+  ulonglong events;
+  ulonglong bytes;
+  ulonglong transactions;
+  ulonglong reconnects;
+  ulonglong seconds_behind;
+  /* -1 when the last heartbeat was for another binlog */
+  longlong bytes_behind;
+};
+
+void metrics_summary(Metrics_summary *summary);
+
+#endif //MYSQL_METRICS_H
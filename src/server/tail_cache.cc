@@ -0,0 +1,278 @@
+/**
+  @file
+
+  @brief
+  Tail cache, see tail_cache.h.
+
+  The ring is a byte buffer addressed by ever growing stream offsets,
+  ring_start is the oldest record still in it and ring_head where the
+  next one goes. A record is a Tail_cache_record followed by the event,
+  either may wrap around the end of the buffer.
+*/
+
+#include "tail_cache.h"
+#include "log/vs_log.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+/* how many binlog names the ring remembers, older records are unusable */
+static const uint TAIL_CACHE_NAMES= 64;
+/* a reader copies at most this much per call, then sends it */
+static const size_t TAIL_CACHE_READ_BATCH= 256 * 1024;
+
+struct Tail_cache_record
+{
+  uint32 event_len;
+  /* index into file_names, modulo TAIL_CACHE_NAMES */
+  uint32 file_no;
+  ulonglong end_pos;
+};
+
+static uchar *ring= NULL;
+static size_t ring_size= 0;
+static ulonglong ring_start= 0;
+static ulonglong ring_head= 0;
+
+static char file_names[TAIL_CACHE_NAMES][FN_REFLEN + 1];
+static uint32 current_file_no= 0;
+/* end of the newest record, the position of a reader at ring_head */
+static my_off_t current_end_pos= 0;
+
+static pthread_mutex_t cache_lock= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_cond= PTHREAD_COND_INITIALIZER;
+
+
+static void ring_put(ulonglong offset, const void *src, size_t len)
+{
+  size_t at= (size_t) (offset % ring_size);
+  size_t first= min(len, ring_size - at);
+  memcpy(ring + at, src, first);
+  memcpy(ring, (const uchar *) src + first, len - first);
+}
+
+
+static void ring_get(ulonglong offset, void *dst, size_t len)
+{
+  size_t at= (size_t) (offset % ring_size);
+  size_t first= min(len, ring_size - at);
+  memcpy(dst, ring + at, first);
+  memcpy((uchar *) dst + first, ring, len - first);
+}
+
+
+/**
+  Name of the binlog a record belongs to, NULL once the slot was reused.
+*/
+static const char *record_file_name(const Tail_cache_record *record)
+{
+  if (current_file_no - record->file_no >= TAIL_CACHE_NAMES)
+    return NULL;
+  return file_names[record->file_no % TAIL_CACHE_NAMES];
+}
+
+
+bool tail_cache_init(size_t size)
+{
+  if (!size)
+    return false;
+  if (!(ring= (uchar *) malloc(size)))
+  {
+    sql_print_error("Tail cache: could not allocate %lu bytes",
+                    (ulong) size);
+    return true;
+  }
+  ring_size= size;
+  sql_print_information("Tail cache: keeping the last %lu bytes of events",
+                        (ulong) size);
+  return false;
+}
+
+
+bool tail_cache_enabled()
+{
+  return ring != NULL;
+}
+
+
+void tail_cache_append(const char *log_name, my_off_t end_pos,
+                       const uchar *event, size_t len)
+{
+  Tail_cache_record record;
+  size_t record_size= sizeof(record) + len;
+
+  pthread_mutex_lock(&cache_lock);
+
+  if (strcmp(file_names[current_file_no % TAIL_CACHE_NAMES], log_name))
+  {
+    current_file_no++;
+    strncpy(file_names[current_file_no % TAIL_CACHE_NAMES], log_name,
+            FN_REFLEN);
+  }
+  current_end_pos= end_pos;
+
+  if (!event || record_size > ring_size)
+  {
+    /* Not kept or does not fit, readers in the ring go back to the files. */
+    ring_head+= record_size;
+    ring_start= ring_head;
+  }
+  else
+  {
+    while (ring_head + record_size - ring_start > ring_size)
+    {
+      Tail_cache_record oldest;
+      ring_get(ring_start, &oldest, sizeof(oldest));
+      ring_start+= sizeof(oldest) + oldest.event_len;
+    }
+    record.event_len= (uint32) len;
+    record.file_no= current_file_no;
+    record.end_pos= end_pos;
+    ring_put(ring_head, &record, sizeof(record));
+    ring_put(ring_head + sizeof(record), event, len);
+    ring_head+= record_size;
+  }
+
+  pthread_cond_broadcast(&cache_cond);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+
+bool tail_cache_seek(const char *log_name, my_off_t pos,
+                     Tail_cache_cursor *cursor)
+{
+  bool not_found= true;
+
+  if (!ring)
+    return true;
+
+  pthread_mutex_lock(&cache_lock);
+  for (ulonglong offset= ring_start; offset < ring_head;)
+  {
+    Tail_cache_record record;
+    ring_get(offset, &record, sizeof(record));
+    const char *name= record_file_name(&record);
+    if (name && record.end_pos - record.event_len == pos &&
+        !strcmp(name, log_name))
+    {
+      *cursor= offset;
+      not_found= false;
+      break;
+    }
+    offset+= sizeof(record) + record.event_len;
+  }
+  if (not_found && current_end_pos == pos &&
+      !strcmp(file_names[current_file_no % TAIL_CACHE_NAMES], log_name))
+  {
+    *cursor= ring_head;
+    not_found= false;
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return not_found;
+}
+
+
+enum_tail_cache_read tail_cache_read(Tail_cache_cursor *cursor,
+                                     uchar **buf, size_t *buf_size,
+                                     size_t *len, char *log_name,
+                                     my_off_t *pos, int timeout_ms)
+{
+  ulonglong head;
+  *len= 0;
+
+  pthread_mutex_lock(&cache_lock);
+  if (*cursor == ring_head)
+  {
+    struct timespec abstime;
+    clock_gettime(CLOCK_REALTIME, &abstime);
+    abstime.tv_sec+= timeout_ms / 1000;
+    abstime.tv_nsec+= (timeout_ms % 1000) * 1000000L;
+    if (abstime.tv_nsec >= 1000000000L)
+    {
+      abstime.tv_sec++;
+      abstime.tv_nsec-= 1000000000L;
+    }
+    while (*cursor == ring_head &&
+           pthread_cond_timedwait(&cache_cond, &cache_lock, &abstime) !=
+           ETIMEDOUT)
+    {}
+  }
+  head= ring_head;
+  bool lapped= *cursor < ring_start;
+  pthread_mutex_unlock(&cache_lock);
+
+  if (lapped)
+    return TAIL_CACHE_LAPPED;
+  if (*cursor == head)
+    return TAIL_CACHE_OK;
+
+  /*
+    The records up to head stay as they are until the writer moves
+    ring_start past them, copy them without the lock so the receive
+    thread never waits for a reader, and check ring_start afterwards.
+    A header read from a lapped record may be garbage, the size is
+    bounded by head and the copy thrown away below.
+  */
+  Tail_cache_record record;
+  size_t avail= (size_t) (head - *cursor);
+  ring_get(*cursor, &record, sizeof(record));
+  size_t copy= min(avail, max(TAIL_CACHE_READ_BATCH,
+                              sizeof(record) + record.event_len));
+  if (copy > *buf_size)
+  {
+    size_t new_size= max(copy, 2 * *buf_size);
+    uchar *new_buf= (uchar *) realloc(*buf, new_size);
+    if (!new_buf)
+    {
+      /* Let the reader go back to the files, they need no buffer. */
+      return TAIL_CACHE_LAPPED;
+    }
+    *buf= new_buf;
+    *buf_size= new_size;
+  }
+  ring_get(*cursor, *buf, copy);
+
+  /* Take the whole records of the copy whose binlog is still known. */
+  size_t used= 0;
+  pthread_mutex_lock(&cache_lock);
+  if (*cursor < ring_start)
+  {
+    pthread_mutex_unlock(&cache_lock);
+    return TAIL_CACHE_LAPPED;
+  }
+  const char *name= NULL;
+  while (used + sizeof(record) <= copy)
+  {
+    memcpy(&record, *buf + used, sizeof(record));
+    if (used + sizeof(record) + record.event_len > copy)
+      break;
+    const char *record_name= record_file_name(&record);
+    if (!record_name)
+      break;
+    name= record_name;
+    *pos= record.end_pos;
+    used+= sizeof(record) + record.event_len;
+  }
+  if (name && strcmp(log_name, name))
+    strcpy(log_name, name);
+  pthread_mutex_unlock(&cache_lock);
+
+  if (!used)
+    return TAIL_CACHE_LAPPED;
+
+  /* Drop the headers, each event moves down over the ones before. */
+  for (size_t offset= 0; offset < used;)
+  {
+    memcpy(&record, *buf + offset, sizeof(record));
+    memmove(*buf + *len, *buf + offset + sizeof(record), record.event_len);
+    *len+= record.event_len;
+    offset+= sizeof(record) + record.event_len;
+  }
+  *cursor+= used;
+  return TAIL_CACHE_OK;
+}
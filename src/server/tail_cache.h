@@ -0,0 +1,90 @@
+/**
+  @file
+
+  @brief
+  In-memory ring of the most recently received binlog events.
+
+  The receive thread appends every event it has written to the binlog.
+  Downstream readers that caught up with the files switch to the ring
+  and follow it with their own cursor, so serving the live tail to many
+  readers costs one memcpy per reader instead of a file read. A reader
+  that falls out of the window goes back to the files.
+*/
+
+#ifndef MYSQL_TAIL_CACHE_H
+#define MYSQL_TAIL_CACHE_H
+
+#include "my_global.h"
+
+/** Position of a reader in the ring, an offset in the stream of records. */
+typedef ulonglong Tail_cache_cursor;
+
+enum enum_tail_cache_read
+{
+  TAIL_CACHE_OK= 0,
+  /** the writer overwrote the position of the cursor */
+  TAIL_CACHE_LAPPED
+};
+
+/**
+  Allocate the ring.
+
+  @param size  ring size in bytes, 0 leaves the cache disabled
+
+  @retval false  ok
+  @retval true   out of memory
+*/
+bool tail_cache_init(size_t size);
+
+bool tail_cache_enabled();
+
+/**
+  Append an event the receive thread has just written.
+
+  @param log_name  binlog the event was written to
+  @param end_pos   offset in log_name right after the event
+  @param event     the event, NULL if it was not kept in memory, readers
+                   of the ring then go back to the files
+  @param len       length of the event
+*/
+void tail_cache_append(const char *log_name, my_off_t end_pos,
+                       const uchar *event, size_t len);
+
+/**
+  Find the record that starts at (log_name, pos).
+
+  The position right after the newest record is found as well, a reader
+  positioned there waits for the next append.
+
+  @retval false  found, *cursor is set
+  @retval true   the position is not in the window
+*/
+bool tail_cache_seek(const char *log_name, my_off_t pos,
+                     Tail_cache_cursor *cursor);
+
+/**
+  Copy events from the cursor on, waiting up to timeout_ms when the
+  reader is at the head of the ring.
+
+  At least one whole event is copied if there is one, *buf grows as
+  needed. On return log_name and pos are where the reader is in the
+  binlogs after the copied events.
+
+  @param[in,out] cursor    reader position
+  @param[in,out] buf       copy buffer, allocated with malloc
+  @param[in,out] buf_size  size of *buf
+  @param[out] len          bytes copied, 0 on timeout
+  @param[in,out] log_name  binlog of the reader
+  @param[in,out] pos       offset in log_name of the reader
+  @param timeout_ms        how long to wait for new events
+
+  @retval TAIL_CACHE_OK      ok
+  @retval TAIL_CACHE_LAPPED  the cursor fell out of the window, log_name
+                             and pos are still valid for reading files
+*/
+enum_tail_cache_read tail_cache_read(Tail_cache_cursor *cursor,
+                                     uchar **buf, size_t *buf_size,
+                                     size_t *len, char *log_name,
+                                     my_off_t *pos, int timeout_ms);
+
+#endif //MYSQL_TAIL_CACHE_H
@@ -34,6 +34,24 @@ using std::string;
 #include "virtual_slave.h"
 #include "Config/Config.h"
 #include "log/vs_log.h"
+#include "server/binlog_server.h"
+#include "server/tail_cache.h"
+#include "server/metrics.h"
+#include "server/admin_socket.h"
+#include "gtid/gtid_index.h"
+#include "binlog/binlog_file.h"
+#include "binlog/binlog_compress.h"
+#include "binlog/binlog_checksum.h"
+#include "binlog/binlog_raw.h"
+#include "binlog/dump_stream.h"
+#include "binlog/trx_buffer.h"
+#include "gtid/received_gtid_set.h"
+#include "gtid/gtid_text_parser.h"
+#include "master/master_reconnect.h"
+#include "master/master_tuning.h"
+#include "master/peer_catchup.h"
+#include "binlog/binlog_mirror.h"
+#include "binlog/catchup_mode.h"
 
 /*
   error() is used in macro BINLOG_ERROR which is invoked in
@@ -57,6 +75,8 @@ static void warning(const char *format, ...)
 #include <algorithm>
 #include <utility>
 #include <map>
+#include <vector>
+#include <fstream>
 
 using std::min;
 using std::max;
@@ -193,6 +213,33 @@ Sid_map *global_sid_map= NULL;
 Checkable_rwlock *global_sid_lock= NULL;
 Gtid_set *gtid_set_included= NULL;
 Gtid_set *gtid_set_excluded= NULL;
+/*
+  GTIDs of the transactions received completely since the last
+  COM_BINLOG_DUMP_GTID, and the GTID of the one being received. The
+  older ones are in gtid_set_excluded.
+*/
+static Received_gtid_set received_gtids;
+static uchar pending_gtid_sid[RECEIVED_GTID_SID_LEN];
+static longlong pending_gtid_gno= 0;
+static bool pending_gtid= false;
+/*
+  The last COM_BINLOG_DUMP_GTID sent, reused on reconnect until
+  gtid_set_excluded or received_gtids change.
+*/
+static uchar *dump_gtid_command= NULL;
+static size_t dump_gtid_command_size= 0;
+static bool dump_gtid_command_stale= true;
+/*
+  The transaction being received, see trx_buffer.h. Once written, its
+  events wait in trx_buffer until they are published to the binlog
+  server, trx_buffer_written is then set.
+*/
+static Trx_buffer trx_buffer;
+static bool trx_buffering= false;
+static bool trx_buffer_written= false;
+static unsigned long long trx_buffer_log_pos= 0;
+static my_off_t trx_buffer_end_pos= 0;
+static char trx_buffer_log_name[FN_REFLEN + 1];
 
 
 /**
@@ -203,6 +250,15 @@ Gtid_set *gtid_set_excluded= NULL;
 */
 static Format_description_log_event* glob_description_event= NULL;
 
+/*
+  Body of the FDE glob_description_event was built from, without its
+  create time and checksum, so an FDE that only starts a new binlog of
+  the same server is recognized without constructing it. Emptied when
+  glob_description_event is replaced by anything else.
+*/
+static uchar description_event_body[256];
+static size_t description_event_body_len= 0;
+
 /**
   Exit status for functions in this file.
 */
@@ -332,6 +388,8 @@ static void cleanup()
   {
     free(opt_exclude_gtids_str);
   }
+  my_free(dump_gtid_command);
+  dump_stream_end();
 
 
   for (size_t i= 0; i < buff_ev->size(); i++)
@@ -363,10 +421,9 @@ static Exit_status safe_connect()
   */
   if(mysql)
   {
-    if(mysql_ping(mysql) ==0 )
-    {
-      mysql_close(mysql);
-    }
+    //dead or alive, pinging an old master would only delay the attempt
+    mysql_close(mysql);
+    mysql= NULL;
   }
 
   mysql= mysql_init(NULL);
@@ -393,6 +450,9 @@ static Exit_status safe_connect()
   }
   int opt_connect_timeout=2;
   mysql_options(mysql,MYSQL_OPT_CONNECT_TIMEOUT,&opt_connect_timeout);
+  //used only if the master supports it, dump_stream.h inflates the dump
+  if(master_compress)
+    mysql_options(mysql,MYSQL_OPT_COMPRESS,NULL);
 #if defined (_WIN32) && !defined (EMBEDDED_LIBRARY)
   if (shared_memory_base_name)
     mysql_options(mysql, MYSQL_SHARED_MEMORY_BASE_NAME,
@@ -404,11 +464,14 @@ static Exit_status safe_connect()
   mysql_options4(mysql, MYSQL_OPT_CONNECT_ATTR_ADD,
                 "_client_role", "binary_log_listener");
 
-  if (!mysql_real_connect(mysql, host, user, pass, 0, port, sock, 0))
+  /* multi statements for the batched setup, see setup_dump_session() */
+  if (!mysql_real_connect(mysql, host, user, pass, 0, port, sock,
+                          CLIENT_MULTI_STATEMENTS))
   {
     sql_print_error("Failed on connect: %s", mysql_error(mysql));
     return ERROR_STOP;
   }
+  master_tuning_apply(mysql);
   mysql->reconnect= 1;
   return OK_CONTINUE;
 }
@@ -514,43 +577,24 @@ static Exit_status dump_multiple_logs(int argc, char **argv)
 static Exit_status check_master_version()
 {
   DBUG_ENTER("check_master_version");
-  MYSQL_RES* res = 0;
-  MYSQL_ROW row;
-  const char* version;
+  /* From the handshake, no need for a SELECT VERSION() round trip. */
+  const char* version= mysql_get_server_info(mysql);
 
-  if (mysql_query(mysql, "SELECT VERSION()") ||
-      !(res = mysql_store_result(mysql)))
+  if (!version || !*version)
   {
     sql_print_error("Could not find server version: "
-          "Query failed when checking master version: %s", mysql_error(mysql));
+          "Master reported no version in the handshake.");
     DBUG_RETURN(ERROR_STOP);
   }
-  if (!(row = mysql_fetch_row(res)))
-  {
-    sql_print_error("Could not find server version: "
-          "Master returned no rows for SELECT VERSION().");
-    goto err;
-  }
-
-  if (!(version = row[0]))
-  {
-    sql_print_error("Could not find server version: "
-          "Master reported NULL for the version.");
-    goto err;
-  }
   /* 
      Make a notice to the server that this client
      is checksum-aware. It does not need the first fake Rotate
      necessary checksummed. 
-     That preference is specified below.
+     That preference is set by setup_dump_session().
   */
-  if (mysql_query(mysql, "SET @master_binlog_checksum='NONE'"))
-  {
-    sql_print_error("Could not notify master about checksum awareness."
-          "Master returned '%s'", mysql_error(mysql));
-    goto err;
-  }
   delete glob_description_event;
+  //the FDE the master sends next has to replace the placeholder
+  description_event_body_len= 0;
   switch (*version) {
   case '3':
     glob_description_event= new Format_description_log_event(1);
@@ -571,20 +615,15 @@ static Exit_status check_master_version()
     glob_description_event= NULL;
     sql_print_error("Could not find server version: "
           "Master reported unrecognized MySQL version '%s'.", version);
-    goto err;
+    DBUG_RETURN(ERROR_STOP);
   }
   if (!glob_description_event || !glob_description_event->is_valid())
   {
     sql_print_error("Failed creating Format_description_log_event; out of memory?");
-    goto err;
+    DBUG_RETURN(ERROR_STOP);
   }
 
-  mysql_free_result(res);
   DBUG_RETURN(OK_CONTINUE);
-
-err:
-  mysql_free_result(res);
-  DBUG_RETURN(ERROR_STOP);
 }
 
 
@@ -613,6 +652,865 @@ typedef struct Binlog_relay_IO_param {
 
 Binlog_relay_IO_param* binlogRelayIoParam;
 
+/**
+  Verify the checksum of a received event with binlog_crc32(), the
+  events are then constructed without read_log_event() checking again.
+
+  @retval false  ok, or verification is off
+  @retval true   checksum mismatch
+*/
+static bool event_checksum_failed(const char *event_buf, ulong len,
+                                  Log_event_type type)
+{
+  if (!opt_verify_binlog_checksum)
+    return false;
+  binary_log::enum_binlog_checksum_alg alg=
+    type == binary_log::FORMAT_DESCRIPTION_EVENT ?
+    raw_fde_checksum_alg((const uchar*)event_buf,len) :
+    glob_description_event->common_footer->checksum_alg;
+  return binlog_event_checksum_failed((const uchar*)event_buf,len,alg);
+}
+
+/**
+  true unless the length in the common header of a received event
+  disagrees with the packet. Events are not constructed, this is all the
+  checking they get besides their checksum.
+*/
+static bool event_len_valid(const char *event_buf, ulong len)
+{
+  return len >= LOG_EVENT_HEADER_LEN &&
+    raw_event_len((const uchar*)event_buf) == len;
+}
+
+/**
+  Make a received FORMAT_DESCRIPTION_EVENT the description of the events
+  that follow. Each binlog starts with one, they differ in their create
+  time only as long as the master is not upgraded, so the current
+  description is kept when the rest matches.
+
+  @param print_event_info  gets the common header length
+  @param event_buf         the FDE
+  @param len               its length
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool update_description_event(PRINT_EVENT_INFO *print_event_info,
+                                     const char *event_buf, ulong len)
+{
+  const uchar *event= (const uchar*)event_buf;
+  const char *error_msg= NULL;
+  size_t body_len= 0;
+  /* create time sits between the server version and the header length */
+  const size_t time_offset= RAW_FDE_CREATE_TIME_OFFSET - LOG_EVENT_HEADER_LEN;
+
+  if(len >= RAW_FDE_CREATE_TIME_OFFSET + 4)
+    body_len= raw_event_data_len(len,raw_fde_checksum_alg(event,len)) -
+      LOG_EVENT_HEADER_LEN;
+  bool cacheable= body_len >= time_offset + 4 &&
+    body_len <= sizeof(description_event_body);
+  const uchar *body= event + LOG_EVENT_HEADER_LEN;
+
+  if(cacheable && body_len == description_event_body_len &&
+     !memcmp(body,description_event_body,time_offset) &&
+     !memcmp(body + time_offset + 4,description_event_body + time_offset + 4,
+             body_len - time_offset - 4))
+    return false;
+
+  Log_event *ev= Log_event::read_log_event(event_buf,len,&error_msg,
+                                           glob_description_event,false);
+  if(!ev || ev->get_type_code() != binary_log::FORMAT_DESCRIPTION_EVENT)
+  {
+    sql_print_error("Could not construct format description event: %s",
+                    ev ? "wrong type" : error_msg);
+    delete ev;
+    return true;
+  }
+  delete glob_description_event;
+  glob_description_event= (Format_description_log_event*) ev;
+  print_event_info->common_header_len= glob_description_event->common_header_len;
+
+  description_event_body_len= 0;
+  if(cacheable)
+  {
+    memcpy(description_event_body,body,body_len);
+    description_event_body_len= body_len;
+  }
+  return false;
+}
+
+/**
+  Add the GTID of a transaction to received_gtids once its last event
+  has been written, a transaction cut by a reconnect is not counted.
+*/
+static void track_received_gtid(const char *event_buf, ulong len,
+                                Log_event_type type)
+{
+  const uchar *event= (const uchar*)event_buf;
+  switch(type)
+  {
+    case binary_log::GTID_LOG_EVENT:
+      pending_gtid= len >= RAW_GTID_MIN_LEN;
+      if(pending_gtid)
+      {
+        memcpy(pending_gtid_sid,raw_gtid_sid(event),RECEIVED_GTID_SID_LEN);
+        pending_gtid_gno= raw_gtid_gno(event);
+      }
+      break;
+    case binary_log::ANONYMOUS_GTID_LOG_EVENT:
+      pending_gtid= false;
+      break;
+    default:
+      if(raw_event_ends_transaction(event,len,
+                                    glob_description_event->common_footer->checksum_alg))
+      {
+        metrics_transaction_received(pending_gtid,raw_event_when(event));
+        if(pending_gtid)
+          received_gtids.add(pending_gtid_sid,pending_gtid_gno);
+        pending_gtid= false;
+      }
+      break;
+  }
+}
+
+/**
+  A heartbeat tells where the master is, for the lag in bytes.
+*/
+static void heartbeat_received(const char *event_buf, ulong len)
+{
+  size_t name_len= 0;
+  const char *name= NULL;
+  if(len >= LOG_EVENT_HEADER_LEN)
+    name= raw_heartbeat_log_name((const uchar*)event_buf,len,
+                                 glob_description_event->common_footer->checksum_alg,
+                                 &name_len);
+  metrics_heartbeat_received(name,name_len,
+                             name ? raw_event_log_pos((const uchar*)event_buf) : 0);
+}
+
+/**
+  Add a Received_gtid_set to a Gtid_set of global_sid_map, the caller
+  holds global_sid_lock for writing.
+
+  @retval false ok
+  @retval true  out of memory or a bad encoding
+*/
+static bool merge_received_gtids(Gtid_set *gtid_set,
+                                 const Received_gtid_set &gtids)
+{
+  if(gtids.is_empty())
+    return false;
+  size_t encoded_len= gtids.get_encoded_length();
+  uchar *encoded= (uchar*) my_malloc(PSI_NOT_INSTRUMENTED,encoded_len,MYF(MY_WME));
+  if(!encoded)
+    return true;
+  gtids.encode(encoded);
+  bool failed= gtid_set->add_gtid_encoding(encoded,encoded_len) != RETURN_STATUS_OK;
+  my_free(encoded);
+  return failed;
+}
+
+/**
+  Point host and port to the best candidate master, they are left alone
+  when no candidate is writable.
+*/
+static void choose_master()
+{
+  Master_address chosen;
+  uint probe_timeout= 2;
+
+  if(master_reconnect_choose(user,pass,probe_timeout,&chosen))
+  {
+    sql_print_warning("No writable master candidate, trying %s:%d",host,port);
+    return;
+  }
+  if((int)chosen.port == port && !strcmp(chosen.host,host))
+    return;
+  sql_print_information("Master moved from %s:%d to %s:%u",
+                        host,port,chosen.host,chosen.port);
+  delete[] host;
+  host= string_to_char(chosen.host);
+  port= (int)chosen.port;
+}
+
+/* bytes kept of an event written by receive_streamed_event() */
+#define STREAMED_HEAD_LEN (LOG_EVENT_HEADER_LEN + RAW_QUERY_HEADER_LEN)
+
+/**
+  Write an event that spans several protocol packets to result_file as
+  the packets arrive, see dump_stream.h, verifying its checksum on the
+  way. On error the part already written is cut off again, the binlog
+  ends with the previous event.
+
+  @param event      the start of the event, in the first protocol packet
+  @param first_len  bytes of the event in the first protocol packet
+  @param[out] lost  true if reading failed, the caller reconnects
+
+  @retval false ok
+  @retval true  error, logged unless lost
+*/
+static bool receive_streamed_event(const uchar *event, ulong first_len,
+                                   bool *lost)
+{
+  bool verify= opt_verify_binlog_checksum &&
+    glob_description_event->common_footer->checksum_alg ==
+    binary_log::BINLOG_CHECKSUM_ALG_CRC32;
+  my_off_t start_pos= my_ftell(result_file,MYF(0));
+  ulonglong event_len, data_len, received= 0;
+  uint32 crc= 0;
+  uchar stored_crc[BINLOG_CHECKSUM_LEN];
+  const uchar *chunk= event;
+  size_t chunk_len= first_len;
+  /* event is overwritten by the next protocol packet */
+  int type= event[EVENT_TYPE_OFFSET];
+
+  *lost= false;
+  if(first_len < LOG_EVENT_HEADER_LEN)
+  {
+    sql_print_error("Event header split over protocol packets");
+    return true;
+  }
+  event_len= raw_event_len(event);
+  data_len= event_len - (verify ? BINLOG_CHECKSUM_LEN : 0);
+  if(event_len < first_len || event_len < LOG_EVENT_HEADER_LEN + BINLOG_CHECKSUM_LEN)
+  {
+    sql_print_error("Event length %llu does not match the packet",event_len);
+    return true;
+  }
+
+  for(;;)
+  {
+    if(received + chunk_len > event_len)
+    {
+      sql_print_error("Event longer than its length %llu",event_len);
+      goto err;
+    }
+    if(verify)
+    {
+      size_t crc_part= received >= data_len ? 0 :
+        (size_t) std::min((ulonglong) chunk_len,data_len - received);
+      crc= binlog_crc32(crc,chunk,crc_part);
+      for(size_t i= crc_part; i < chunk_len; i++)
+        stored_crc[received + i - data_len]= chunk[i];
+    }
+    if(my_fwrite(result_file,chunk,chunk_len,MYF(MY_NABP)))
+    {
+      sql_print_error("Could not write into log file '%s'",new_binlog_file_name);
+      goto err;
+    }
+    binlog_mirror_write(chunk,chunk_len);
+    received+= chunk_len;
+    if(!dump_stream_more())
+      break;
+    if(dump_stream_next(mysql,&chunk,&chunk_len))
+    {
+      *lost= true;
+      goto err;
+    }
+  }
+
+  if(received != event_len)
+  {
+    sql_print_error("Event shorter than its length %llu",event_len);
+    goto err;
+  }
+  if(verify && crc != uint4korr(stored_crc))
+  {
+    sql_print_error("Event crc check failed, event type %d, event len: %llu",
+                    type,event_len);
+    goto err;
+  }
+  return false;
+
+err:
+  if(fflush(result_file) ||
+     ftruncate(fileno(result_file),start_pos) ||
+     my_fseek(result_file,start_pos,MY_SEEK_SET,MYF(0)) == MY_FILEPOS_ERROR)
+    sql_print_error("Could not cut the partial event off '%s'",new_binlog_file_name);
+  binlog_mirror_truncate(start_pos);
+  return true;
+}
+
+/**
+  Write the buffered transaction to result_file.
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool flush_trx_buffer()
+{
+  if(trx_buffer.is_empty() || trx_buffer_written)
+    return false;
+  if(my_fwrite(result_file,trx_buffer.data(),trx_buffer.length(),MYF(MY_NABP)))
+  {
+    sql_print_error("Could not write into log file '%s'",new_binlog_file_name);
+    return true;
+  }
+  binlog_mirror_write(trx_buffer.data(),trx_buffer.length());
+  respond_pos= trx_buffer_log_pos;
+  trx_buffer_end_pos= my_ftell(result_file,MYF(0));
+  my_stpcpy(trx_buffer_log_name,new_binlog_file_name);
+  trx_buffer_written= true;
+  return false;
+}
+
+/**
+  fflush() result_file, what it held is then in the binlog as far as
+  the bytes behind the master go, see metrics.h.
+
+  @return 0 or EOF, as fflush()
+*/
+static int flush_result_file()
+{
+  if(fflush(result_file))
+    return EOF;
+  metrics_flushed(new_binlog_file_name,respond_pos);
+  return 0;
+}
+
+/**
+  Publish events written to the binlog to the binlog server and the tail
+  cache.
+
+  @param log_name     the binlog they were written to
+  @param events       the events, back to back, NULL for a streamed one
+  @param len          their length
+  @param end_pos      offset in log_name after the last one
+  @param new_binlog   true for the FDE that starts a binlog
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool publish_events(const char *log_name, const uchar *events,
+                           size_t len, my_off_t end_pos, bool new_binlog)
+{
+  if(tail_cache_enabled())
+  {
+    my_off_t start_pos= end_pos - len;
+    size_t pos= 0;
+    if(!events)
+      tail_cache_append(log_name,end_pos,NULL,len);
+    while(events && pos + LOG_EVENT_HEADER_LEN <= len)
+    {
+      uint32 event_len= raw_event_len(events + pos);
+      if(event_len < LOG_EVENT_HEADER_LEN || pos + event_len > len)
+        break;
+      tail_cache_append(log_name,start_pos + pos + event_len,events + pos,
+                        event_len);
+      pos+= event_len;
+    }
+  }
+  /*
+    Readers reading the binlog itself sendfile() from it, so the event
+    has to reach the kernel before it is published to them. With the
+    tail cache that is only needed when one of them is waiting, or
+    when a new binlog starts and readers must see the old one closed.
+    In catch-up mode it is published when it is synced, see
+    catchup_event_written().
+  */
+  if(new_binlog ||
+     (!catchup_mode_active() &&
+      (!tail_cache_enabled() || binlog_server_tail_wanted())))
+  {
+    if(flush_result_file())
+    {
+      sql_print_error("fflush file %s failed",log_name);
+      return true;
+    }
+    binlog_server_update_tail(log_name,end_pos);
+  }
+  return false;
+}
+
+/**
+  Publish the transaction flush_trx_buffer() wrote, if any, and empty
+  trx_buffer.
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool publish_trx_buffer()
+{
+  if(!trx_buffer_written)
+    return false;
+  if(binlog_server_enabled() &&
+     publish_events(trx_buffer_log_name,trx_buffer.data(),trx_buffer.length(),
+                    trx_buffer_end_pos,false))
+    return true;
+  trx_buffer.clear();
+  trx_buffer_written= false;
+  return false;
+}
+
+/**
+  Write an event to result_file. The events of a transaction, from its
+  GTID event to its last event, are collected in trx_buffer and written
+  at once, unless they grow over trx_buffer_size_kb: the transaction is
+  then written as it comes from there on.
+
+  @param event          the event
+  @param len            its length
+  @param type           its type
+  @param log_pos        its end in the master binlog
+  @param[out] buffered  true if the event went through trx_buffer, the
+                        binlog server learns of it with the transaction
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool write_event(const uchar *event, ulong len, Log_event_type type,
+                        unsigned long long log_pos, bool *buffered)
+{
+  *buffered= false;
+  if(trx_buffer_size_kb && len)
+  {
+    if(type == binary_log::GTID_LOG_EVENT ||
+       type == binary_log::ANONYMOUS_GTID_LOG_EVENT)
+    {
+      //a transaction left without its end, write it and start over
+      if(flush_trx_buffer() || publish_trx_buffer())
+        return true;
+      trx_buffering= true;
+    }
+    if(trx_buffering)
+    {
+      if(!trx_buffer_written &&
+         trx_buffer.length() + len <= (size_t) trx_buffer_size_kb << 10 &&
+         !trx_buffer.append(event,len))
+      {
+        *buffered= true;
+        trx_buffer_log_pos= log_pos;
+        if(!semi_sync_need_reply &&
+           !raw_event_ends_transaction(event,len,
+                                       glob_description_event->common_footer->checksum_alg))
+          return false;
+        trx_buffering= false;
+        return flush_trx_buffer();
+      }
+      //too large, the rest of the transaction goes straight to the file
+      trx_buffering= false;
+      if(flush_trx_buffer())
+        return true;
+    }
+  }
+  if(my_fwrite(result_file,event,len,MYF(MY_NABP)))
+  {
+    sql_print_error("Could not write into log file '%s'",new_binlog_file_name);
+    return true;
+  }
+  binlog_mirror_write(event,len);
+  return false;
+}
+
+/*
+  When the semi-sync ACK of a transaction is sent, set by ack_policy or,
+  without it, by fsync_mode.
+
+  Except with ACK_ON_RECEIVE, the ACK of a transaction is held back while
+  the next packet is already here to read, so a group of transactions
+  the master committed together gets one ACK, and one sync, once the
+  last of them is written. ACKs are cumulative, the master releases all
+  transactions up to the position acknowledged.
+*/
+enum Ack_policy
+{
+  /* on arrival, before the transaction is written */
+  ACK_ON_RECEIVE= 0,
+  /* once written to the page cache */
+  ACK_AFTER_WRITE,
+  /* once fdatasync()ed */
+  ACK_AFTER_FDATASYNC,
+  /*
+    once fdatasync()ed, the ACK is also held back while the next packet
+    is only partly here, for larger groups
+  */
+  ACK_AFTER_GROUP_SYNC
+};
+
+static const char *ack_policy_names[]=
+{ "receive", "write", "fdatasync", "group" };
+
+static Ack_policy ack_policy= ACK_AFTER_WRITE;
+
+/* longest an ACK is held back, under a steady stream the socket never drains */
+static const ulonglong ACK_HOLD_MAX_USEC= 1000;
+
+/*
+  An ACK held back for the position in binlogRelayIoParam, since when,
+  for an event that arrived when and for how many events asking for one.
+*/
+static bool ack_owed= false;
+static ulonglong ack_owed_since= 0;
+static ulonglong ack_owed_arrival= 0;
+static ulonglong ack_owed_events= 0;
+
+/**
+  Parse an ack_policy name.
+
+  @retval false ok
+  @retval true  unknown name
+*/
+static bool parse_ack_policy(const char *name, Ack_policy *policy)
+{
+  for(uint i= 0; i < array_elements(ack_policy_names); i++)
+  {
+    if(!strcmp(name,ack_policy_names[i]))
+    {
+      *policy= (Ack_policy) i;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+  Close result_file, flushing what it buffers, and open log_name as
+  result_file with binlog_file_open_mode.
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool open_result_file(const char *log_name)
+{
+  MY_STAT st;
+  if(result_file && result_file != stdout)
+  {
+    binlog_mirror_close();
+    my_fclose(result_file,MYF(0));
+    result_file= NULL;
+  }
+  if(!(result_file= my_fopen(log_name,binlog_file_open_mode,MYF(MY_WME))))
+  {
+    sql_print_error("Could not create log file '%s'",log_name);
+    return true;
+  }
+  binlog_file_set_active(log_name);
+  //large writes in catch-up mode, see catchup_mode.h
+  if(catchup_mode_enabled() &&
+     setvbuf(result_file,NULL,_IOFBF,CATCHUP_WRITE_BUFFER_SIZE))
+    sql_print_warning("Could not set the buffer of log file '%s'",log_name);
+  if(!binlog_mirror_enabled() && !binlog_server_enabled())
+    return false;
+  if(my_fstat(fileno(result_file),&st,MYF(0)))
+  {
+    sql_print_error("stat of %s failed, errno %d, it is not mirrored "
+                    "nor published",log_name,errno);
+    return false;
+  }
+  //the mirror (binlog_mirror.h) starts from what the binlog already holds
+  if(binlog_mirror_enabled())
+    binlog_mirror_open(log_name,(my_off_t) st.st_size);
+  /*
+    Readers of the binlog server take any binlog that is not the tail
+    for a closed one, publish it before the first event arrives.
+  */
+  if(binlog_server_enabled())
+    binlog_server_update_tail(log_name,(my_off_t) st.st_size);
+  return false;
+}
+
+/**
+  Make what is written to result_file durable, as far as ack_policy
+  asks for before an ACK.
+
+  @param measure  true to time the sync for the metrics
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool sync_for_ack(bool measure)
+{
+  if(flush_result_file())
+  {
+    sql_print_error("fflush file %s failed",new_binlog_file_name);
+    return true;
+  }
+  if(ack_policy < ACK_AFTER_FDATASYNC)
+    return false;
+  if(binlog_mirror_enabled())
+    return binlog_mirror_sync(fileno(result_file),measure);
+  ulonglong sync_start= measure ? my_micro_time() : 0;
+  //the size is synced with the data, nothing else is needed to read it back
+  if(fdatasync(fileno(result_file)))
+  {
+    sql_print_error("Sync file %s failed",new_binlog_file_name);
+    return true;
+  }
+  if(sync_start)
+    metrics_fsync(my_micro_time() - sync_start);
+  return false;
+}
+
+/**
+  Send the ACK for the position in binlogRelayIoParam.
+
+  @param arrival  when the first event it acknowledges arrived, 0
+                  without metrics
+*/
+static void send_ack(ulonglong arrival)
+{
+  handle_repl_semi_slave_send_reply((void*)binlogRelayIoParam);
+  if(arrival && rpl_semi_sync_slave_status)
+    metrics_ack_sent(my_micro_time() - arrival);
+}
+
+/**
+  Send the ACK held back, after syncing.
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool send_owed_ack()
+{
+  if(!ack_owed)
+    return false;
+  ack_owed= false;
+  if(sync_for_ack(ack_owed_arrival != 0))
+    return true;
+  send_ack(ack_owed_arrival);
+  metrics_acks_merged(ack_owed_events - 1);
+  return false;
+}
+
+/**
+  The event just written asks for an ACK, it is owed from now on and
+  sent by flush_owed_ack().
+
+  @param arrival  when it arrived, 0 without metrics
+*/
+static void ack_event(ulonglong arrival)
+{
+  handle_repl_semi_slave_defer_reply((void*)binlogRelayIoParam);
+  if(!ack_owed)
+  {
+    ack_owed= true;
+    ack_owed_since= my_micro_time();
+    ack_owed_arrival= arrival;
+    ack_owed_events= 0;
+  }
+  ack_owed_events++;
+}
+
+/**
+  Send the ACK owed unless the next packet can be read right away, the
+  ACK of what it brings will cover this one too. It is held back at most
+  ACK_HOLD_MAX_USEC.
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool flush_owed_ack()
+{
+  if(!ack_owed)
+    return false;
+  bool more;
+  if(ack_policy == ACK_AFTER_GROUP_SYNC)
+    more= dump_stream_pending(mysql);
+  else
+    more= ack_policy != ACK_ON_RECEIVE && dump_stream_ready(mysql);
+  if(more && my_micro_time() - ack_owed_since < ACK_HOLD_MAX_USEC)
+    return false;
+  return send_owed_ack();
+}
+
+/**
+  Flush the binlog in catch-up mode, sync it unless catchup_sync_mb is
+  0, and publish it to the binlog server.
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool catchup_sync()
+{
+  if(flush_result_file())
+  {
+    sql_print_error("fflush file %s failed",new_binlog_file_name);
+    return true;
+  }
+  if(catchup_sync_mb)
+  {
+    if(binlog_mirror_enabled())
+    {
+      if(binlog_mirror_sync(fileno(result_file),false))
+        return true;
+    }
+    else if(fdatasync(fileno(result_file)))
+    {
+      sql_print_error("Sync file %s failed",new_binlog_file_name);
+      return true;
+    }
+  }
+  if(binlog_server_enabled())
+    binlog_server_update_tail(new_binlog_file_name,my_ftell(result_file,MYF(0)));
+  catchup_synced(my_micro_time());
+  return false;
+}
+
+/**
+  An event was written: switch between catch-up and tail mode, see
+  catchup_mode.h, and at the end of a transaction flush the binlog as
+  the mode asks for.
+
+  @param event_buf  the event, only its head if it was streamed
+  @param len        its length
+  @param streamed   true if it was streamed
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool catchup_event_written(const char *event_buf, ulong len,
+                                  bool streamed)
+{
+  catchup_received(len);
+  if(semi_sync_need_reply && rpl_semi_sync_slave_status &&
+     catchup_at_tail("the master waits for a semi-sync ACK",
+                     my_micro_time()) == CATCHUP_LEFT)
+    return catchup_sync();
+  if(streamed || len < LOG_EVENT_HEADER_LEN ||
+     !raw_event_ends_transaction((const uchar*)event_buf,len,
+                                 glob_description_event->common_footer->checksum_alg))
+    return false;
+  ulonglong now= my_micro_time();
+  switch(catchup_transaction(raw_event_when((const uchar*)event_buf),now))
+  {
+  case CATCHUP_LEFT:
+    return catchup_sync();
+  case CATCHUP_ENTERED:
+    return false;
+  case CATCHUP_UNCHANGED:
+    break;
+  }
+  if(catchup_mode_active())
+    return catchup_sync_due(now) && catchup_sync();
+  //at the tail, the transaction reaches the kernel right away
+  if(flush_result_file())
+  {
+    sql_print_error("fflush file %s failed",new_binlog_file_name);
+    return true;
+  }
+  return false;
+}
+
+/**
+  In catch-up mode, wait for the next event at most until the binlog is
+  due for a sync. If none arrives, the master has nothing left to send:
+  catch-up mode ends and the binlog is synced and published, it is not
+  left in the stdio buffer while the master is idle.
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool catchup_wait_event()
+{
+  ulonglong now= my_micro_time();
+  if(catchup_sync_deadline() <= now)
+  {
+    //overdue, a whole interval is waited for from now on
+    if(catchup_sync())
+      return true;
+    now= my_micro_time();
+  }
+  int timeout_ms= (int) ((catchup_sync_deadline() - now + 999) / 1000);
+  admin_state_release();
+  bool arrived= dump_stream_wait(mysql,timeout_ms);
+  admin_state_acquire();
+  if(arrived)
+    return false;
+  catchup_at_tail("no event arrived before the binlog was due for a sync",
+                  my_micro_time());
+  return catchup_sync();
+}
+
+/* when the current connection attempt started, 0 once it delivered */
+static ulonglong reconnect_start_time= 0;
+
+/**
+  Log how long the master was unreachable for the receive thread, from
+  the start of the connection attempt to the first packet of the dump.
+*/
+static inline void log_time_to_first_event()
+{
+  if(!reconnect_start_time)
+    return;
+  sql_print_information("first event received %llu ms after connecting",
+                        (my_micro_time() - reconnect_start_time) / 1000);
+  reconnect_start_time= 0;
+}
+
+/**
+  Build the COM_BINLOG_DUMP_GTID command into dump_gtid_command.
+
+  While nothing was received since the last request, the encoded GTID
+  set is reused as it is and reconnecting takes no lock. Otherwise the
+  received GTIDs are moved to gtid_set_excluded, so the next merge only
+  has the GTIDs of one connection to add.
+
+  @retval false ok
+  @retval true  error, logged
+*/
+static bool build_dump_gtid_command(uint server_id, const char *logname,
+                                    size_t logname_len)
+{
+  if(!dump_gtid_command_stale && received_gtids.is_empty())
+  {
+    int2store(dump_gtid_command, get_dump_flags());
+    int4store(dump_gtid_command + ::BINLOG_FLAGS_INFO_SIZE, server_id);
+    return false;
+  }
+
+  global_sid_lock->wrlock();
+
+  //never ask again for what was received already
+  if(merge_received_gtids(gtid_set_excluded,received_gtids))
+  {
+    sql_print_error("Could not add the received GTIDs to the dump request");
+    global_sid_lock->unlock();
+    return true;
+  }
+  received_gtids.clear();
+
+  // allocate buffer
+  size_t encoded_data_size= gtid_set_excluded->get_encoded_length();
+  size_t allocation_size=
+          ::BINLOG_FLAGS_INFO_SIZE + ::BINLOG_SERVER_ID_INFO_SIZE +
+          ::BINLOG_NAME_SIZE_INFO_SIZE + logname_len +
+          ::BINLOG_POS_INFO_SIZE + ::BINLOG_DATA_SIZE_INFO_SIZE +
+          encoded_data_size + 1;
+
+  my_free(dump_gtid_command);
+  dump_gtid_command_size= 0;
+  dump_gtid_command_stale= true;
+  if (!(dump_gtid_command= (uchar *) my_malloc(PSI_NOT_INSTRUMENTED,
+                                               allocation_size, MYF(MY_WME))))
+  {
+    sql_print_error("Got fatal error allocating memory.");
+    global_sid_lock->unlock();
+    return true;
+  }
+  uchar* ptr_buffer= dump_gtid_command;
+  int2store(ptr_buffer, get_dump_flags());
+  ptr_buffer+= ::BINLOG_FLAGS_INFO_SIZE;
+  int4store(ptr_buffer, server_id);
+  ptr_buffer+= ::BINLOG_SERVER_ID_INFO_SIZE;
+  int4store(ptr_buffer, static_cast<uint32>(logname_len));
+  ptr_buffer+= ::BINLOG_NAME_SIZE_INFO_SIZE;
+  memcpy(ptr_buffer, logname, logname_len);
+  ptr_buffer+= logname_len;
+  int8store(ptr_buffer, start_position);
+  ptr_buffer+= ::BINLOG_POS_INFO_SIZE;
+  int4store(ptr_buffer, static_cast<uint32>(encoded_data_size));
+  ptr_buffer+= ::BINLOG_DATA_SIZE_INFO_SIZE;
+  gtid_set_excluded->encode(ptr_buffer);
+  ptr_buffer+= encoded_data_size;
+
+  global_sid_lock->unlock();
+
+  dump_gtid_command_size= ptr_buffer - dump_gtid_command;
+  DBUG_ASSERT(dump_gtid_command_size == (allocation_size - 1));
+  dump_gtid_command_stale= false;
+  return false;
+}
+
 /**
   Requests binlog dump from a remote server and prints the events it
   receives.
@@ -629,8 +1527,6 @@ Binlog_relay_IO_param* binlogRelayIoParam;
 static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
                                            const char* logname)
 {
-  const char *error_msg= NULL;
-  Log_event *ev= NULL;
   Log_event_type type= binary_log::UNKNOWN_EVENT;
   uchar *command_buffer= NULL;
   size_t command_size= 0;
@@ -646,6 +1542,16 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
   char log_file_name[FN_REFLEN + 1];
   Exit_status retval= OK_CONTINUE;
   enum enum_server_command command= COM_END;
+  const uchar *packet= NULL;
+  bool partial= false;
+  /* the start of an event written by receive_streamed_event() */
+  uchar streamed_head[STREAMED_HEAD_LEN];
+  bool streamed= false;
+  /* end of the current event in the master binlog */
+  unsigned long long event_log_pos= 0;
+  bool in_trx_buffer= false;
+  /* when the packet arrived, 0 without metrics */
+  ulonglong event_arrival= 0;
 //  fname[0]= log_file_name[0]= 0;
   log_file_name[0]= 0;
 
@@ -665,9 +1571,25 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
   */
 
   vs_reconnect:
-  if ((retval= safe_connect()) != OK_CONTINUE)
-  {
-    return retval;
+  reconnect_start_time= my_micro_time();
+  //a transaction cut by the reconnect is received again
+  trx_buffer.clear();
+  trx_buffering= false;
+  trx_buffer_written= false;
+  //the master waits for an ACK on the new connection instead
+  ack_owed= false;
+  for (uint attempt= 0; ; attempt++)
+  {
+    if(master_reconnect_has_candidates())
+      choose_master();
+    if ((retval= safe_connect()) == OK_CONTINUE)
+      break;
+    ulong delay_ms= master_reconnect_backoff_ms(attempt,reconnect_backoff_max_ms);
+    sql_print_warning("Connecting to master %s:%d failed, retrying in %lu ms",
+                      host,port,delay_ms);
+    admin_state_release();
+    my_sleep(delay_ms * 1000);
+    admin_state_acquire();
   }
   net= &mysql->net;
 
@@ -676,7 +1598,7 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
     return retval;
   }
 
-  if((retval=get_master_uuid()) != OK_CONTINUE)
+  if((retval=setup_dump_session()) != OK_CONTINUE)
   {
     return retval;
   }
@@ -720,19 +1642,15 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
   binlogRelayIoParam->server_id=server_id;
   binlogRelayIoParam->thread_id = 1;
   binlogRelayIoParam->master_log_name =NULL;
-  binlogRelayIoParam->master_log_pos=0;
-  binlogRelayIoParam->mysql = mysql;
-
-  if(handle_repl_semi_slave_request_dump((void*)binlogRelayIoParam,0))
-  {
-    sql_print_error("call repl_semi_slave_request_dump error");
-  }
+  binlogRelayIoParam->master_log_pos=0;
+  binlogRelayIoParam->mysql = mysql;
 
   if (opt_remote_proto == BINLOG_DUMP_NON_GTID)
   {
     bool suppress_warnings;
     register_slave_on_master(mysql,&suppress_warnings);
     command= COM_BINLOG_DUMP;
+    BINLOG_NAME_INFO_SIZE = strlen(new_binlog_file_name);
     size_t allocation_size= ::BINLOG_POS_OLD_INFO_SIZE +
       BINLOG_NAME_INFO_SIZE + ::BINLOG_FLAGS_INFO_SIZE +
       ::BINLOG_SERVER_ID_INFO_SIZE + 1;
@@ -768,53 +1686,23 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
     command= COM_BINLOG_DUMP_GTID;
     char real_log_name[]="";
     BINLOG_NAME_INFO_SIZE= strlen(real_log_name);
-    global_sid_lock->rdlock();
-
-    // allocate buffer
-    size_t encoded_data_size= gtid_set_excluded->get_encoded_length();
-    size_t allocation_size=
-            ::BINLOG_FLAGS_INFO_SIZE + ::BINLOG_SERVER_ID_INFO_SIZE +
-            ::BINLOG_NAME_SIZE_INFO_SIZE + BINLOG_NAME_INFO_SIZE +
-            ::BINLOG_POS_INFO_SIZE + ::BINLOG_DATA_SIZE_INFO_SIZE +
-            encoded_data_size + 1;
-
-    if (!(command_buffer= (uchar *) my_malloc(PSI_NOT_INSTRUMENTED,
-                                              allocation_size, MYF(MY_WME))))
-    {
-      sql_print_error("Got fatal error allocating memory.");
-      global_sid_lock->unlock();
+    if(build_dump_gtid_command(server_id,logname,BINLOG_NAME_INFO_SIZE))
       return ERROR_STOP;
-    }
-    uchar* ptr_buffer= command_buffer;
-    int2store(ptr_buffer, get_dump_flags());
-    ptr_buffer+= ::BINLOG_FLAGS_INFO_SIZE;
-    int4store(ptr_buffer, server_id);
-    ptr_buffer+= ::BINLOG_SERVER_ID_INFO_SIZE;
-    int4store(ptr_buffer, static_cast<uint32>(BINLOG_NAME_INFO_SIZE));
-    ptr_buffer+= ::BINLOG_NAME_SIZE_INFO_SIZE;
-    memcpy(ptr_buffer, logname, BINLOG_NAME_INFO_SIZE);
-    ptr_buffer+= BINLOG_NAME_INFO_SIZE;
-    int8store(ptr_buffer, start_position);
-    ptr_buffer+= ::BINLOG_POS_INFO_SIZE;
-    int4store(ptr_buffer, static_cast<uint32>(encoded_data_size));
-    ptr_buffer+= ::BINLOG_DATA_SIZE_INFO_SIZE;
-    gtid_set_excluded->encode(ptr_buffer);
-    ptr_buffer+= encoded_data_size;
-
-    global_sid_lock->unlock();
-
-    command_size= ptr_buffer - command_buffer;
-    DBUG_ASSERT(command_size == (allocation_size - 1));
+    command_buffer= dump_gtid_command;
+    command_size= dump_gtid_command_size;
   }
 
   if (simple_command(mysql, command, command_buffer, command_size, 1))
   {
     sql_print_information("Got fatal error sending the log dump command.");
-    my_free(command_buffer);
+    if (command_buffer != dump_gtid_command)
+      my_free(command_buffer);
     return ERROR_STOP;
   }
   re_connect_start_position = 0;
-  my_free(command_buffer);
+  if (command_buffer != dump_gtid_command)
+    my_free(command_buffer);
+  dump_stream_reset();
 
   const char* event_buf;
   for(;;)
@@ -822,7 +1710,9 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
     //recovery mode read.
     if(recovery_mode)
     {
-      len = cli_safe_read(mysql, NULL);
+      admin_state_release();
+      len = dump_stream_read(mysql, &packet, &partial);
+      admin_state_acquire();
       if (len == packet_error)
       {
         sql_print_error("Got error reading packet from server: %s,%i", mysql_error(mysql),mysql_errno(mysql));
@@ -834,13 +1724,16 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
         }
         recovery_mode=true;
         like_reset_slave();
+        metrics_reconnect(mysql_errno(mysql));
 
         goto vs_reconnect;
       }
       len--;
+      log_time_to_first_event();
+      event_arrival= metrics_enabled() ? my_micro_time() : 0;
 
-      event_buf= (const char *) net->read_pos + 1;
-      if(handle_repl_semi_slave_read_event((void*)binlogRelayIoParam,(char*)net->read_pos+1,len,&event_buf,&len))
+      event_buf= (const char *) packet + 1;
+      if(handle_repl_semi_slave_read_event((void*)binlogRelayIoParam,(char*)packet+1,len,&event_buf,&len))
       {
         sql_print_error("call handle_repl_semi_slave_read_event error");
       }
@@ -848,31 +1741,48 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
       if(type == binary_log::HEARTBEAT_LOG_EVENT)
       {
         sql_print_information("recovery mode,received HEARTBEAT log event");
+        heartbeat_received(event_buf,len);
         continue;
       }
 
-      if (!(ev= Log_event::read_log_event(event_buf,
-                                          len, &error_msg,
-                                          glob_description_event,
-                                          opt_verify_binlog_checksum)))
+      if(partial)
+      {
+        //only row or query events get this large, never ROTATE or FDE
+        if (open_result_file(new_binlog_file_name))
+          return ERROR_STOP;
+        recovery_mode=false;
+        goto streamed_event;
+      }
+
+      if(!event_len_valid(event_buf,len))
       {
-        sql_print_error("Could not construct log event object in reconnect mode: %s,event len: %lu", error_msg,len);
+        sql_print_error("Malformed event in reconnect mode, event type %d, event len: %lu",
+                        (int)type,len);
         return ERROR_STOP;
       }
-      /*
-        If reading from a remote host, ensure the temp_buf for the
-        Log_event class is pointing to the incoming stream.
-      */
-      ev->register_temp_buf((char*)event_buf);
+      if(event_checksum_failed(event_buf,len,type))
+      {
+        sql_print_error("Event crc check failed in reconnect mode, event type %d, event len: %lu",
+                        (int)type,len);
+        return ERROR_STOP;
+      }
+      event_log_pos= raw_event_log_pos((const uchar*)event_buf);
 
       if (type == binary_log::ROTATE_EVENT)
       {
-        Rotate_log_event *rev= (Rotate_log_event *)ev;
-
-        if(strcmp(new_binlog_file_name,rev->new_log_ident) ==0 )
+        size_t ident_len= 0;
+        const char *ident= raw_rotate_ident((const uchar*)event_buf,len,
+                                            glob_description_event->common_footer->checksum_alg,
+                                            &ident_len);
+        if(!ident || ident_len > FN_REFLEN)
+        {
+          sql_print_error("Malformed ROTATE_EVENT in reconnect mode, event len: %lu",len);
+          return ERROR_STOP;
+        }
+        if(ident_len == strlen(new_binlog_file_name) &&
+           !memcmp(new_binlog_file_name,ident,ident_len))
         {
           //无用的ROTATE_EVENT
-          reset_temp_buf_and_delete(rev);
           continue;
         }
         else
@@ -882,22 +1792,19 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
           goto normal_event;
         }
       }
-      else if(type == binary_log::FORMAT_DESCRIPTION_EVENT || type == binary_log:: PREVIOUS_GTIDS_LOG_EVENT)
+      else if(type == binary_log::FORMAT_DESCRIPTION_EVENT)
+      {
+        if(update_description_event(print_event_info,event_buf,len))
+          return ERROR_STOP;
+      }
+      else if(type == binary_log::PREVIOUS_GTIDS_LOG_EVENT)
       {
-        delete glob_description_event;
-        glob_description_event= (Format_description_log_event*) ev;
-        print_event_info->common_header_len= glob_description_event->common_header_len;
-        ev->temp_buf= 0;
-        ev= 0;
+        //already in the binlog being appended to
       }
       else
       {
-        if (!(result_file = my_fopen(new_binlog_file_name, binlog_file_open_mode,
-                                     MYF(MY_WME))))
-        {
-          sql_print_error("Could not create log file '%s'", new_binlog_file_name);
+        if (open_result_file(new_binlog_file_name))
           return ERROR_STOP;
-        }
         recovery_mode=false;
         goto normal_event;
       }
@@ -911,20 +1818,31 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
   for (;;)
   {
     //normal read.
-    len = cli_safe_read(mysql, NULL);
+    streamed= false;
+    if(catchup_mode_active() && catchup_wait_event())
+      return ERROR_STOP;
+    //admin commands run while waiting for the master, see admin_socket.h
+    admin_state_release();
+    len = dump_stream_read(mysql, &packet, &partial);
+    admin_state_acquire();
+    master_tuning_quickack(mysql);
     if (len == packet_error)
     {
       sql_print_error("Got error reading packet from server: %i,%s", mysql_errno(mysql),mysql_error(mysql));
       recovery_mode=true;
+      metrics_reconnect(mysql_errno(mysql));
       goto vs_reconnect;
     }
     len--;
-    if (len < 8 && net->read_pos[0] == 254)
+    if (len < 8 && packet[0] == 254)
     {
       sql_print_error("Got error reading packet from server: %i,%s",mysql_errno(mysql),mysql_error(mysql));
       recovery_mode=true;
+      metrics_reconnect(mysql_errno(mysql));
       goto vs_reconnect;
     }
+    log_time_to_first_event();
+    event_arrival= metrics_enabled() ? my_micro_time() : 0;
     //  break; // end of data
 //      DBUG_PRINT("info",( "len: %lu  net->read_pos[5]: %d\n",
 //			len, net->read_pos[5]));
@@ -933,8 +1851,8 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
       ROTATE_EVENT or FORMAT_DESCRIPTION_EVENT
     */
 
-    event_buf= (const char *) net->read_pos + 1;
-    if(handle_repl_semi_slave_read_event((void*)binlogRelayIoParam,(char*)net->read_pos+1,len,&event_buf,&len))
+    event_buf= (const char *) packet + 1;
+    if(handle_repl_semi_slave_read_event((void*)binlogRelayIoParam,(char*)packet+1,len,&event_buf,&len))
     {
       sql_print_error("call handle_repl_semi_slave_read_event error");
     }
@@ -943,26 +1861,88 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
     if (type == binary_log::HEARTBEAT_LOG_EVENT)
     {
       sql_print_information("received HEARTBEAT log event");
+      heartbeat_received(event_buf,len);
+      if(catchup_at_tail("a heartbeat shows nothing is left to receive",
+                         my_micro_time()) == CATCHUP_LEFT &&
+         catchup_sync())
+        return ERROR_STOP;
+      if(flush_owed_ack())
+        return ERROR_STOP;
       continue;
     }
 
+    streamed_event:
+    if (partial)
+    {
+      /*
+        Longer than a protocol packet: written as it arrives, only its
+        start is kept for what follows.
+      */
+      bool lost= false;
+      memcpy(streamed_head,event_buf,std::min((size_t)len,sizeof(streamed_head)));
+      trx_buffering= false;
+      if(flush_trx_buffer())
+        return ERROR_STOP;
+      if(receive_streamed_event((const uchar*)event_buf,len,&lost))
+      {
+        if(!lost)
+          return ERROR_STOP;
+        sql_print_error("Got error reading packet from server: %i,%s",mysql_errno(mysql),mysql_error(mysql));
+        recovery_mode=true;
+        metrics_reconnect(mysql_errno(mysql));
+        goto vs_reconnect;
+      }
+      streamed= true;
+      event_buf= (const char *) streamed_head;
+      len= raw_event_len(streamed_head);
+      respond_pos= raw_event_log_pos(streamed_head);
+      total_bytes+= len;
+      in_trx_buffer= false;
+      goto event_written;
+    }
+
 
-    if (!(ev= Log_event::read_log_event(event_buf,
-                                        len, &error_msg,
-                                        glob_description_event,
-                                        opt_verify_binlog_checksum)))
+    if(!event_len_valid(event_buf,len))
     {
-      sql_print_error("Could not construct log event object: %s", error_msg);
+      sql_print_error("Malformed event, event type %d, event len: %lu",
+                      (int)type,len);
+      return ERROR_STOP;
+    }
+    if(event_checksum_failed(event_buf,len,type))
+    {
+      sql_print_error("Event crc check failed, event type %d, event len: %lu",
+                      (int)type,len);
       return ERROR_STOP;
     }
     /*
-      If reading from a remote host, ensure the temp_buf for the
-      Log_event class is pointing to the incoming stream.
+      Events are not constructed, the few fields needed are read from
+      the buffer, see binlog_raw.h.
     */
-    ev->register_temp_buf((char*)event_buf);
-    respond_pos = ev->common_header->log_pos;
+    event_log_pos= raw_event_log_pos((const uchar*)event_buf);
 
     normal_event:
+    if(semi_sync_need_reply && rpl_semi_sync_slave_status &&
+       ack_policy == ACK_ON_RECEIVE)
+    {
+      //acknowledged before it is written, it is lost if we crash now
+      binlogRelayIoParam->master_log_name = new_binlog_file_name;
+      binlogRelayIoParam->master_log_pos = event_log_pos;
+      //as in ack_event(), the reply must not disturb the packet numbering
+      handle_repl_semi_slave_defer_reply((void*)binlogRelayIoParam);
+      send_ack(event_arrival);
+      semi_sync_need_reply= false;
+    }
+    if (trx_buffering &&
+        (type == binary_log::ROTATE_EVENT ||
+         type == binary_log::FORMAT_DESCRIPTION_EVENT ||
+         type == binary_log::STOP_EVENT))
+    {
+      //the transaction was cut short, write what there is before the binlog changes
+      trx_buffering= false;
+      if (flush_trx_buffer() || publish_trx_buffer())
+        return ERROR_STOP;
+    }
+
     /*
       If this is a Rotate event, maybe it's the end of the requested binlog;
       in this case we are done (stop transfer).
@@ -976,7 +1956,15 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
     {
       // error("last total bytes %lu",total_bytes);
       total_bytes =0;
-      Rotate_log_event *rev= (Rotate_log_event *)ev;
+      size_t ident_len= 0;
+      const char *ident= raw_rotate_ident((const uchar*)event_buf,len,
+                                          glob_description_event->common_footer->checksum_alg,
+                                          &ident_len);
+      if (!ident || ident_len > FN_REFLEN)
+      {
+        sql_print_error("Malformed ROTATE_EVENT, event len: %lu",len);
+        return ERROR_STOP;
+      }
       /*
         If this is a fake Rotate event, and not about our log, we can stop
         transfer. If this a real Rotate event (so it's not about our log,
@@ -985,21 +1973,11 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
         soon.
       */
 
-      if (output_file != 0)
-      {
-        my_snprintf(log_file_name, sizeof(log_file_name), "%s",
-                    rev->new_log_ident);
-        memset(new_binlog_file_name,0,(FN_REFLEN + 1));
-        my_stpcpy(new_binlog_file_name, rev->new_log_ident);
-      }
-      else
-      {
-        my_stpcpy(log_file_name, rev->new_log_ident);
-        memset(new_binlog_file_name,0,(FN_REFLEN + 1));
-        my_stpcpy(new_binlog_file_name, rev->new_log_ident);
-      }
+      memset(new_binlog_file_name,0,(FN_REFLEN + 1));
+      memcpy(new_binlog_file_name, ident, ident_len);
+      my_stpcpy(log_file_name, new_binlog_file_name);
 
-      if (rev->common_header->when.tv_sec == 0)
+      if (raw_event_when((const uchar*)event_buf) == 0)
       {
         if (!to_last_remote_log)
         {
@@ -1015,7 +1993,6 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
             log. If we are running with to_last_remote_log, we print it,
             because it serves as a useful marker between binlogs then.
           */
-          reset_temp_buf_and_delete(rev);
           continue;
         }
         /*
@@ -1039,14 +2016,11 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
       if ((old_off != BIN_LOG_HEADER_SIZE) && (!raw_mode))
         len= 1;
 
-      if (result_file && (result_file != stdout))
-        my_fclose(result_file, MYF(0));
-      if (!(result_file = my_fopen(log_file_name, binlog_file_open_mode,
-                                   MYF(MY_WME))))
-      {
-        sql_print_error("Could not create log file '%s'", log_file_name);
+      //the held back ACK is for the binlog being closed
+      if (send_owed_ack())
+        return ERROR_STOP;
+      if (open_result_file(log_file_name))
         return ERROR_STOP;
-      }
       result_file_no = fileno(result_file);
 
       DBUG_EXECUTE_IF("simulate_result_file_write_error_for_FD_event",
@@ -1057,6 +2031,7 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
         sql_print_error("Could not write into log file '%s'", log_file_name);
         return ERROR_STOP;
       }
+      binlog_mirror_write((const uchar*) BINLOG_MAGIC,BIN_LOG_HEADER_SIZE);
       //setbuf(result_file,NULL);
       //write index file
       if(my_fwrite(binary_log_index_file,(const uchar*)new_binlog_file_name,
@@ -1080,6 +2055,7 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
         sql_print_error("fflush binary log index file %s failed",index_file_name);
         return ERROR_STOP;
       }
+      binlog_mirror_index(new_binlog_file_name);
 
       total_bytes+=4; //BINLOG_MAGIC is 4 bytes.
 
@@ -1087,11 +2063,8 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
         Need to handle these events correctly in raw mode too
         or this could get messy
       */
-      delete glob_description_event;
-      glob_description_event= (Format_description_log_event*) ev;
-      print_event_info->common_header_len= glob_description_event->common_header_len;
-      ev->temp_buf= 0;
-      ev= 0;
+      if (update_description_event(print_event_info, event_buf, len))
+        return ERROR_STOP;
     }
 
     if (type == binary_log::LOAD_EVENT)
@@ -1102,19 +2075,22 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
               "the remote server. ");
     }
 
-    if (my_fwrite(result_file, (const uchar*)event_buf, len, MYF(MY_NABP)))
+    if (write_event((const uchar*)event_buf, len, type, event_log_pos,
+                    &in_trx_buffer))
     {
-      sql_print_error("Could not write into log file '%s'", log_file_name);
       retval= ERROR_STOP;
     }
+    else if (!in_trx_buffer)
+    {
+      respond_pos= event_log_pos;
+    }
     total_bytes += len;
-    if (ev)
-      reset_temp_buf_and_delete(ev);
     if (retval != OK_CONTINUE)
     {
       return retval;
     }
 
+    event_written:
     /*
       Let's adjust offset for remote log as for local log to produce
       similar text and to have --stop-position to work identically.
@@ -1123,26 +2099,36 @@ static Exit_status dump_remote_log_entries(PRINT_EVENT_INFO *print_event_info,
     binlogRelayIoParam->master_log_name = new_binlog_file_name;
     binlogRelayIoParam->master_log_pos = respond_pos;
 
-    if(semi_sync_need_reply)
+    if(len)
     {
-      if(fflush(result_file))
-      {
-        sql_print_error("fflush file %s failed",log_file_name);
-        return ERROR_STOP;
-      }
-      if(fsync_mode)
-      {
-        if(fsync(result_file_no))
-        {
-          sql_print_error("Sync file %s failed",log_file_name);
-          return ERROR_STOP;
-        }
-      }
-
+      metrics_event_received((const uchar*)event_buf,len);
+      gtid_index_append(new_binlog_file_name,(const uchar*)event_buf,len);
+      track_received_gtid(event_buf,len,type);
     }
+    if(type == binary_log::FORMAT_DESCRIPTION_EVENT)
+    {
+      //the previous binlog is closed now
+      binlog_compress_notify();
+    }
+
+    if(publish_trx_buffer())
+      return ERROR_STOP;
+    if(binlog_server_enabled() && len && !in_trx_buffer &&
+       publish_events(new_binlog_file_name,
+                      streamed ? NULL : (const uchar*)event_buf,len,
+                      my_ftell(result_file,MYF(0)),
+                      type == binary_log::FORMAT_DESCRIPTION_EVENT))
+      return ERROR_STOP;
+    if(catchup_mode_enabled() && len &&
+       catchup_event_written(event_buf,len,streamed))
+      return ERROR_STOP;
 
     //ack
-    handle_repl_semi_slave_queue_event((void*)binlogRelayIoParam,event_buf,0,0);
+    if(semi_sync_need_reply && rpl_semi_sync_slave_status)
+      ack_event(event_arrival);
+    if(flush_owed_ack())
+      return ERROR_STOP;
+    metrics_position(new_binlog_file_name,respond_pos);
 
   }
 
@@ -1187,6 +2173,178 @@ inline bool gtid_client_init()
 }
 
 
+////////////////////////////////////////////////////////////
+//
+// Admin socket commands, see admin_socket.h. The locked ones run
+// between two events of the receive thread.
+//
+////////////////////////////////////////////////////////////
+
+static bool admin_status(const char *, string *reply)
+{
+  static ulonglong last_time= 0;
+  static Metrics_summary last;
+  Metrics_summary now;
+  char line[FN_REFLEN + 128];
+  char *gtids= NULL;
+
+  my_snprintf(line,sizeof(line),"master %s:%d %s\n",host,port,
+              master_uuid ? master_uuid : "");
+  reply->append(line);
+  my_snprintf(line,sizeof(line),"binlog %s %llu\n",new_binlog_file_name,
+              respond_pos);
+  reply->append(line);
+  reply->append(catchup_mode_active() ? "write_mode catch-up\n" :
+                                        "write_mode tail\n");
+
+  //what the next dump request excludes: the GTIDs of the master at the start and those received
+  Gtid_set all(global_sid_map);
+  global_sid_lock->wrlock();
+  if(all.add_gtid_set(gtid_set_excluded) == RETURN_STATUS_OK &&
+     !merge_received_gtids(&all,received_gtids))
+    all.to_string(&gtids);
+  global_sid_lock->unlock();
+  reply->append("gtid_set ");
+  reply->append(gtids ? gtids : "?");
+  reply->append("\n");
+  my_free(gtids);
+
+  metrics_summary(&now);
+  ulonglong time_now= my_micro_time();
+  double seconds= last_time ? (time_now - last_time) / 1e6 : 0;
+  my_snprintf(line,sizeof(line),
+              "seconds_behind_master %llu\nbytes_behind_master %lld\n"
+              "events %llu\nbytes %llu\ntransactions %llu\nreconnects %llu\n",
+              now.seconds_behind,now.bytes_behind,now.events,now.bytes,
+              now.transactions,now.reconnects);
+  reply->append(line);
+  //rates since the previous status, none at the first one
+  if(seconds > 0)
+  {
+    my_snprintf(line,sizeof(line),
+                "events_per_second %llu\nbytes_per_second %llu\n"
+                "transactions_per_second %llu\n",
+                (ulonglong)((now.events - last.events) / seconds),
+                (ulonglong)((now.bytes - last.bytes) / seconds),
+                (ulonglong)((now.transactions - last.transactions) / seconds));
+    reply->append(line);
+  }
+  last= now;
+  last_time= time_now;
+
+  my_snprintf(line,sizeof(line),"ack_policy %s\nsemi_sync %s\n",
+              ack_policy_names[ack_policy],
+              rpl_semi_sync_slave_status ? "ON" : "OFF");
+  reply->append(line);
+  return false;
+}
+
+static bool admin_fsync(const char *, string *reply)
+{
+  char line[FN_REFLEN + 64];
+  if(!result_file || result_file == stdout)
+  {
+    *reply= "no binlog is open";
+    return true;
+  }
+  if(flush_result_file() || fsync(fileno(result_file)) ||
+     fflush(binary_log_index_file) || fsync(fileno(binary_log_index_file)) ||
+     (binlog_mirror_enabled() && binlog_mirror_sync(fileno(result_file),false)))
+  {
+    my_snprintf(line,sizeof(line),"sync of %s failed, errno %d",
+                new_binlog_file_name,errno);
+    *reply= line;
+    return true;
+  }
+  my_snprintf(line,sizeof(line),"synced %s %llu\n",new_binlog_file_name,
+              respond_pos);
+  *reply= line;
+  return false;
+}
+
+static bool admin_ack_policy(const char *args, string *reply)
+{
+  char line[64];
+  if(*args)
+  {
+    Ack_policy policy;
+    if(parse_ack_policy(args,&policy))
+    {
+      *reply= "ack_policy must be receive, write, fdatasync or group";
+      return true;
+    }
+    //an ACK held back is sent at the end of the next event
+    ack_policy= policy;
+    sql_print_information("Admin: ack_policy set to %s",args);
+  }
+  my_snprintf(line,sizeof(line),"ack_policy %s\n",ack_policy_names[ack_policy]);
+  *reply= line;
+  return false;
+}
+
+static bool admin_purge(const char *, string *reply)
+{
+  if(purge_binlog_file() != OK_CONTINUE)
+  {
+    *reply= "purge failed, see the error log";
+    return true;
+  }
+  *reply= "purged\n";
+  return false;
+}
+
+/**
+  Check the checksums of a closed binlog, or of all of them. It runs
+  unlocked, the last binlog of the index is the one being written and
+  is left alone.
+*/
+static bool admin_verify(const char *args, string *reply)
+{
+  std::vector<string> binlogs;
+  char line[FN_REFLEN + 64];
+
+  if(binlog_file_closed_binlogs(index_file_name,&binlogs))
+  {
+    *reply= "no binlog is being written yet";
+    return true;
+  }
+  if(*args)
+  {
+    if(std::find(binlogs.begin(),binlogs.end(),string(args)) == binlogs.end())
+    {
+      my_snprintf(line,sizeof(line),"%s is not a closed binlog",args);
+      *reply= line;
+      return true;
+    }
+    binlogs.assign(1,string(args));
+  }
+
+  for(size_t i= 0; i < binlogs.size(); i++)
+  {
+    my_off_t bad_pos= 0;
+    if(binlog_file_verify(binlogs[i].c_str(),&bad_pos))
+    {
+      my_snprintf(line,sizeof(line),"%s has a bad event at %llu",
+                  binlogs[i].c_str(),(ulonglong)bad_pos);
+      *reply= line;
+      return true;
+    }
+  }
+  my_snprintf(line,sizeof(line),"verified %lu binlogs\n",(ulong)binlogs.size());
+  *reply= line;
+  return false;
+}
+
+static const Admin_command admin_commands[]=
+{
+  { "status", "", true, admin_status },
+  { "fsync", "", true, admin_fsync },
+  { "ack_policy", "[receive|write|fdatasync|group]", true, admin_ack_policy },
+  { "purge", "", true, admin_purge },
+  { "verify", "[binlog]", false, admin_verify }
+};
+
+
 int main(int argc, char** argv)
 {
   //char **defaults_argv;
@@ -1241,6 +2399,43 @@ int main(int argc, char** argv)
   virtual_slave_log_file = strdup("virtual_slave.log");
   log_level = virtual_slave_config.Read("log_level",0);
   fsync_mode = virtual_slave_config.Read("fsync_mode",0);
+  string _s_ack_policy = virtual_slave_config.Read("ack_policy",string(""));
+  ack_policy_name = string_to_char(_s_ack_policy);
+  binlog_server_port = virtual_slave_config.Read("binlog_server_port",0);
+  string _s_binlog_server_bind = virtual_slave_config.Read("binlog_server_bind",string("127.0.0.1"));
+  binlog_server_bind = string_to_char(_s_binlog_server_bind);
+  tail_cache_size_mb = virtual_slave_config.Read("tail_cache_size_mb",64);
+  binlog_compress = virtual_slave_config.Read("binlog_compress",0);
+  binlog_compress_keep_files = virtual_slave_config.Read("binlog_compress_keep_files",2);
+  binlog_compress_level = virtual_slave_config.Read("binlog_compress_level",6);
+  string _s_master_candidates = virtual_slave_config.Read("master_candidates",string(""));
+  master_candidates = string_to_char(_s_master_candidates);
+  string _s_master_candidates_file = virtual_slave_config.Read("master_candidates_file",string(""));
+  master_candidates_file = string_to_char(_s_master_candidates_file);
+  reconnect_backoff_max_ms = virtual_slave_config.Read("reconnect_backoff_max_ms",30000);
+  master_compress = virtual_slave_config.Read("master_compress",0);
+  master_low_latency = virtual_slave_config.Read("master_low_latency",0);
+  master_rcvbuf_kb = virtual_slave_config.Read("master_rcvbuf_kb",0);
+  master_sndbuf_kb = virtual_slave_config.Read("master_sndbuf_kb",0);
+  master_busy_poll_usec = virtual_slave_config.Read("master_busy_poll_usec",0);
+  string _s_receive_thread_cpus = virtual_slave_config.Read("receive_thread_cpus",string(""));
+  receive_thread_cpus = string_to_char(_s_receive_thread_cpus);
+  trx_buffer_size_kb = virtual_slave_config.Read("trx_buffer_size_kb",1024);
+  metrics_port = virtual_slave_config.Read("metrics_port",0);
+  string _s_metrics_bind = virtual_slave_config.Read("metrics_bind",string("127.0.0.1"));
+  metrics_bind = string_to_char(_s_metrics_bind);
+  string _s_metrics_socket = virtual_slave_config.Read("metrics_socket",string(""));
+  metrics_socket = string_to_char(_s_metrics_socket);
+  string _s_admin_socket = virtual_slave_config.Read("admin_socket",string(""));
+  admin_socket = string_to_char(_s_admin_socket);
+  string _s_catchup_peer = virtual_slave_config.Read("catchup_peer",string(""));
+  catchup_peer = string_to_char(_s_catchup_peer);
+  string _s_mirror_binlog_dir = virtual_slave_config.Read("mirror_binlog_dir",string(""));
+  mirror_binlog_dir = string_to_char(_s_mirror_binlog_dir);
+  string _s_mirror_ack = virtual_slave_config.Read("mirror_ack",string("all"));
+  mirror_ack = string_to_char(_s_mirror_ack);
+  catchup_lag_seconds = virtual_slave_config.Read("catchup_lag_seconds",60);
+  catchup_sync_mb = virtual_slave_config.Read("catchup_sync_mb",64);
 
   binlog_file_open_mode = O_WRONLY | O_BINARY;
   respond_pos = 0;
@@ -1253,6 +2448,26 @@ int main(int argc, char** argv)
     return 1;
   }
 
+  if(!*ack_policy_name)
+    ack_policy= fsync_mode ? ACK_AFTER_FDATASYNC : ACK_AFTER_WRITE;
+  else if(parse_ack_policy(ack_policy_name,&ack_policy))
+  {
+    sql_print_error("Unknown ack_policy '%s', expected receive, write, "
+                    "fdatasync or group",ack_policy_name);
+    return 1;
+  }
+
+  if(master_reconnect_init(host,port,master_candidates,master_candidates_file))
+  {
+    return 1;
+  }
+
+  if(master_tuning_init(master_low_latency,master_rcvbuf_kb,master_sndbuf_kb,
+                        master_busy_poll_usec,receive_thread_cpus))
+  {
+    return 1;
+  }
+
   if(symisync_slave_init())
   {
     sql_print_error("init semisync_slave plugin error");
@@ -1290,11 +2505,72 @@ int main(int argc, char** argv)
     return 1;
   }
 
+  sql_print_information("binlog checksums are computed with %s",
+                        binlog_crc32_implementation());
+
+  if(gtid_index_init(index_file_name))
+  {
+    return 1;
+  }
+
+  catchup_mode_init(catchup_lag_seconds,catchup_sync_mb);
+
+  if(*mirror_binlog_dir)
+  {
+    Mirror_ack ack;
+    if(!strcmp(mirror_ack,"all"))
+      ack= MIRROR_ACK_ALL;
+    else if(!strcmp(mirror_ack,"first"))
+      ack= MIRROR_ACK_FIRST;
+    else
+    {
+      sql_print_error("mirror_ack %s is not all or first",mirror_ack);
+      return 1;
+    }
+    if(binlog_mirror_start(mirror_binlog_dir,index_file_name,ack))
+      return 1;
+  }
+
+  if(binlog_compress &&
+     binlog_compress_start(index_file_name,binlog_compress_keep_files,
+                           (int)binlog_compress_level))
+  {
+    return 1;
+  }
+
   if (determine_dump_mode() == ERROR_STOP)
   {
     return 1;
   }
+
+  if(binlog_server_port &&
+     (binlog_server_start(binlog_server_bind,binlog_server_port,index_file_name) ||
+      tail_cache_init((size_t)tail_cache_size_mb << 20)))
+  {
+    return 1;
+  }
+  if((metrics_port || *metrics_socket) &&
+     metrics_start(metrics_bind,metrics_port,metrics_socket))
+  {
+    return 1;
+  }
+  if(*admin_socket &&
+     admin_socket_start(admin_socket,admin_commands,
+                        array_elements(admin_commands)))
+  {
+    return 1;
+  }
+  //after the other threads are created, they are not pinned with it
+  if(master_tuning_pin_thread())
+  {
+    return 1;
+  }
   retval= dump_multiple_logs(argc, argv);
+  admin_socket_stop();
+  binlog_mirror_stop();
+  metrics_stop();
+  binlog_server_stop();
+  binlog_compress_stop();
   if (tmpdir.list)
   {
     free_tmpdir(&tmpdir);
@@ -1446,57 +2722,10 @@ int register_slave_on_master(MYSQL* mysql,/* Master_info *mi,*/
     DBUG_RETURN(1);
   }
 
-  if(set_heartbeat_period(mysql) !=0)
-  {
-    //todo log here
-    return -1;
-  }
-
-  if(set_slave_uuid(mysql) !=0)
-  {
-    //todo log here
-    return -1;
-  }
   DBUG_RETURN(0);
 }
 
 
-/**
- * set replication heartbeat period.
- * @param mysql
- * @return -1 failed; 0 successfully.
- */
-int set_heartbeat_period(MYSQL* mysql)
-{
-  char llbuf[22];
-  const char query_format[]= "SET @master_heartbeat_period= %s";
-  char query[sizeof(query_format) - 2 + sizeof(llbuf)];
-  /*
-     the period is an ulonglong of nano-secs.
-  */
-  llstr((ulonglong) (heartbeat_period*1000000000UL), llbuf);
-  sprintf(query, query_format, llbuf);
-  if(mysql_real_query(mysql,query,static_cast<ulong>(strlen(query))))
-  {
-    sql_print_error("%s error %s,%i",query,mysql_error(mysql),mysql_errno(mysql));
-    return -1;
-  }
-  return 0;
-}
-
-int set_slave_uuid(MYSQL* mysql)
-{
-  char* query = new char[100];
-  sprintf(query,"SET @slave_uuid= '63cf7450-9829-11e7-8a58-000c2985ca33'");
-  if(mysql_real_query(mysql,query,strlen(query)))
-  {
-    sql_print_error("%s error %s,%i",query,mysql_error(mysql),mysql_errno(mysql));
-    delete[] query;
-    return -1;
-  }
-  return 0;
-}
-
 char* string_to_char(string str)
 {
   char* p  = new char[str.length()+1];
@@ -1575,6 +2804,7 @@ Exit_status determine_dump_mode()
       }
       mysql_free_result(res);
       mysql_close(mysql);
+      mysql= NULL;
       binlog_file_open_mode = O_WRONLY | O_BINARY;
 
       if(like_reset_slave() == ERROR_STOP)
@@ -1588,6 +2818,15 @@ Exit_status determine_dump_mode()
     {
       //2:decide by last file and pos in binlog_dir;appending
       opt_remote_proto = BINLOG_DUMP_NON_GTID;
+      char next_file[FN_REFLEN + 1];
+      if(*catchup_peer && !peer_catchup(catchup_peer,index_file_name,next_file))
+      {
+        //the closed binlogs came from the peer, the master sends the rest
+        strcpy(new_binlog_file_name,next_file);
+        re_connect_start_position = BIN_LOG_HEADER_SIZE;
+        binlog_file_open_mode = O_WRONLY | O_BINARY;
+        break;
+      }
       if(search_last_file_position() != OK_CONTINUE)
       {
         sql_print_error("Search last file position from index file failed");
@@ -1634,9 +2873,27 @@ Exit_status get_executed_gtid()
 
 Exit_status set_gtid_executed()
 {
-  global_sid_lock->rdlock();
+  /*
+    gtid_executed of a long lived cluster can be megabytes. It is parsed
+    without the lock and added in one go, add_gtid_text() is only used
+    for what the fast parser rejects, for its error handling.
+  */
+  Received_gtid_set executed;
+  bool parsed= opt_exclude_gtids_str != NULL &&
+    !gtid_text_parse(opt_exclude_gtids_str,&executed);
+
+  global_sid_lock->wrlock();
 
-  if (opt_exclude_gtids_str != NULL)
+  if (parsed)
+  {
+    if (merge_received_gtids(gtid_set_excluded,executed))
+    {
+      sql_print_error("Could not configure --exclude-gtids '%s'", opt_exclude_gtids_str);
+      global_sid_lock->unlock();
+      return (ERROR_STOP);
+    }
+  }
+  else if (opt_exclude_gtids_str != NULL)
   {
     if (gtid_set_excluded->add_gtid_text(opt_exclude_gtids_str) !=
         RETURN_STATUS_OK)
@@ -1647,6 +2904,7 @@ Exit_status set_gtid_executed()
     }
   }
 
+  dump_gtid_command_stale= true;
   global_sid_lock->unlock();
   return OK_CONTINUE;
 }
@@ -1655,28 +2913,110 @@ Exit_status set_gtid_executed()
  * Get master uuid and set switch(true or false);
  * @return ERROR_STOP:failed; OK_CONTINUE:successfully;
  */
-Exit_status get_master_uuid()
+/**
+ * Set the session variables the master reads when dumping and read its
+ * server_uuid, with one multi-statement query instead of a round trip
+ * each:
+ *   SET @master_binlog_checksum= 'NONE', @master_heartbeat_period= N,
+ *       @slave_uuid= '...' [, @rpl_semi_sync_slave= 1];
+ *   SELECT @@global.server_uuid
+ *   [; SELECT @@global.rpl_semi_sync_master_enabled]
+ * The last statement fails on a master without semisync, as in
+ * repl_semi_slave_request_dump(); @rpl_semi_sync_slave is then an unused
+ * user variable.
+ * @return ERROR_STOP:failed; OK_CONTINUE:successfully;
+ */
+Exit_status setup_dump_session()
 {
-  char query[] ="show global variables like 'server_uuid'";
+  static char query[320];
+  static size_t query_len= 0;
+  static bool semisync= false;
+  Exit_status retval;
+
+  if(!query_len)
+  {
+    char llbuf[22];
+    /*
+       the period is an ulonglong of nano-secs.
+    */
+    llstr((ulonglong) (heartbeat_period*1000000000UL), llbuf);
+    semisync= handle_repl_semi_slave_enabled();
+    query_len= my_snprintf(query,sizeof(query),
+                           "SET @master_binlog_checksum= 'NONE', "
+                           "@master_heartbeat_period= %s, "
+                           "@slave_uuid= '63cf7450-9829-11e7-8a58-000c2985ca33'"
+                           "%s; SELECT @@global.server_uuid%s",
+                           llbuf,
+                           semisync ? ", @rpl_semi_sync_slave= 1" : "",
+                           semisync ?
+                           "; SELECT @@global.rpl_semi_sync_master_enabled" :
+                           "");
+  }
 
   mysql_free_result(mysql_store_result(mysql));
-  if(mysql_real_query(mysql,
-                      query,
-                      strlen(query))!=0)
+  if(mysql_real_query(mysql,query,static_cast<ulong>(query_len)) ||
+     mysql_next_result(mysql) != 0)
   {
-    sql_print_error("get master uuid failed:%i,%s",mysql_errno(mysql),mysql_error(mysql));
+    sql_print_error("%s error %s,%i",query,mysql_error(mysql),mysql_errno(mysql));
     return ERROR_STOP;
   }
   MYSQL_RES* res = mysql_store_result(mysql);
-  MYSQL_ROW row = mysql_fetch_row(res);
-  if(row[1])
+  MYSQL_ROW row = res ? mysql_fetch_row(res) : NULL;
+  if(!row || !row[0])
+  {
+    sql_print_error("get master uuid failed:%i,%s",mysql_errno(mysql),mysql_error(mysql));
+    mysql_free_result(res);
+    while(mysql_next_result(mysql) == 0)
+      mysql_free_result(mysql_store_result(mysql));
+    return ERROR_STOP;
+  }
+  retval= check_master_uuid(row[0]);
+  mysql_free_result(res);
+
+  if(semisync)
+  {
+    int status= mysql_next_result(mysql);
+    if(status == 0)
+    {
+      mysql_free_result(mysql_store_result(mysql));
+      handle_repl_semi_slave_request_dump_probed(true);
+    }
+    else if(status > 0 && mysql_errno(mysql) == ER_UNKNOWN_SYSTEM_VARIABLE)
+      handle_repl_semi_slave_request_dump_probed(false);
+    else
+    {
+      /*
+        Without the probe the dump would not know whether to answer
+        the semi-sync events, reconnect and try again.
+      */
+      sql_print_error("Execution failed on master: "
+                      "SELECT @@global.rpl_semi_sync_master_enabled; error %d",
+                      mysql_errno(mysql));
+      while(mysql_next_result(mysql) == 0)
+        mysql_free_result(mysql_store_result(mysql));
+      return ERROR_STOP;
+    }
+  }
+  while(mysql_next_result(mysql) == 0)
+    mysql_free_result(mysql_store_result(mysql));
+  return retval;
+}
+
+/**
+ * Compare the server_uuid of the master with the last one and set switch
+ * (true or false);
+ * @return ERROR_STOP:failed; OK_CONTINUE:successfully;
+ */
+Exit_status check_master_uuid(const char *server_uuid)
+{
+  if(server_uuid)
   {
      if(master_uuid_new)
      {
        free(master_uuid_new);
      }
 
-     master_uuid_new=strdup(row[1]);
+     master_uuid_new=strdup(server_uuid);
      if(!master_uuid) //get master uuid first times.
      {
        sql_print_information("connect to master first times,master_uuid:%s",master_uuid_new);
@@ -1712,7 +3052,6 @@ Exit_status get_master_uuid()
     sql_print_error("get master uuid failed:%i,%s",mysql_errno(mysql),mysql_error(mysql));
     return ERROR_STOP;
   }
-  mysql_free_result(res);
 
   return OK_CONTINUE;
 }
@@ -1782,7 +3121,9 @@ Exit_status search_last_file_position()
   }
 
   fseek(binary_log_index_file,0,SEEK_SET);
+  delete glob_description_event;
   glob_description_event= new Format_description_log_event(3);
+  description_event_body_len= 0;
   while(fgets(current_file,FN_REFLEN+1,binary_log_index_file)){}
 
   if(current_file[strlen(current_file)-1] == '\n')
@@ -1842,7 +3183,7 @@ Exit_status like_reset_slave()
     {
       current_file[strlen(current_file)-1] = '\0';
     }
-    if(remove(current_file) !=0 )
+    if(binlog_file_remove(current_file))
     {
       sql_print_warning("reset slave error remove file:%s",current_file);
     }
@@ -1850,6 +3191,10 @@ Exit_status like_reset_slave()
 
   //clear index file
   ftruncate(fileno(binary_log_index_file),SEEK_SET);
+  binlog_mirror_reset();
+  gtid_index_reset();
+  received_gtids.clear();
+  pending_gtid= false;
   return OK_CONTINUE;
 }
 
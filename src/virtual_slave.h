@@ -36,16 +36,68 @@ char* virtual_slave_log_file;
 int log_level;
 
 int register_slave_on_master(MYSQL* mysql,bool *suppress_warnings);
-int set_heartbeat_period(MYSQL* mysql);
-int set_slave_uuid(MYSQL* mysql);
 char* string_to_char(string str);
 extern bool semi_sync_need_reply;
+extern char rpl_semi_sync_slave_status;
 
 char* index_file_name = strdup("virtual_slave-bin.index");
 File index_file_fd;
 
-//sync mode
+//sync mode, only read when ack_policy is empty
 int fsync_mode;
+//when semi-sync ACKs are sent: receive, write, fdatasync or group
+char* ack_policy_name;
+
+//downstream binlog server, disabled when the port is 0
+uint binlog_server_port;
+char* binlog_server_bind;
+//recent events kept in memory for readers at the tail, 0 disables
+uint tail_cache_size_mb;
+
+//compress closed binlogs in the background, keeping the newest ones plain
+uint binlog_compress;
+uint binlog_compress_keep_files;
+uint binlog_compress_level;
+
+//events of a transaction are written at once up to this size, 0 disables
+uint trx_buffer_size_kb;
+
+//Prometheus metrics on a TCP port (0 disables) or a Unix socket
+uint metrics_port;
+char* metrics_bind;
+char* metrics_socket;
+
+//Unix socket for status and control commands, empty disables
+char* admin_socket;
+
+//binlog server of another virtual_slave to copy closed binlogs from at
+//startup, host:port, empty disables; only with get_start_gtid_mode 2
+char* catchup_peer;
+
+//second directory the binlogs are written to, on another disk, empty
+//disables; mirror_ack is all or first, see binlog_mirror.h
+char* mirror_binlog_dir;
+char* mirror_ack;
+
+//lag in seconds that switches the binlog writes to catch-up mode, 0
+//disables; in it the binlog is synced every catchup_sync_mb, 0 never
+uint catchup_lag_seconds;
+uint catchup_sync_mb;
+
+//other masters to probe on reconnect, and the longest wait between attempts
+char* master_candidates;
+char* master_candidates_file;
+uint reconnect_backoff_max_ms;
+
+//compressed protocol on the master connection
+uint master_compress;
+
+//socket options of the master connection and CPUs of the receive thread
+uint master_low_latency;
+uint master_rcvbuf_kb;
+uint master_sndbuf_kb;
+uint master_busy_poll_usec;
+char* receive_thread_cpus;
 
 char* line_b = strdup("\n");
 enum Exit_status {
@@ -60,7 +112,8 @@ enum Exit_status {
 
 Exit_status determine_dump_mode();
 
-Exit_status get_master_uuid();
+Exit_status setup_dump_session();
+Exit_status check_master_uuid(const char *server_uuid);
 Exit_status get_executed_gtid();
 Exit_status set_gtid_executed();
 